@@ -34,6 +34,20 @@
  * Sparse matrix routines.
  *
  * cholmod_spinv		sparse inverse (from simplicial Cholesky)
+ * cholmod_spinv_adjoint	reverse-mode derivative of the sparse inverse
+ * cholmod_spinv_fisher	tr(inv(A)*dA[i]*inv(A)*dA[j]) for all pairs i,j
+ * cholmod_spinv_diag	estimate of diag(inv(A)) by probing
+ * cholmod_spinv_lu	selected inverse of an unsymmetric matrix from L*U
+ * cholmod_spinv_factor	sparse inverse in the layout of the factor
+ * cholmod_spinv_plan_*	symbolic plan of the sparse inverse, saved to a file
+ * cholmod_spinv_cache_*	cache of plans used by cholmod_spinv
+ * cholmod_spinv_analyze_ordering  ordering with the cheapest sparse inverse
+ * cholmod_spinv_blas_threads	hook setting the number of BLAS threads
+ * cholmod_spinv_pages	NUMA first-touch or huge pages for large buffers
+ * cholmod_spinv_submit	asynchronous sparse inverse (also _poll, _wait)
+ * cholmod_spinv_file	out-of-core sparse inverse written to a file
+ * cholmod_spinv_mpi	sparse inverse distributed over MPI ranks (define
+ *			CHOLMOD_EXTRA_MPI, in libcholmod-extra-mpi)
  *
  * Requires the Core module, and three packages: CHOLMOD, AMD and COLAMD.
  * Optionally uses the Supernodal and Partition modules.
@@ -54,6 +68,14 @@
 #include <cholmod_supernodal.h>
 #endif
 
+#ifdef CHOLMOD_EXTRA_MPI
+#include <mpi.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* cholmod_spinv:  compute the sparse inverse of a sparse matrix              */
 /* -------------------------------------------------------------------------- */
@@ -68,5 +90,411 @@ cholmod_sparse *cholmod_spinv
 
 cholmod_sparse *cholmod_l_spinv( cholmod_factor *L, cholmod_common *Common ) ;
 
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_adjoint:  derivatives wrt A given derivatives wrt spinv(A)  */
+/* -------------------------------------------------------------------------- */
+
+cholmod_sparse *cholmod_spinv_adjoint
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse *X,	/* sparse inverse computed by cholmod_spinv */
+    cholmod_sparse *Xbar, /* derivatives with respect to the elements of X */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_adjoint( cholmod_factor *L, cholmod_sparse *X,
+    cholmod_sparse *Xbar, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_fisher:  F[i,j] = tr(inv(A)*dA[i]*inv(A)*dA[j])              */
+/* -------------------------------------------------------------------------- */
+
+cholmod_dense *cholmod_spinv_fisher
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse **dA, /* p symmetric matrices */
+    size_t p,		/* number of matrices */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_dense *cholmod_l_spinv_fisher( cholmod_factor *L, cholmod_sparse **dA,
+    size_t p, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_diag:  estimate diag(inv(A)) from solves with the factor     */
+/* -------------------------------------------------------------------------- */
+
+cholmod_sparse *cholmod_spinv_diag
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse *A,	/* matrix whose graph is coloured, or NULL */
+    int distance,	/* colouring distance, 0 for plain Hutchinson */
+    size_t nsamples,	/* number of random probes for each colour */
+    /* ---- output --- */
+    cholmod_dense **E,	/* standard errors of the estimates, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_diag( cholmod_factor *L, cholmod_sparse *A,
+    int distance, size_t nsamples, cholmod_dense **E, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_lu:  selected inverse from an LU factorization               */
+/* -------------------------------------------------------------------------- */
+
+cholmod_sparse *cholmod_spinv_lu
+(
+    /* ---- input ---- */
+    cholmod_sparse *L,	/* unit lower triangular factor */
+    cholmod_sparse *U,	/* upper triangular factor */
+    int *P,		/* row permutation, or NULL */
+    int *Q,		/* column permutation, or NULL */
+    double *R,		/* row scale factors, L*U = (R\A)(P,Q), or NULL */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_lu( cholmod_sparse *L, cholmod_sparse *U,
+    int64_t *P, int64_t *Q, double *R, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_factor:  sparse inverse in the layout of the factor          */
+/* -------------------------------------------------------------------------- */
+
+cholmod_factor *cholmod_spinv_factor
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use, shared with the result */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_factor *cholmod_l_spinv_factor( cholmod_factor *L,
+    cholmod_common *Common ) ;
+
+int cholmod_spinv_free_factor
+(
+    /* ---- in/out --- */
+    cholmod_factor **Z,	/* inverse from cholmod_spinv_factor, NULL on output */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_free_factor( cholmod_factor **Z, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_plan:  symbolic plan of the sparse inverse                   */
+/* -------------------------------------------------------------------------- */
+
+/* The arrays are Int (int32 for cholmod_*, int64 for cholmod_l_*) and point
+ * into one block, which is the image of the plan file. */
+
+typedef struct cholmod_spinv_plan_struct
+{
+    size_t n ;		/* L and the sparse inverse are n-by-n */
+    size_t nzx ;	/* number of elements of the sparse inverse */
+    size_t nlayout ;	/* size of the layout of L (L->xsize or L->nzmax) */
+    int is_super ;	/* TRUE if supernodal */
+    int ordering ;	/* ordering method used for Perm */
+
+    /* symbolic factorization, see cholmod_factor */
+    void *Perm ;	/* size n */
+    void *ColCount ;	/* size n */
+    size_t nsuper, ssize, maxcsize, maxesize ;
+    void *super ;	/* size nsuper+1, supernodal only */
+    void *pi ;		/* size nsuper+1, supernodal only */
+    void *px ;		/* size nsuper+1, supernodal only */
+    void *s ;		/* size ssize, supernodal only */
+    void *p ;		/* size n+1, column pointers of a simplicial L */
+    void *i ;		/* size nzx, row indices of a simplicial L */
+
+    /* pattern of the sparse inverse (lower triangle, sorted) */
+    void *Xp ;		/* size n+1 */
+    void *Xi ;		/* size nzx */
+    void *Xmap ;	/* size nzx, position in Xi of each element of the
+			 * lower triangle of the layout of L, column by column,
+			 * or -1-k if it is conjugated (k is the position) */
+
+    void *data ;	/* the file image that holds the arrays */
+    size_t size ;	/* its size in bytes */
+    int mapped ;	/* TRUE if data is a read-only memory map */
+
+} cholmod_spinv_plan ;
+
+cholmod_spinv_plan *cholmod_spinv_plan_create
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* numerical factorization */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_spinv_plan *cholmod_l_spinv_plan_create( cholmod_factor *L,
+    cholmod_common *Common ) ;
+
+int cholmod_spinv_plan_save
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to write */
+    const char *filename,	/* file to (over)write */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_plan_save( cholmod_spinv_plan *Plan, const char *filename,
+    cholmod_common *Common ) ;
+
+cholmod_spinv_plan *cholmod_spinv_plan_load
+(
+    /* ---- input ---- */
+    const char *filename,	/* file written by cholmod_spinv_plan_save */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_spinv_plan *cholmod_l_spinv_plan_load( const char *filename,
+    cholmod_common *Common ) ;
+
+cholmod_factor *cholmod_spinv_plan_factor
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to use */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_factor *cholmod_l_spinv_plan_factor( cholmod_spinv_plan *Plan,
+    cholmod_common *Common ) ;
+
+cholmod_sparse *cholmod_spinv_plan_numeric
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to use */
+    cholmod_factor *L,	/* factorization of the symbolic factor of Plan */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_plan_numeric( cholmod_spinv_plan *Plan,
+    cholmod_factor *L, cholmod_common *Common ) ;
+
+int cholmod_spinv_plan_free
+(
+    /* ---- in/out --- */
+    cholmod_spinv_plan **Plan,	/* plan to free, NULL on output */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_plan_free( cholmod_spinv_plan **Plan,
+    cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_cache:  plans reused by cholmod_spinv for repeated patterns  */
+/* -------------------------------------------------------------------------- */
+
+int cholmod_spinv_cache_config
+(
+    /* ---- input ---- */
+    size_t budget,	/* bytes of plans to keep, 0 turns the cache off */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_cache_config( size_t budget, cholmod_common *Common ) ;
+
+int cholmod_spinv_cache_stats
+(
+    /* ---- output --- */
+    size_t *hits,	/* lookups that found a plan, or NULL */
+    size_t *misses,	/* lookups that created a plan, or NULL */
+    size_t *bypasses,	/* calls with a plan over the budget, or NULL */
+    size_t *evictions,	/* plans removed to fit in the budget, or NULL */
+    size_t *nplans,	/* plans in the cache, or NULL */
+    size_t *bytes,	/* their size, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_cache_stats( size_t *hits, size_t *misses,
+    size_t *bypasses, size_t *evictions, size_t *nplans, size_t *bytes,
+    cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_analyze_ordering:  analyze for the cost of the inverse       */
+/* -------------------------------------------------------------------------- */
+
+cholmod_factor *cholmod_spinv_analyze_ordering
+(
+    /* ---- input ---- */
+    cholmod_sparse *A,	/* matrix to order and analyze */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_factor *cholmod_l_spinv_analyze_ordering( cholmod_sparse *A,
+    cholmod_common *Common ) ;
+
+int cholmod_spinv_estimate
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* symbolic or numerical factorization */
+    /* ---- output --- */
+    double *flops,	/* flops of the recursion, or NULL */
+    double *bytes,	/* memory of the result and workspace, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_estimate( cholmod_factor *L, double *flops, double *bytes,
+    cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_blas_threads:  hook for the number of BLAS threads           */
+/* -------------------------------------------------------------------------- */
+
+/* Sets the number of threads of the BLAS and returns the previous number,
+ * or 0 if it is not known.  With OpenBLAS the default hook calls
+ * openblas_set_num_threads, otherwise the default does nothing. */
+typedef int (*cholmod_spinv_blas_hook) (int nthreads) ;
+
+int cholmod_spinv_blas_threads
+(
+    /* ---- input ---- */
+    cholmod_spinv_blas_hook hook,	/* new hook, NULL for the default */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_blas_threads( cholmod_spinv_blas_hook hook,
+    cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_pages:  placement of the large buffers                       */
+/* -------------------------------------------------------------------------- */
+
+#define CHOLMOD_SPINV_PAGES_MALLOC 0	/* CHOLMOD(malloc) */
+#define CHOLMOD_SPINV_PAGES_TOUCH 1	/* fresh pages, placed by first touch */
+#define CHOLMOD_SPINV_PAGES_THP 2	/* same, with transparent huge pages */
+#define CHOLMOD_SPINV_PAGES_HUGETLB 3	/* explicit huge pages */
+
+int cholmod_spinv_pages
+(
+    /* ---- input ---- */
+    int mode,		/* CHOLMOD_SPINV_PAGES_* */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_pages( int mode, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_submit:  asynchronous sparse inverse                         */
+/* -------------------------------------------------------------------------- */
+
+/* A queued or running sparse inverse, finished with cholmod_spinv_wait */
+typedef struct cholmod_spinv_job_struct cholmod_spinv_job ;
+
+/* Called by the worker thread when a job finishes, with its status */
+typedef void (*cholmod_spinv_callback) (int status, void *data) ;
+
+int cholmod_spinv_submit
+(
+    /* ---- input ---- */
+    cholmod_factor *L,			/* factorization */
+    cholmod_spinv_callback callback,	/* called when done, may be NULL */
+    void *data,				/* passed to callback */
+    /* ---- output --- */
+    cholmod_spinv_job **Job,		/* the job, for poll and wait */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_submit( cholmod_factor *L,
+    cholmod_spinv_callback callback, void *data, cholmod_spinv_job **Job,
+    cholmod_common *Common ) ;
+
+int cholmod_spinv_poll
+(
+    /* ---- input ---- */
+    cholmod_spinv_job *Job,	/* job from cholmod_spinv_submit */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_poll( cholmod_spinv_job *Job, cholmod_common *Common ) ;
+
+cholmod_sparse *cholmod_spinv_wait
+(
+    /* ---- in/out --- */
+    cholmod_spinv_job **Job,	/* freed and set to NULL */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_wait( cholmod_spinv_job **Job,
+    cholmod_common *Common ) ;
+
+int cholmod_spinv_async_threads
+(
+    /* ---- input ---- */
+    int nworkers,	/* number of worker threads, at least 1 */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_async_threads( int nworkers, cholmod_common *Common ) ;
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_file:  out-of-core sparse inverse written to a file          */
+/* -------------------------------------------------------------------------- */
+
+int cholmod_spinv_file
+(
+    /* ---- input ---- */
+    cholmod_factor *L,		/* factorization to use */
+    const char *filename,	/* output file, binary format */
+    size_t budget,		/* bytes of memory for the inverse */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+int cholmod_l_spinv_file( cholmod_factor *L, const char *filename,
+    size_t budget, cholmod_common *Common ) ;
+
+#ifdef CHOLMOD_EXTRA_MPI
+
+/* -------------------------------------------------------------------------- */
+/* cholmod_spinv_mpi:  sparse inverse distributed over the ranks of MPI       */
+/* -------------------------------------------------------------------------- */
+
+#define CHOLMOD_SPINV_MPI_LOCAL (-1)	/* root: each rank keeps its part */
+
+cholmod_sparse *cholmod_spinv_mpi
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* supernodal factorization, the same on every rank */
+    int diag,		/* TRUE for only the diagonal */
+    int root,		/* rank that gets the whole result, or
+			   CHOLMOD_SPINV_MPI_LOCAL */
+    MPI_Comm comm,	/* ranks that share the work */
+    /* --------------- */
+    cholmod_common *Common
+) ;
+
+cholmod_sparse *cholmod_l_spinv_mpi( cholmod_factor *L, int diag, int root,
+    MPI_Comm comm, cholmod_common *Common ) ;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
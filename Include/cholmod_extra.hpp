@@ -0,0 +1,497 @@
+/* ========================================================================== */
+/* === cholmod_extra.hpp ==================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_extra.hpp is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * Header-only C++ interface of CHOLMOD Extra Module.
+ *
+ * Move-only handles own the CHOLMOD objects and free them when they go out
+ * of scope: common (cholmod_common, started and finished), factor
+ * (cholmod_factor), plan (cholmod_spinv_plan) and sparse (cholmod_sparse,
+ * e.g., the sparse inverse).  They are templates of the index type, int32_t
+ * for the cholmod_* and int64_t for the cholmod_l_* routines, which is also
+ * the StorageIndex of the Eigen matrices.  A failure throws
+ * cholmod_extra::error with the status of Common.
+ *
+ * Compressed column Eigen matrices are passed to CHOLMOD as views of their
+ * arrays, and a sparse result is seen as an Eigen::Map of its arrays
+ * (sparse::eigen), thus nothing is copied in either direction.  The scalar
+ * type is double for real and std::complex<double> for complex matrices,
+ * which has the layout of CHOLMOD_COMPLEX.  The sparse inverse holds the
+ * lower triangle, selfadjointView<Eigen::Lower> gives the symmetric matrix.
+ *
+ *   using namespace cholmod_extra ;
+ *   common<int> c ;
+ *   factor<int> L = factor<int>::analyze (c, A) ;
+ *   L.factorize (A) ;
+ *   sparse<int> X = spinv (L) ;
+ *   double trace = X.eigen<double> ().diagonal ().sum () ;
+ *
+ * The common object must outlive the handles made with it and is not
+ * movable.
+ * -------------------------------------------------------------------------- */
+
+#ifndef CHOLMOD_EXTRA_HPP
+#define CHOLMOD_EXTRA_HPP
+
+#include "cholmod_extra.h"
+#include <cholmod.h>
+#include <Eigen/SparseCore>
+
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace cholmod_extra
+{
+
+class error : public std::runtime_error
+{
+public:
+    error (const std::string &what, int status)
+        : std::runtime_error (what), status_ (status) { }
+
+    int status () const { return status_ ; }
+
+private:
+    int status_ ;
+} ;
+
+namespace detail
+{
+
+// The routines for an index type
+template <typename Index> struct api ;
+
+#define CHOLMOD_EXTRA_API(P)                                                  \
+    static int start (cholmod_common *c) { return P##start (c) ; }          \
+    static int finish (cholmod_common *c) { return P##finish (c) ; }        \
+    static int free (cholmod_sparse **A, cholmod_common *c)                 \
+        { return P##free_sparse (A, c) ; }                                  \
+    static int free (cholmod_factor **L, cholmod_common *c)                 \
+        { return P##free_factor (L, c) ; }                                  \
+    static int free (cholmod_spinv_plan **Plan, cholmod_common *c)          \
+        { return P##spinv_plan_free (Plan, c) ; }                           \
+    static cholmod_factor *analyze (cholmod_sparse *A, cholmod_common *c)   \
+        { return P##analyze (A, c) ; }                                      \
+    static cholmod_factor *analyze_ordering (cholmod_sparse *A,             \
+                                             cholmod_common *c)             \
+        { return P##spinv_analyze_ordering (A, c) ; }                       \
+    static int factorize (cholmod_sparse *A, cholmod_factor *L,             \
+                          cholmod_common *c)                                \
+        { return P##factorize (A, L, c) ; }                                 \
+    static cholmod_sparse *spinv (cholmod_factor *L, cholmod_common *c)     \
+        { return P##spinv (L, c) ; }                                        \
+    static cholmod_spinv_plan *plan_create (cholmod_factor *L,              \
+                                            cholmod_common *c)              \
+        { return P##spinv_plan_create (L, c) ; }                            \
+    static int plan_save (cholmod_spinv_plan *Plan, const char *f,          \
+                          cholmod_common *c)                                \
+        { return P##spinv_plan_save (Plan, f, c) ; }                        \
+    static cholmod_spinv_plan *plan_load (const char *f, cholmod_common *c) \
+        { return P##spinv_plan_load (f, c) ; }                              \
+    static cholmod_factor *plan_factor (cholmod_spinv_plan *Plan,           \
+                                        cholmod_common *c)                  \
+        { return P##spinv_plan_factor (Plan, c) ; }                         \
+    static cholmod_sparse *plan_numeric (cholmod_spinv_plan *Plan,          \
+                                         cholmod_factor *L,                 \
+                                         cholmod_common *c)                 \
+        { return P##spinv_plan_numeric (Plan, L, c) ; }
+
+template <> struct api<int32_t>
+{
+    static const int itype = CHOLMOD_INT ;
+    CHOLMOD_EXTRA_API (cholmod_)
+} ;
+
+template <> struct api<int64_t>
+{
+    static const int itype = CHOLMOD_LONG ;
+    CHOLMOD_EXTRA_API (cholmod_l_)
+} ;
+
+#undef CHOLMOD_EXTRA_API
+
+// The xtype of a scalar type
+template <typename Scalar> struct xtype ;
+template <> struct xtype<double>
+{
+    static const int value = CHOLMOD_REAL ;
+} ;
+template <> struct xtype<std::complex<double> >
+{
+    static const int value = CHOLMOD_COMPLEX ;
+} ;
+
+}   // namespace detail
+
+
+/* ========================================================================== */
+/* === common =============================================================== */
+/* ========================================================================== */
+
+template <typename Index>
+class common
+{
+public:
+    common () { detail::api<Index>::start (&c_) ; }
+    ~common () { detail::api<Index>::finish (&c_) ; }
+
+    common (const common &) = delete ;
+    common &operator= (const common &) = delete ;
+
+    cholmod_common *get () { return &c_ ; }
+    cholmod_common *operator-> () { return &c_ ; }
+
+    // Throws if p is NULL or the last call failed
+    template <typename T>
+    T *check (T *p, const char *what)
+    {
+        if (p == nullptr || c_.status < CHOLMOD_OK)
+            throw error (std::string (what) + " failed", c_.status) ;
+        return p ;
+    }
+
+    void check (int ok, const char *what)
+    {
+        if (!ok || c_.status < CHOLMOD_OK)
+            throw error (std::string (what) + " failed", c_.status) ;
+    }
+
+private:
+    cholmod_common c_ ;
+} ;
+
+
+/* ========================================================================== */
+/* === handle =============================================================== */
+/* ========================================================================== */
+
+// Owner of a CHOLMOD object of type T, freed with the common it was made with
+template <typename Index, typename T>
+class handle
+{
+public:
+    handle () : p_ (nullptr), c_ (nullptr) { }
+    handle (T *p, common<Index> &c) : p_ (p), c_ (&c) { }
+    ~handle () { reset () ; }
+
+    handle (const handle &) = delete ;
+    handle &operator= (const handle &) = delete ;
+
+    handle (handle &&o) noexcept : p_ (o.p_), c_ (o.c_) { o.p_ = nullptr ; }
+    handle &operator= (handle &&o) noexcept
+    {
+        if (this != &o)
+        {
+            reset () ;
+            p_ = o.p_ ;
+            c_ = o.c_ ;
+            o.p_ = nullptr ;
+        }
+        return *this ;
+    }
+
+    T *get () const { return p_ ; }
+    T *operator-> () const { return p_ ; }
+    explicit operator bool () const { return p_ != nullptr ; }
+    common<Index> &owner () const { return *c_ ; }
+
+    // Gives up the ownership
+    T *release ()
+    {
+        T *p = p_ ;
+        p_ = nullptr ;
+        return p ;
+    }
+
+    void reset ()
+    {
+        if (p_ != nullptr)
+            detail::api<Index>::free (&p_, c_->get ()) ;
+        p_ = nullptr ;
+    }
+
+protected:
+    T *p_ ;
+    common<Index> *c_ ;
+} ;
+
+
+/* ========================================================================== */
+/* === view ================================================================= */
+/* ========================================================================== */
+
+/*
+ * cholmod_sparse that points to the arrays of a compressed Eigen matrix, no
+ * copy.  stype is -1 if the lower triangle is used, 1 for the upper
+ * triangle and 0 for an unsymmetric matrix.  The view is valid as long as
+ * A is not modified.
+ */
+template <typename Scalar, typename Index>
+cholmod_sparse view
+(
+    const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> &A,
+    int stype = -1
+)
+{
+    cholmod_sparse S = cholmod_sparse () ;
+
+    if (!A.isCompressed ())
+        throw error ("view of an uncompressed matrix", CHOLMOD_INVALID) ;
+    S.nrow = A.rows () ;
+    S.ncol = A.cols () ;
+    S.nzmax = A.nonZeros () ;
+    S.p = const_cast<Index *> (A.outerIndexPtr ()) ;
+    S.i = const_cast<Index *> (A.innerIndexPtr ()) ;
+    S.x = const_cast<Scalar *> (A.valuePtr ()) ;
+    S.stype = stype ;
+    S.itype = detail::api<Index>::itype ;
+    S.xtype = detail::xtype<Scalar>::value ;
+    S.dtype = CHOLMOD_DOUBLE ;
+    S.sorted = 1 ;
+    S.packed = 1 ;
+    return S ;
+}
+
+
+/* ========================================================================== */
+/* === sparse =============================================================== */
+/* ========================================================================== */
+
+template <typename Index>
+class sparse : public handle<Index, cholmod_sparse>
+{
+public:
+    sparse () { }
+    sparse (cholmod_sparse *A, common<Index> &c)
+        : handle<Index, cholmod_sparse> (A, c) { }
+
+    // Eigen map of the arrays, no copy
+    template <typename Scalar>
+    Eigen::Map<const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> >
+    eigen () const
+    {
+        check<Scalar> () ;
+        return Eigen::Map<const Eigen::SparseMatrix<Scalar, Eigen::ColMajor,
+                                                    Index> >
+            (this->p_->nrow, this->p_->ncol, nnz (),
+             static_cast<const Index *> (this->p_->p),
+             static_cast<const Index *> (this->p_->i),
+             static_cast<const Scalar *> (this->p_->x)) ;
+    }
+
+    template <typename Scalar>
+    Eigen::Map<Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> > eigen ()
+    {
+        check<Scalar> () ;
+        return Eigen::Map<Eigen::SparseMatrix<Scalar, Eigen::ColMajor,
+                                              Index> >
+            (this->p_->nrow, this->p_->ncol, nnz (),
+             static_cast<Index *> (this->p_->p),
+             static_cast<Index *> (this->p_->i),
+             static_cast<Scalar *> (this->p_->x)) ;
+    }
+
+    Index nnz () const
+    {
+        return static_cast<const Index *> (this->p_->p) [this->p_->ncol] ;
+    }
+
+private:
+    template <typename Scalar>
+    void check () const
+    {
+        if (this->p_ == nullptr || !this->p_->packed ||
+            this->p_->xtype != detail::xtype<Scalar>::value ||
+            this->p_->dtype != CHOLMOD_DOUBLE)
+            throw error ("sparse matrix is not of the scalar type",
+                         CHOLMOD_INVALID) ;
+    }
+} ;
+
+
+/* ========================================================================== */
+/* === factor =============================================================== */
+/* ========================================================================== */
+
+template <typename Index>
+class factor : public handle<Index, cholmod_factor>
+{
+public:
+    factor () { }
+    factor (cholmod_factor *L, common<Index> &c)
+        : handle<Index, cholmod_factor> (L, c) { }
+
+    // Symbolic analysis with the orderings of Common (cholmod_analyze)
+    static factor analyze (common<Index> &c, cholmod_sparse *A)
+    {
+        return factor (c.check (detail::api<Index>::analyze (A, c.get ()),
+                                "cholmod_analyze"), c) ;
+    }
+
+    template <typename Scalar>
+    static factor analyze
+    (
+        common<Index> &c,
+        const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> &A,
+        int stype = -1
+    )
+    {
+        cholmod_sparse S = view (A, stype) ;
+        return analyze (c, &S) ;
+    }
+
+    // Symbolic analysis with the ordering of the cheapest sparse inverse
+    // (cholmod_spinv_analyze_ordering)
+    static factor analyze_spinv (common<Index> &c, cholmod_sparse *A)
+    {
+        return factor (c.check (detail::api<Index>::analyze_ordering (
+                                    A, c.get ()),
+                                "cholmod_spinv_analyze_ordering"), c) ;
+    }
+
+    template <typename Scalar>
+    static factor analyze_spinv
+    (
+        common<Index> &c,
+        const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> &A,
+        int stype = -1
+    )
+    {
+        cholmod_sparse S = view (A, stype) ;
+        return analyze_spinv (c, &S) ;
+    }
+
+    void factorize (cholmod_sparse *A)
+    {
+        this->c_->check (detail::api<Index>::factorize (A, this->p_,
+                                                        this->c_->get ()),
+                         "cholmod_factorize") ;
+    }
+
+    template <typename Scalar>
+    void factorize
+    (
+        const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> &A,
+        int stype = -1
+    )
+    {
+        cholmod_sparse S = view (A, stype) ;
+        factorize (&S) ;
+    }
+} ;
+
+
+/* ========================================================================== */
+/* === plan ================================================================= */
+/* ========================================================================== */
+
+template <typename Index>
+class plan : public handle<Index, cholmod_spinv_plan>
+{
+public:
+    plan () { }
+    plan (cholmod_spinv_plan *Plan, common<Index> &c)
+        : handle<Index, cholmod_spinv_plan> (Plan, c) { }
+
+    static plan create (const factor<Index> &L)
+    {
+        common<Index> &c = L.owner () ;
+        return plan (c.check (detail::api<Index>::plan_create (L.get (),
+                                                               c.get ()),
+                              "cholmod_spinv_plan_create"), c) ;
+    }
+
+    static plan load (common<Index> &c, const std::string &filename)
+    {
+        return plan (c.check (detail::api<Index>::plan_load (
+                                  filename.c_str (), c.get ()),
+                              "cholmod_spinv_plan_load"), c) ;
+    }
+
+    void save (const std::string &filename) const
+    {
+        this->c_->check (detail::api<Index>::plan_save (
+                             this->p_, filename.c_str (), this->c_->get ()),
+                         "cholmod_spinv_plan_save") ;
+    }
+
+    // Symbolic factor of the plan, to be factorized
+    factor<Index> symbolic () const
+    {
+        return factor<Index> (this->c_->check (
+                                  detail::api<Index>::plan_factor (
+                                      this->p_, this->c_->get ()),
+                                  "cholmod_spinv_plan_factor"), *this->c_) ;
+    }
+
+    sparse<Index> numeric (const factor<Index> &L) const
+    {
+        return sparse<Index> (this->c_->check (
+                                  detail::api<Index>::plan_numeric (
+                                      this->p_, L.get (), this->c_->get ()),
+                                  "cholmod_spinv_plan_numeric"), *this->c_) ;
+    }
+} ;
+
+
+/* ========================================================================== */
+/* === spinv ================================================================ */
+/* ========================================================================== */
+
+// Sparse inverse from a numerical factorization
+template <typename Index>
+sparse<Index> spinv (const factor<Index> &L)
+{
+    common<Index> &c = L.owner () ;
+    return sparse<Index> (c.check (detail::api<Index>::spinv (L.get (),
+                                                              c.get ()),
+                                   "cholmod_spinv"), c) ;
+}
+
+// Sparse inverse of a symmetric (Hermitian) positive definite Eigen matrix,
+// with the ordering of the cheapest sparse inverse
+template <typename Scalar, typename Index>
+sparse<Index> spinv
+(
+    common<Index> &c,
+    const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> &A,
+    int stype = -1
+)
+{
+    factor<Index> L = factor<Index>::analyze_spinv (c, A, stype) ;
+    L.factorize (A, stype) ;
+    return spinv (L) ;
+}
+
+}   // namespace cholmod_extra
+
+#endif
@@ -0,0 +1,339 @@
+/* ========================================================================== */
+/* === cholmod_extra_internal =============================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_extra_internal.h is licensed under Version 2 of the GNU
+ * General Public License, or (at your option) any later version. See
+ * LICENSE for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * Internal definitions shared by the source files of CHOLMOD Extra
+ * Module.  Not meant to be included in user code.
+ * -------------------------------------------------------------------------- */
+
+#ifndef CHOLMOD_EXTRA_INTERNAL_H
+#define CHOLMOD_EXTRA_INTERNAL_H
+
+// Start: no internal headers available.
+//#include "cholmod_internal.h"
+//#include <cholmod_cholesky.h>
+
+#include <cblas.h>
+#ifdef OPENBLAS_USE64BITINT // openblas_config.h
+#  define BLAS64  // SuiteSparse_config.h: SUITESPARSE_BLAS_INT int64_t/int32_t
+#endif
+#include <cholmod.h>
+#include "cholmod_extra.h"
+
+// SuiteSparse distinguishes Int and SUITESPARSE_BLAS_INT
+// and copy-converts Int to SUITESPARSE_BLAS_INT
+// when calling BLAS functions through its macros.
+// Likewise here: the index width Int is selected by DLONG (cholmod_l_*) as
+// in cholmod_internal.h, and the BLAS integer width BLAS_INT by the BLAS
+// library.  Arguments of type Int are converted explicitly with BLAS_INT at
+// the BLAS call sites, thus the int32 library works with ILP64 BLAS.
+// CHOLMOD_INT, CHOLMOD_LONG: cholmod.h
+// cholmod_types.h
+#undef Int
+#undef CHOLMOD
+#undef ITYPE
+#ifdef DLONG
+// CHOLMOD_INT64
+#  define Int int64_t
+#  define CHOLMOD(name) cholmod_l_ ## name
+#  define ITYPE CHOLMOD_LONG
+#else
+// CHOLMOD_INT32
+#  define Int int32_t
+#  define CHOLMOD(name) cholmod_ ## name
+#  define ITYPE CHOLMOD_INT
+#endif
+
+#undef BLAS_INT
+#ifdef OPENBLAS_USE64BITINT
+#  define BLAS_INT int64_t
+#else
+#  define BLAS_INT int32_t
+#endif
+
+// cholmod_internal.h
+#undef ASSERT
+#undef FALSE
+#undef TRUE
+#undef MAX
+#undef MIN
+#undef ERROR
+#ifndef NDEBUG
+#  include <assert.h>
+#  define ASSERT(expression) (assert (expression))
+#else
+#  define ASSERT(expression)
+#endif
+#define FALSE 0
+#define TRUE 1
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#define ERROR(status,msg) \
+    CHOLMOD(error) (status, __FILE__, __LINE__, msg, Common)
+#define RETURN_IF_NULL(A,result)                            \
+{                                                           \
+    if ((A) == NULL)                                        \
+    {                                                       \
+        if (Common->status != CHOLMOD_OUT_OF_MEMORY)        \
+        {                                                   \
+            ERROR (CHOLMOD_INVALID, "argument missing") ;   \
+        }                                                   \
+        return (result) ;                                   \
+    }                                                       \
+}
+
+// Return if Common is NULL or invalid
+#define RETURN_IF_NULL_COMMON(result)                       \
+{                                                           \
+    if (Common == NULL)                                     \
+    {                                                       \
+        return (result) ;                                   \
+    }                                                       \
+    if (Common->itype != ITYPE)                             \
+    {                                                       \
+        Common->status = CHOLMOD_INVALID ;                  \
+        return (result) ;                                   \
+    }                                                       \
+}
+#define RETURN_IF_XTYPE_INVALID(A,xtype1,xtype2,result)                       \
+{                                                                             \
+    if ((A)->xtype < (xtype1) || (A)->xtype > (xtype2) ||                     \
+        ((A)->xtype != CHOLMOD_PATTERN && ((A)->x) == NULL) ||                \
+        ((A)->xtype == CHOLMOD_ZOMPLEX && ((A)->z) == NULL) ||                \
+        !(((A)->dtype == CHOLMOD_DOUBLE) || ((A)->dtype == CHOLMOD_SINGLE)))  \
+    {                                                                         \
+        if (Common->status != CHOLMOD_OUT_OF_MEMORY)                          \
+        {                                                                     \
+            ERROR (CHOLMOD_INVALID, "invalid xtype or dtype") ;               \
+        }                                                                     \
+        return (result) ;                                                     \
+    }                                                                         \
+}
+
+// End: no internal headers available.
+
+#define PERM(j) (Lperm != NULL ? Lperm[j] : j)
+
+/* -------------------------------------------------------------------------- */
+/* internal routines shared by the modules                                    */
+/* -------------------------------------------------------------------------- */
+
+// Blocked inverse of one supernode: Z = [Z1; Z2] from L = [L1; L2] and the
+// already computed part V of the inverse (cholmod_spinv.c)
+void CHOLMOD(spinv_block)
+(
+    double *L,
+    double *Z,
+    double *V,
+    Int m,
+    Int n,
+    cholmod_common *Common
+) ;
+
+// Size of the numerical values of L, that is, the length of the arrays
+// indexed like L->x (cholmod_spinv.c)
+size_t CHOLMOD(spinv_layout_size) (cholmod_factor *L) ;
+
+// Index kl of the element (ip,jp), ip >= jp, of the (permuted) factor in the
+// array L->x, or -1 if the element is not in the pattern (cholmod_spinv.c)
+Int CHOLMOD(spinv_locate) (cholmod_factor *L, Int ip, Int jp) ;
+
+// Write (or add) the elements of A to F indexed like L->x, Iperm is the
+// inverse of L->Perm (cholmod_spinv.c)
+int CHOLMOD(spinv_scatter)
+(
+    cholmod_factor *L,
+    cholmod_sparse *A,
+    Int *Iperm,
+    double *F,
+    int add,
+    cholmod_common *Common
+) ;
+
+// Sparse matrix with the pattern of the sparse inverse from F indexed like
+// L->x, real or interleaved complex, or only the pattern (cholmod_spinv.c)
+cholmod_sparse *CHOLMOD(spinv_gather)
+(
+    cholmod_factor *L,
+    double *F,
+    int xtype,
+    cholmod_common *Common
+) ;
+
+// Pass over the supernodes (or columns) k0..k1-1 of L that counts (pass 0)
+// or stores (pass 1) the elements of the columns c0..c1-1 of the sparse
+// inverse (cholmod_spinv.c)
+void CHOLMOD(spinv_gather_range)
+(
+    cholmod_factor *L,
+    double *F,
+    int xtype,
+    Int k0,
+    Int k1,
+    Int c0,
+    Int c1,
+    Int *ncol,
+    Int *Xi,
+    double *Xx,
+    int pass
+) ;
+
+// Sorts the m row indices Xi of a column with their values, w doubles each
+// (cholmod_spinv.c)
+void CHOLMOD(spinv_sort_column) (Int *Xi, double *Xx, int w, Int m) ;
+
+// Indices in L->x of the lower triangle of V, the part of the inverse needed
+// by the supernode s or by the simplicial column jl (cholmod_spinv.c)
+void CHOLMOD(spinv_super_map) (cholmod_factor *L, Int s, Int *map) ;
+void CHOLMOD(spinv_simplicial_map) (cholmod_factor *L, Int jl, Int *map) ;
+
+// TRUE if L has the permutation and the layout of the plan
+// (cholmod_spinv_plan.c)
+int CHOLMOD(spinv_plan_matches) (cholmod_spinv_plan *Plan, cholmod_factor *L) ;
+
+// Size in bytes of the plan of L, without creating it (cholmod_spinv_plan.c)
+size_t CHOLMOD(spinv_plan_size) (cholmod_factor *L) ;
+
+// Sparse inverse through the plan cache, *cached is FALSE if the cache is off
+// or the plan would not fit in it (cholmod_spinv_cache.c)
+cholmod_sparse *CHOLMOD(spinv_cache_numeric)
+(
+    cholmod_factor *L,
+    int *cached,
+    cholmod_common *Common
+) ;
+
+// Lower triangle of the m x m matrix V from X indexed like L->x: V[i+j*m] =
+// X[map[i+j*m]], vectorised with run-time dispatch (cholmod_spinv_simd.c)
+void CHOLMOD(spinv_gather_lower)
+(
+    double *V,
+    const double *X,
+    const Int *map,
+    Int m
+) ;
+
+// Large buffers mapped fresh (placed by the first thread that writes them)
+// or with huge pages, freed with the same n and size
+// (cholmod_spinv_memory.c)
+void *CHOLMOD(spinv_malloc) (size_t n, size_t size, cholmod_common *Common) ;
+void *CHOLMOD(spinv_free)
+(
+    size_t n,
+    size_t size,
+    void *p,
+    cholmod_common *Common
+) ;
+
+// Sparse inverse in Xf indexed like L->x, interleaved complex if L is
+// complex or zomplex (cholmod_spinv.c)
+int CHOLMOD(spinv_numeric)
+(
+    cholmod_factor *L,
+    double *Xf,
+    cholmod_common *Common
+) ;
+
+// Inverse of one supernode once its ancestors are done, V, Z and map are
+// workspace of its size (cholmod_spinv.c)
+void CHOLMOD(spinv_supernode)
+(
+    cholmod_factor *L,
+    Int s,
+    double *Xf,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+) ;
+
+// Supernodal inverse with independent subtrees run concurrently and the
+// BLAS threads set per supernode, FALSE (and nothing done) if a single
+// thread is used (cholmod_spinv_sched.c)
+int CHOLMOD(spinv_super_hybrid)
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+) ;
+
+// Registers a threaded part of an inverse running in the process (the
+// scheduler or the threaded gather) and returns its share of the threads
+// (cholmod_spinv_sched.c)
+int CHOLMOD(spinv_threads_enter)
+(
+    cholmod_common *Common
+) ;
+
+// Current share of the threads of a registered part
+int CHOLMOD(spinv_threads_share)
+(
+    cholmod_common *Common
+) ;
+
+// Ends a registered part, the BLAS threads are restored by the last one
+void CHOLMOD(spinv_threads_leave)
+(
+    void
+) ;
+
+// Same for a complex or zomplex factorization (cholmod_spinv_complex.c)
+int CHOLMOD(spinv_complex_numeric)
+(
+    cholmod_factor *L,
+    double *Xc,
+    cholmod_common *Common
+) ;
+
+// Workspace of cholmod_spinv_adjoint_numeric: *dsize doubles and *isize
+// Ints (cholmod_spinv_adjoint.c)
+void CHOLMOD(spinv_adjoint_worksize)
+(
+    cholmod_factor *L,
+    size_t *dsize,
+    size_t *isize
+) ;
+
+// Derivatives wrt A in F given the derivatives wrt X in F and X in Xf, both
+// indexed like L->x.  Thread-safe, does not check the inputs
+// (cholmod_spinv_adjoint.c)
+void CHOLMOD(spinv_adjoint_numeric)
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *F,
+    double *Work,
+    Int *Iwork
+) ;
+
+#endif
@@ -0,0 +1,105 @@
+# Copyright (C) 2012 Jaakko Luttinen
+#
+# This file is part of CHOLMOD Extra Module, licensed under Version 2 of
+# the GNU General Public License, or (at your option) any later version.
+# See LICENSE for a text of the license.
+
+"""
+Sparse inverse of symmetric (Hermitian) positive definite SciPy matrices.
+
+The Cholesky factor and the sparse inverse are computed by CHOLMOD and
+cholmod_spinv without the GIL, so threads can compute inverses in
+parallel.  The sparse inverse is returned as a scipy.sparse.csc_matrix whose
+arrays are those of the cholmod_sparse result, not copies.  It holds the
+lower triangle of the inverse on the pattern of the factor::
+
+    L = cholmod_extra.Factor(K)
+    X = L.spinv()
+    trace = X.diagonal().sum()
+    X = X + scipy.sparse.tril(X, -1).H      # full matrix (a copy)
+
+The input matrix is not copied either if it is a CSC matrix with float64 or
+complex128 values and int32 (or int64) indices.
+"""
+
+import numpy as np
+import scipy.sparse as sp
+
+from ._core import CholmodError
+from . import _core
+
+__all__ = ['CholmodError', 'Factor', 'spinv']
+
+
+def _arrays(A, lower, itype=None):
+    """
+    CSC arrays of a square matrix, copied only if needed.  The indices are
+    int64 if they are given so, otherwise int32 unless itype is given.
+    """
+    A = sp.csc_matrix(A)
+    if A.shape[0] != A.shape[1]:
+        raise ValueError("matrix must be square")
+    dtype = np.complex128 if np.iscomplexobj(A.data) else np.float64
+    if itype is None:
+        itype = np.int64 if A.indices.dtype == np.int64 else np.int32
+    return (A.shape[0],
+            np.ascontiguousarray(A.indptr, dtype=itype),
+            np.ascontiguousarray(A.indices, dtype=itype),
+            np.ascontiguousarray(A.data, dtype=dtype),
+            -1 if lower else 1,
+            int(A.has_sorted_indices))
+
+
+class Factor:
+    """
+    Cholesky factorization of a sparse symmetric positive definite matrix.
+
+    Only the upper triangle of A is used, or the lower one if lower is
+    true.  ordering is 'default', 'natural', 'amd', 'metis', 'nesdis' or
+    'spinv' (the cheapest inverse, see cholmod_spinv_analyze_ordering) and
+    mode is 'auto', 'simplicial' or 'supernodal'.
+    """
+
+    def __init__(self, A, lower=False, ordering='default', mode='auto'):
+        n, p, i, x, stype, s = _arrays(A, lower)
+        self._factor = _core.Factor(n, p, i, x, stype, s, ordering, mode)
+        self._lower = lower
+        self._itype = i.dtype
+
+    @property
+    def n(self):
+        return self._factor.n
+
+    def factorize(self, A):
+        """
+        Factorize a matrix with the same pattern.
+        """
+        n, p, i, x, stype, s = _arrays(A, self._lower, self._itype)
+        if n != self.n:
+            raise ValueError("matrix has a different size")
+        self._factor.factorize(p, i, x, stype, s)
+
+    def spinv(self):
+        """
+        Sparse inverse as a csc_matrix (lower triangle) without copies.
+        """
+        X = self._factor.spinv()
+        dtype = np.complex128 if X.is_complex else np.float64
+        p = np.frombuffer(X.indptr, dtype=self._itype)
+        i = np.frombuffer(X.indices, dtype=self._itype)
+        x = np.frombuffer(X.data, dtype=dtype)
+        # The constructor would downcast int64 indices that fit in int32,
+        # which copies them, so the arrays are set on an empty matrix
+        Z = sp.csc_matrix((X.n, X.n), dtype=dtype)
+        Z.data = x
+        Z.indices = i
+        Z.indptr = p
+        Z.has_sorted_indices = True
+        return Z
+
+
+def spinv(A, lower=False, ordering='default', mode='auto'):
+    """
+    Sparse inverse of A, see Factor and Factor.spinv.
+    """
+    return Factor(A, lower, ordering, mode).spinv()
@@ -0,0 +1,599 @@
+/* ========================================================================== */
+/* === _core ================================================================ */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * _core.c is licensed under Version 2 of the GNU General Public
+ * License, or (at your option) any later version. See LICENSE for a
+ * text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ * Python extension of the cholmod_extra package (see __init__.py).
+ *
+ * A Factor owns a cholmod_common and a cholmod_factor.  The matrix is given
+ * as the arrays of a CSC matrix, which are read in place through the buffer
+ * protocol.  The analysis, the factorization and the sparse inverse run
+ * without the GIL, so Python threads with their own factors compute in
+ * parallel.  A lock per factor serializes the calls that use its common.
+ *
+ * Factor.spinv returns an Inverse that owns the cholmod_sparse result.  Its
+ * indptr, indices and data are Array objects that export the arrays of the
+ * result through the buffer protocol, so numpy.frombuffer and
+ * scipy.sparse.csc_matrix use them without copying.  An Array keeps its
+ * Inverse alive and an Inverse keeps its Factor alive, whose common frees
+ * the result.
+ *
+ * The indices are int32 (cholmod_*) or int64 (cholmod_l_*), chosen by the
+ * item size of the indices given to Factor.
+ * -------------------------------------------------------------------------- */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+#include "cholmod_extra.h"
+#include <cholmod.h>
+#include <string.h>
+
+static PyObject *CholmodError ;
+
+typedef struct
+{
+    PyObject_HEAD
+    cholmod_common Common ;
+    cholmod_factor *L ;
+    PyThread_type_lock lock ;
+    int dlong ;                 /* cholmod_l_* routines */
+    int started ;
+} FactorObject ;
+
+typedef struct
+{
+    PyObject_HEAD
+    FactorObject *factor ;
+    cholmod_sparse *X ;
+} InverseObject ;
+
+typedef struct
+{
+    PyObject_HEAD
+    PyObject *owner ;
+    void *buf ;
+    Py_ssize_t size ;           /* in bytes */
+} ArrayObject ;
+
+static PyTypeObject FactorType ;
+static PyTypeObject InverseType ;
+static PyTypeObject ArrayType ;
+
+/* CSC matrix viewing the buffers of Python objects */
+typedef struct
+{
+    Py_buffer p, i, x ;
+    cholmod_sparse A ;
+} spinv_matrix ;
+
+
+/* ========================================================================== */
+/* === Helpers ============================================================== */
+/* ========================================================================== */
+
+static PyObject *spinv_error(const char *what, int status)
+{
+    PyObject *e = Py_BuildValue("(si)", what, status) ;
+    if (e != NULL)
+    {
+        PyErr_SetObject(CholmodError, e) ;
+        Py_DECREF(e) ;
+    }
+    return NULL ;
+}
+
+static void spinv_release_matrix(spinv_matrix *M)
+{
+    PyBuffer_Release(&M->p) ;
+    PyBuffer_Release(&M->i) ;
+    PyBuffer_Release(&M->x) ;
+}
+
+/*
+ * Views the n-by-n CSC matrix (indptr, indices, data).  The indices have
+ * the item size of the factor and the data is float64 or complex128.
+ */
+static int spinv_get_matrix
+(
+    spinv_matrix *M,
+    Py_ssize_t n,
+    PyObject *indptr,
+    PyObject *indices,
+    PyObject *data,
+    int stype,
+    int sorted,
+    int dlong
+)
+{
+    Py_ssize_t isize = dlong ? sizeof(int64_t) : sizeof(int32_t) ;
+    Py_ssize_t nz ;
+
+    memset(M, 0, sizeof(spinv_matrix)) ;
+    if (PyObject_GetBuffer(indptr, &M->p, PyBUF_C_CONTIGUOUS) < 0
+        || PyObject_GetBuffer(indices, &M->i, PyBUF_C_CONTIGUOUS) < 0
+        || PyObject_GetBuffer(data, &M->x, PyBUF_C_CONTIGUOUS) < 0)
+    {
+        spinv_release_matrix(M) ;
+        return -1 ;
+    }
+    if (n < 0 || M->p.len != (n+1)*isize || M->i.len % isize != 0
+        || (M->x.itemsize != 8 && M->x.itemsize != 16))
+    {
+        spinv_release_matrix(M) ;
+        PyErr_SetString(PyExc_ValueError, "invalid CSC arrays") ;
+        return -1 ;
+    }
+    nz = dlong ? ((int64_t *) M->p.buf)[n] : ((int32_t *) M->p.buf)[n] ;
+    if (nz < 0 || M->i.len < nz*isize || M->x.len < nz*M->x.itemsize)
+    {
+        spinv_release_matrix(M) ;
+        PyErr_SetString(PyExc_ValueError, "CSC arrays are too short") ;
+        return -1 ;
+    }
+
+    M->A.nrow = n ;
+    M->A.ncol = n ;
+    M->A.nzmax = nz ;
+    M->A.p = M->p.buf ;
+    M->A.i = M->i.buf ;
+    M->A.x = M->x.buf ;
+    M->A.stype = stype ;
+    M->A.itype = dlong ? CHOLMOD_LONG : CHOLMOD_INT ;
+    M->A.xtype = M->x.itemsize == 16 ? CHOLMOD_COMPLEX : CHOLMOD_REAL ;
+    M->A.dtype = CHOLMOD_DOUBLE ;
+    M->A.sorted = sorted ;
+    M->A.packed = 1 ;
+    return 0 ;
+}
+
+/* Factorizes A without the GIL, the lock of the factor is held */
+static PyObject *spinv_factorize(FactorObject *self, spinv_matrix *M)
+{
+    cholmod_common *Common = &self->Common ;
+    int ok ;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK) ;
+    ok = self->dlong ? cholmod_l_factorize(&M->A, self->L, Common)
+        : cholmod_factorize(&M->A, self->L, Common) ;
+    PyThread_release_lock(self->lock) ;
+    Py_END_ALLOW_THREADS
+
+    spinv_release_matrix(M) ;
+    if (!ok || Common->status < CHOLMOD_OK)
+        return spinv_error("cholmod_factorize failed", Common->status) ;
+    if (Common->status == CHOLMOD_NOT_POSDEF)
+        return spinv_error("matrix is not positive definite",
+                           Common->status) ;
+    Py_RETURN_NONE ;
+}
+
+
+/* ========================================================================== */
+/* === Factor =============================================================== */
+/* ========================================================================== */
+
+static int Factor_init(FactorObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"n", "indptr", "indices", "data", "stype",
+                             "sorted", "ordering", "mode", NULL} ;
+    PyObject *indptr, *indices, *data, *r ;
+    Py_ssize_t n ;
+    Py_buffer b ;
+    int stype = 1, sorted = 1, order, supernodal ;
+    const char *ordering = "default", *mode = "auto" ;
+    cholmod_common *Common = &self->Common ;
+    spinv_matrix M ;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "nOOO|iiss", kwlist, &n,
+                                     &indptr, &indices, &data, &stype,
+                                     &sorted, &ordering, &mode))
+        return -1 ;
+    if (self->started)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Factor is already initialized") ;
+        return -1 ;
+    }
+
+    if (strcmp(mode, "simplicial") == 0)
+        supernodal = CHOLMOD_SIMPLICIAL ;
+    else if (strcmp(mode, "supernodal") == 0)
+        supernodal = CHOLMOD_SUPERNODAL ;
+    else if (strcmp(mode, "auto") == 0)
+        supernodal = CHOLMOD_AUTO ;
+    else
+        supernodal = -1 ;
+
+    if (strcmp(ordering, "default") == 0 || strcmp(ordering, "spinv") == 0)
+        order = -1 ;
+    else if (strcmp(ordering, "natural") == 0)
+        order = CHOLMOD_NATURAL ;
+    else if (strcmp(ordering, "amd") == 0)
+        order = CHOLMOD_AMD ;
+    else if (strcmp(ordering, "metis") == 0)
+        order = CHOLMOD_METIS ;
+    else if (strcmp(ordering, "nesdis") == 0)
+        order = CHOLMOD_NESDIS ;
+    else
+        order = -2 ;
+
+    if (supernodal < 0 || order < -1)
+    {
+        PyErr_SetString(PyExc_ValueError, "unknown ordering or mode") ;
+        return -1 ;
+    }
+
+    /* The index width of the factor is that of the given indices */
+    if (PyObject_GetBuffer(indices, &b, PyBUF_C_CONTIGUOUS) < 0)
+        return -1 ;
+    self->dlong = b.itemsize == sizeof(int64_t) ;
+    PyBuffer_Release(&b) ;
+
+    if (spinv_get_matrix(&M, n, indptr, indices, data, stype, sorted,
+                         self->dlong) < 0)
+        return -1 ;
+
+    self->lock = PyThread_allocate_lock() ;
+    if (self->lock == NULL)
+    {
+        spinv_release_matrix(&M) ;
+        PyErr_NoMemory() ;
+        return -1 ;
+    }
+    if (self->dlong)
+        cholmod_l_start(Common) ;
+    else
+        cholmod_start(Common) ;
+    self->started = 1 ;
+    Common->print = 0 ;
+    Common->supernodal = supernodal ;
+    if (order >= 0)
+    {
+        Common->nmethods = 1 ;
+        Common->method[0].ordering = order ;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    if (strcmp(ordering, "spinv") == 0)
+        self->L = self->dlong ? cholmod_l_spinv_analyze_ordering(&M.A, Common)
+            : cholmod_spinv_analyze_ordering(&M.A, Common) ;
+    else
+        self->L = self->dlong ? cholmod_l_analyze(&M.A, Common)
+            : cholmod_analyze(&M.A, Common) ;
+    Py_END_ALLOW_THREADS
+
+    if (self->L == NULL)
+    {
+        spinv_release_matrix(&M) ;
+        spinv_error("cholmod_analyze failed", Common->status) ;
+        return -1 ;
+    }
+    r = spinv_factorize(self, &M) ;
+    Py_XDECREF(r) ;
+    return r == NULL ? -1 : 0 ;
+}
+
+static void Factor_dealloc(FactorObject *self)
+{
+    if (self->started)
+    {
+        if (self->dlong)
+        {
+            cholmod_l_free_factor(&self->L, &self->Common) ;
+            cholmod_l_finish(&self->Common) ;
+        }
+        else
+        {
+            cholmod_free_factor(&self->L, &self->Common) ;
+            cholmod_finish(&self->Common) ;
+        }
+    }
+    if (self->lock != NULL)
+        PyThread_free_lock(self->lock) ;
+    Py_TYPE(self)->tp_free((PyObject *) self) ;
+}
+
+static PyObject *Factor_factorize(FactorObject *self, PyObject *args,
+                                  PyObject *kwds)
+{
+    static char *kwlist[] = {"indptr", "indices", "data", "stype", "sorted",
+                             NULL} ;
+    PyObject *indptr, *indices, *data ;
+    int stype = 1, sorted = 1 ;
+    spinv_matrix M ;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOO|ii", kwlist, &indptr,
+                                     &indices, &data, &stype, &sorted))
+        return NULL ;
+    if (self->L == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Factor is not initialized") ;
+        return NULL ;
+    }
+    if (spinv_get_matrix(&M, self->L->n, indptr, indices, data, stype,
+                         sorted, self->dlong) < 0)
+        return NULL ;
+    return spinv_factorize(self, &M) ;
+}
+
+static PyObject *Factor_spinv(FactorObject *self, PyObject *unused)
+{
+    cholmod_common *Common = &self->Common ;
+    cholmod_sparse *X ;
+    InverseObject *inv ;
+
+    if (self->L == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Factor is not initialized") ;
+        return NULL ;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK) ;
+    X = self->dlong ? cholmod_l_spinv(self->L, Common)
+        : cholmod_spinv(self->L, Common) ;
+    PyThread_release_lock(self->lock) ;
+    Py_END_ALLOW_THREADS
+
+    if (X == NULL)
+        return spinv_error("cholmod_spinv failed", Common->status) ;
+    inv = PyObject_New(InverseObject, &InverseType) ;
+    if (inv == NULL)
+    {
+        if (self->dlong)
+            cholmod_l_free_sparse(&X, Common) ;
+        else
+            cholmod_free_sparse(&X, Common) ;
+        return NULL ;
+    }
+    Py_INCREF(self) ;
+    inv->factor = self ;
+    inv->X = X ;
+    return (PyObject *) inv ;
+}
+
+static PyObject *Factor_get_n(FactorObject *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->L != NULL ? (Py_ssize_t) self->L->n : 0) ;
+}
+
+static PyObject *Factor_get_is_super(FactorObject *self, void *closure)
+{
+    return PyBool_FromLong(self->L != NULL && self->L->is_super) ;
+}
+
+static PyMethodDef Factor_methods[] =
+{
+    {"factorize", (PyCFunction) Factor_factorize,
+     METH_VARARGS | METH_KEYWORDS,
+     "factorize(indptr, indices, data, stype=1, sorted=1)\n\n"
+     "Numerical factorization of a matrix with the analysed pattern."},
+    {"spinv", (PyCFunction) Factor_spinv, METH_NOARGS,
+     "spinv()\n\nSparse inverse (lower triangle) as an Inverse."},
+    {NULL}
+} ;
+
+static PyGetSetDef Factor_getset[] =
+{
+    {"n", (getter) Factor_get_n, NULL, "Size of the matrix.", NULL},
+    {"is_super", (getter) Factor_get_is_super, NULL,
+     "True for a supernodal factor.", NULL},
+    {NULL}
+} ;
+
+static PyTypeObject FactorType =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cholmod_extra._core.Factor",
+    .tp_basicsize = sizeof(FactorObject),
+    .tp_dealloc = (destructor) Factor_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Factor(n, indptr, indices, data, stype=1, sorted=1, "
+              "ordering='default', mode='auto')\n\n"
+              "Cholesky factorization of a CSC matrix.",
+    .tp_methods = Factor_methods,
+    .tp_getset = Factor_getset,
+    .tp_init = (initproc) Factor_init,
+    .tp_new = PyType_GenericNew,
+} ;
+
+
+/* ========================================================================== */
+/* === Inverse ============================================================== */
+/* ========================================================================== */
+
+static void Inverse_dealloc(InverseObject *self)
+{
+    FactorObject *F = self->factor ;
+
+    /* Another thread may be using the common, it does not need the GIL */
+    PyThread_acquire_lock(F->lock, WAIT_LOCK) ;
+    if (F->dlong)
+        cholmod_l_free_sparse(&self->X, &F->Common) ;
+    else
+        cholmod_free_sparse(&self->X, &F->Common) ;
+    PyThread_release_lock(F->lock) ;
+    Py_DECREF(F) ;
+    PyObject_Del(self) ;
+}
+
+/* Array of the result exporting one of its arrays */
+static PyObject *Inverse_array(InverseObject *self, void *buf,
+                               Py_ssize_t size)
+{
+    ArrayObject *a = PyObject_New(ArrayObject, &ArrayType) ;
+    if (a == NULL)
+        return NULL ;
+    Py_INCREF(self) ;
+    a->owner = (PyObject *) self ;
+    a->buf = buf ;
+    a->size = size ;
+    return (PyObject *) a ;
+}
+
+static Py_ssize_t Inverse_isize(InverseObject *self)
+{
+    return self->factor->dlong ? sizeof(int64_t) : sizeof(int32_t) ;
+}
+
+static Py_ssize_t Inverse_nnz(InverseObject *self)
+{
+    Py_ssize_t n = self->X->ncol ;
+    return self->factor->dlong ? ((int64_t *) self->X->p)[n]
+        : ((int32_t *) self->X->p)[n] ;
+}
+
+static PyObject *Inverse_get_indptr(InverseObject *self, void *closure)
+{
+    return Inverse_array(self, self->X->p,
+                         (self->X->ncol + 1) * Inverse_isize(self)) ;
+}
+
+static PyObject *Inverse_get_indices(InverseObject *self, void *closure)
+{
+    return Inverse_array(self, self->X->i,
+                         Inverse_nnz(self) * Inverse_isize(self)) ;
+}
+
+static PyObject *Inverse_get_data(InverseObject *self, void *closure)
+{
+    Py_ssize_t entry = self->X->xtype == CHOLMOD_COMPLEX ? 16 : 8 ;
+    return Inverse_array(self, self->X->x, Inverse_nnz(self) * entry) ;
+}
+
+static PyObject *Inverse_get_n(InverseObject *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->X->ncol) ;
+}
+
+static PyObject *Inverse_get_is_complex(InverseObject *self, void *closure)
+{
+    return PyBool_FromLong(self->X->xtype == CHOLMOD_COMPLEX) ;
+}
+
+static PyGetSetDef Inverse_getset[] =
+{
+    {"n", (getter) Inverse_get_n, NULL, "Size of the matrix.", NULL},
+    {"is_complex", (getter) Inverse_get_is_complex, NULL,
+     "True for complex128 data.", NULL},
+    {"indptr", (getter) Inverse_get_indptr, NULL,
+     "Column pointers (buffer, int32 or int64).", NULL},
+    {"indices", (getter) Inverse_get_indices, NULL,
+     "Row indices (buffer, int32 or int64).", NULL},
+    {"data", (getter) Inverse_get_data, NULL,
+     "Values (buffer, float64 or complex128).", NULL},
+    {NULL}
+} ;
+
+static PyTypeObject InverseType =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cholmod_extra._core.Inverse",
+    .tp_basicsize = sizeof(InverseObject),
+    .tp_dealloc = (destructor) Inverse_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Sparse inverse owned by CHOLMOD, lower triangle in CSC.",
+    .tp_getset = Inverse_getset,
+} ;
+
+
+/* ========================================================================== */
+/* === Array ================================================================ */
+/* ========================================================================== */
+
+static void Array_dealloc(ArrayObject *self)
+{
+    Py_DECREF(self->owner) ;
+    PyObject_Del(self) ;
+}
+
+static int Array_getbuffer(ArrayObject *self, Py_buffer *view, int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject *) self, self->buf, self->size,
+                             0, flags) ;
+}
+
+static PyBufferProcs Array_as_buffer =
+{
+    (getbufferproc) Array_getbuffer,
+    NULL,
+} ;
+
+static PyTypeObject ArrayType =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cholmod_extra._core.Array",
+    .tp_basicsize = sizeof(ArrayObject),
+    .tp_dealloc = (destructor) Array_dealloc,
+    .tp_as_buffer = &Array_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Bytes of an array of an Inverse (buffer protocol).",
+} ;
+
+
+/* ========================================================================== */
+/* === Module =============================================================== */
+/* ========================================================================== */
+
+static struct PyModuleDef spinv_module =
+{
+    PyModuleDef_HEAD_INIT,
+    "cholmod_extra._core",
+    "CHOLMOD factors and sparse inverses (see the cholmod_extra package).",
+    -1,
+    NULL,
+} ;
+
+PyMODINIT_FUNC PyInit__core(void)
+{
+    PyObject *m ;
+
+    if (PyType_Ready(&FactorType) < 0 || PyType_Ready(&InverseType) < 0
+        || PyType_Ready(&ArrayType) < 0)
+        return NULL ;
+    m = PyModule_Create(&spinv_module) ;
+    if (m == NULL)
+        return NULL ;
+    CholmodError = PyErr_NewExceptionWithDoc(
+        "cholmod_extra.CholmodError",
+        "CHOLMOD failed, args are (message, Common->status).",
+        PyExc_RuntimeError, NULL) ;
+    Py_XINCREF(CholmodError) ;
+    Py_INCREF(&FactorType) ;
+    if (CholmodError == NULL
+        || PyModule_AddObject(m, "CholmodError", CholmodError) < 0
+        || PyModule_AddObject(m, "Factor", (PyObject *) &FactorType) < 0)
+    {
+        Py_DECREF(m) ;
+        return NULL ;
+    }
+    return m ;
+}
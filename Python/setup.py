@@ -0,0 +1,27 @@
+# Builds the Python bindings of CHOLMOD Extra Module against the library in
+# ../Build, e.g. "python setup.py build_ext --inplace" after "make".
+
+import os
+from setuptools import setup, Extension
+
+here = os.path.dirname(os.path.abspath(__file__))
+build = os.path.join(here, '..', 'Build')
+
+core = Extension(
+    'cholmod_extra._core',
+    sources=['cholmod_extra/_core.c'],
+    include_dirs=[os.path.join(here, '..', 'Include')],
+    library_dirs=[build],
+    runtime_library_dirs=[os.path.abspath(build)],
+    libraries=['cholmod-extra', 'cholmod'],
+)
+
+setup(
+    name='cholmod-extra',
+    version='1.2.0',
+    description='Sparse inverse of CHOLMOD factors for SciPy',
+    license='GPLv2+',
+    packages=['cholmod_extra'],
+    install_requires=['numpy', 'scipy'],
+    ext_modules=[core],
+)
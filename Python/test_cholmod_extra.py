@@ -0,0 +1,104 @@
+# Copyright (C) 2012 Jaakko Luttinen
+#
+# This file is part of CHOLMOD Extra Module, licensed under Version 2 of
+# the GNU General Public License, or (at your option) any later version.
+# See LICENSE for a text of the license.
+
+"""
+Tests of the Python bindings, run with "python -m unittest" in Python/.
+"""
+
+import threading
+import unittest
+
+import numpy as np
+import scipy.sparse as sp
+
+import cholmod_extra
+
+
+def laplacian(m, c=0.0):
+    """
+    Shifted 2D Laplacian on an m-by-m grid, Hermitian for an imaginary c.
+    """
+    T = sp.diags([-1.0, 2.25, -1.0], [-1, 0, 1], shape=(m, m))
+    K = sp.kronsum(T, T).tocsc()
+    if c:
+        K = (K + c * sp.triu(K, 1) - c * sp.tril(K, -1)).tocsc()
+    return K
+
+
+def error(X, K):
+    """
+    Largest error of the lower triangle X on its pattern.
+    """
+    invK = np.linalg.inv(K.toarray())
+    X = X.tocoo()
+    return np.max(np.abs(X.data - invK[X.row, X.col]))
+
+
+class TestSpinv(unittest.TestCase):
+
+    def test_real(self):
+        K = laplacian(12)
+        X = cholmod_extra.spinv(K)
+        self.assertLess(error(X, K), 1e-12)
+        self.assertTrue(np.all(X.tocoo().row >= X.tocoo().col))
+
+    def test_complex(self):
+        K = laplacian(8, 0.3j)
+        X = cholmod_extra.spinv(K, mode='simplicial')
+        self.assertEqual(X.dtype, np.complex128)
+        self.assertLess(error(X, K), 1e-12)
+
+    def test_int64(self):
+        K = laplacian(8)
+        K.indptr = K.indptr.astype(np.int64)
+        K.indices = K.indices.astype(np.int64)
+        L = cholmod_extra.Factor(K)
+        L.factorize(2 * K)
+        X = L.spinv()
+        self.assertLess(error(X, 2 * K), 1e-12)
+
+    def test_no_copy(self):
+        for itype in (np.int32, np.int64):
+            K = laplacian(6)
+            K.indices = K.indices.astype(itype)
+            K.indptr = K.indptr.astype(itype)
+            L = cholmod_extra.Factor(K)
+            X = L.spinv()
+            self.assertEqual(X.indices.dtype, itype)
+            self.assertEqual(X.indptr.dtype, itype)
+            for a in (X.data, X.indices, X.indptr):
+                while isinstance(a, np.ndarray):
+                    a = a.base
+                self.assertEqual(type(a).__name__, 'Array')
+            # The arrays outlive the factor
+            del L
+            self.assertLess(error(X, K), 1e-12)
+
+    def test_not_posdef(self):
+        K = laplacian(4) - 10 * sp.eye(16)
+        with self.assertRaises(cholmod_extra.CholmodError):
+            cholmod_extra.Factor(K)
+
+    def test_threads(self):
+        Ks = [laplacian(10 + k) for k in range(4)]
+        Xs = [None] * len(Ks)
+
+        def run(k):
+            for _ in range(5):
+                Xs[k] = cholmod_extra.spinv(Ks[k])
+
+        threads = [threading.Thread(target=run, args=(k,))
+                   for k in range(len(Ks))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for X, K in zip(Xs, Ks):
+            self.assertLess(error(X, K), 1e-12)
+
+
+if __name__ == '__main__':
+    unittest.main()
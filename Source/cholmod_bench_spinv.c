@@ -0,0 +1,750 @@
+/* ========================================================================== */
+/* === cholmod_bench_spinv ================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_bench_spinv.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * Benchmark of the sparse inverse.
+ *
+ * Usage: cholmod_bench_spinv [-json] [-quick] [-max n] [-verify nprobe]
+ *                            [-only family] [-pages mode] [file.mtx ...]
+ *
+ * Runs cholmod_spinv and cholmod_spinv_factor with simplicial and supernodal
+ * factorizations on families of generated matrices of growing size:
+ *
+ *   lap2d    5-point Laplacian of a k x k grid (plus identity)
+ *   lap3d    7-point Laplacian of a k x k x k grid (plus identity)
+ *   banded   random diagonally dominant band matrix, half bandwidth 10
+ *   rgg      Laplacian (plus identity) of a random geometric graph in the
+ *            unit square with about 10 neighbours per node
+ *
+ * and on Matrix Market files given on the command line (the upper triangle
+ * is used if the file is not symmetric).  -quick runs only the two smallest
+ * sizes of each family, -max n skips the matrices larger than n and -only
+ * runs only the given family.
+ *
+ * One line is printed for each matrix and factorization, as CSV (default)
+ * or JSON (one object per line): wall times of the phases in seconds, the
+ * floating point rate of the recursion (timed with cholmod_spinv_factor,
+ * which does not form the sparse matrix), nnz(L), nnz of the result and the
+ * peak resident set size of the process so far.
+ *
+ * -verify nprobe also checks each result with nprobe random probes that
+ * cost O(nnz) each (see probe_error and takahashi_error), adds the errors
+ * to the output and exits with a nonzero status if they are too large.
+ * This validates the kernels at sizes where no dense inverse fits.
+ *
+ * -pages sets the placement of the large buffers with cholmod_spinv_pages
+ * (malloc, touch, thp or hugetlb), which is also printed.  Comparing the
+ * modes on the large 3D Laplacians with the threads bound to the cores
+ * (make numa) shows the effect of NUMA placement and huge pages.
+ * -------------------------------------------------------------------------- */
+
+
+#include "cholmod_extra.h"
+#include <cholmod.h>
+#include <math.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+static int json = 0 ;
+static long maxn = 0 ;
+static int nverify = 0 ;
+static int failed = 0 ;
+static const char *only = NULL ;
+static const char *pages = NULL ;
+
+// Largest accepted relative error of the verification
+#define VERIFY_TOL 1e-10
+
+double wall_time(void)
+{
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + 1e-9*t.tv_nsec ;
+}
+
+long peak_rss_kb(void)
+{
+    struct rusage r ;
+    getrusage(RUSAGE_SELF, &r) ;
+    return r.ru_maxrss ;
+}
+
+/*
+ * Reproducible uniform random numbers in [0,1)
+ */
+static unsigned long long rng_state = 88172645463325252ULL ;
+
+double uniform(void)
+{
+    rng_state ^= rng_state << 13 ;
+    rng_state ^= rng_state >> 7 ;
+    rng_state ^= rng_state << 17 ;
+    return (rng_state >> 11) * (1.0 / 9007199254740992.0) ;
+}
+
+/*
+ * Symmetric (upper) matrix from a triplet matrix whose off-diagonal
+ * elements are given once.  The diagonal is set to the sum of the absolute
+ * values of the row plus one, which makes the matrix positive definite.
+ */
+cholmod_sparse *make_spd(cholmod_triplet *T, cholmod_common *Common)
+{
+    int n, k, nz ;
+    int *Ti, *Tj ;
+    double *Tx, *d ;
+    cholmod_sparse *A ;
+
+    n = T->nrow ;
+    nz = T->nnz ;
+    Ti = T->i ;
+    Tj = T->j ;
+    Tx = T->x ;
+    d = calloc(n, sizeof(double)) ;
+    for (k = 0; k < nz; k++)
+    {
+        d[Ti[k]] += fabs(Tx[k]) ;
+        d[Tj[k]] += fabs(Tx[k]) ;
+    }
+    for (k = 0; k < n; k++)
+    {
+        Ti[nz+k] = k ;
+        Tj[nz+k] = k ;
+        Tx[nz+k] = d[k] + 1.0 ;
+    }
+    T->nnz = nz + n ;
+    free(d) ;
+
+    A = cholmod_triplet_to_sparse(T, 0, Common) ;
+    cholmod_free_triplet(&T, Common) ;
+    return A ;
+}
+
+/*
+ * Add the upper triangular element (i,j) (or (j,i)) to T
+ */
+void add_edge(cholmod_triplet *T, int i, int j, double x)
+{
+    int *Ti = T->i ;
+    int *Tj = T->j ;
+    double *Tx = T->x ;
+
+    Ti[T->nnz] = (i < j) ? i : j ;
+    Tj[T->nnz] = (i < j) ? j : i ;
+    Tx[T->nnz] = x ;
+    T->nnz++ ;
+}
+
+cholmod_sparse *lap2d(int k, cholmod_common *Common)
+{
+    int n = k*k ;
+    int x, y ;
+    cholmod_triplet *T ;
+
+    T = cholmod_allocate_triplet(n, n, 3*n, 1, CHOLMOD_REAL, Common) ;
+    for (y = 0; y < k; y++)
+    {
+        for (x = 0; x < k; x++)
+        {
+            if (x+1 < k)
+                add_edge(T, x+y*k, x+1+y*k, -1.0) ;
+            if (y+1 < k)
+                add_edge(T, x+y*k, x+(y+1)*k, -1.0) ;
+        }
+    }
+    return make_spd(T, Common) ;
+}
+
+cholmod_sparse *lap3d(int k, cholmod_common *Common)
+{
+    int n = k*k*k ;
+    int x, y, z, i ;
+    cholmod_triplet *T ;
+
+    T = cholmod_allocate_triplet(n, n, 4*n, 1, CHOLMOD_REAL, Common) ;
+    for (z = 0; z < k; z++)
+    {
+        for (y = 0; y < k; y++)
+        {
+            for (x = 0; x < k; x++)
+            {
+                i = x + y*k + z*k*k ;
+                if (x+1 < k)
+                    add_edge(T, i, i+1, -1.0) ;
+                if (y+1 < k)
+                    add_edge(T, i, i+k, -1.0) ;
+                if (z+1 < k)
+                    add_edge(T, i, i+k*k, -1.0) ;
+            }
+        }
+    }
+    return make_spd(T, Common) ;
+}
+
+cholmod_sparse *banded(int n, int bw, cholmod_common *Common)
+{
+    int i, j ;
+    cholmod_triplet *T ;
+
+    T = cholmod_allocate_triplet(n, n, (bw+1)*n, 1, CHOLMOD_REAL, Common) ;
+    for (j = 0; j < n; j++)
+    {
+        for (i = (j > bw) ? j-bw : 0; i < j; i++)
+            add_edge(T, i, j, 2.0*uniform() - 1.0) ;
+    }
+    return make_spd(T, Common) ;
+}
+
+/*
+ * Random geometric graph: n points in the unit square, connected if closer
+ * than r.  The points are bucketed into cells of size r.
+ */
+cholmod_sparse *rgg(int n, cholmod_common *Common)
+{
+    int i, j, c, cx, cy, dx, dy, nc, q, nzmax ;
+    int *head, *next ;
+    double *px, *py ;
+    double r ;
+    cholmod_triplet *T ;
+
+    r = sqrt(10.0 / (M_PI * n)) ;
+    nc = (int) (1.0 / r) ;
+    if (nc < 1)
+        nc = 1 ;
+    px = malloc(n * sizeof(double)) ;
+    py = malloc(n * sizeof(double)) ;
+    head = malloc(nc*nc * sizeof(int)) ;
+    next = malloc(n * sizeof(int)) ;
+    for (c = 0; c < nc*nc; c++)
+        head[c] = -1 ;
+    for (i = 0; i < n; i++)
+    {
+        px[i] = uniform() ;
+        py[i] = uniform() ;
+        c = (int) (px[i]*nc) + nc * (int) (py[i]*nc) ;
+        next[i] = head[c] ;
+        head[c] = i ;
+    }
+
+    nzmax = 16*n ;
+    T = cholmod_allocate_triplet(n, n, nzmax + n, 1, CHOLMOD_REAL, Common) ;
+    for (i = 0; i < n; i++)
+    {
+        cx = (int) (px[i]*nc) ;
+        cy = (int) (py[i]*nc) ;
+        for (dy = -1; dy <= 1; dy++)
+        {
+            for (dx = -1; dx <= 1; dx++)
+            {
+                if (cx+dx < 0 || cx+dx >= nc || cy+dy < 0 || cy+dy >= nc)
+                    continue ;
+                for (j = head[cx+dx + nc*(cy+dy)]; j >= 0; j = next[j])
+                {
+                    if (j <= i || T->nnz >= nzmax)
+                        continue ;
+                    q = ((px[i]-px[j])*(px[i]-px[j]) +
+                         (py[i]-py[j])*(py[i]-py[j]) < r*r) ;
+                    if (q)
+                        add_edge(T, i, j, -1.0) ;
+                }
+            }
+        }
+    }
+
+    free(next) ;
+    free(head) ;
+    free(py) ;
+    free(px) ;
+    return make_spd(T, Common) ;
+}
+
+/*
+ * Floating point operations of the sparse inverse, counted from the
+ * structure of the factor like the BLAS calls of cholmod_spinv.
+ */
+double spinv_flops(cholmod_factor *L)
+{
+    int s, j, ms, ns, m2, nj ;
+    int *Super, *Lpi, *Lp ;
+    double fl = 0 ;
+
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            m2 = ms - ns ;
+            fl += 2.0*m2*m2*ns ;        // dsymm
+            fl += 2.0*ns*ns*m2 ;        // dgemm
+            fl += 1.0*ns*ns*ns ;        // dtrsm, diagonal block
+            fl += 1.0*ms*ns*ns ;        // dtrsm, all rows
+        }
+    }
+    else
+    {
+        Lp = L->p ;
+        for (j = 0; j < L->n; j++)
+        {
+            nj = Lp[j+1] - Lp[j] - 1 ;
+            fl += 2.0*nj*nj + 2.0*nj ;  // dsymv and ddot
+        }
+    }
+    return fl ;
+}
+
+/*
+ * Verification without a dense inverse.  Both checks cost O(nnz) per probe,
+ * thus they can be run on the large matrices.
+ *
+ * probe_error: nprobe random columns c of inv(A) are solved with
+ * cholmod_solve and compared to the elements of X in row and column c.
+ * Returns the largest error relative to the largest element of the column.
+ *
+ * takahashi_error: for nprobe random columns j of the permuted factor, the
+ * identity Z*L = inv(L') (Z*L = inv(L')*inv(D) for LDL') is checked on the
+ * rows of the pattern of L(:,j), using Z from cholmod_spinv_factor.  These
+ * rows are exactly the elements of Z that the recursion reads, thus the
+ * check covers the kernels (and their parallel or vectorised versions)
+ * directly.  Returns the largest residual relative to sum(|Z(i,k)*L(k,j)|).
+ */
+double probe_error(cholmod_factor *L, cholmod_sparse *X, int nprobe,
+                   cholmod_common *Common)
+{
+    int n, q, i, j, p, c ;
+    int *Xp, *Xi, *probe ;
+    double *Xx, *Yx, *ymax ;
+    double err ;
+    cholmod_dense *B, *Y ;
+
+    n = L->n ;
+    if (nprobe > n)
+        nprobe = n ;
+    B = cholmod_zeros(n, nprobe, CHOLMOD_REAL, Common) ;
+    probe = malloc(n * sizeof(int)) ;
+    ymax = calloc(nprobe, sizeof(double)) ;
+    for (i = 0; i < n; i++)
+        probe[i] = -1 ;
+    for (q = 0; q < nprobe; q++)
+    {
+        do
+            c = (int) (uniform() * n) ;
+        while (probe[c] >= 0) ;
+        probe[c] = q ;
+        ((double *) B->x)[c + q*n] = 1.0 ;
+    }
+    Y = cholmod_solve(CHOLMOD_A, L, B, Common) ;
+    Yx = Y->x ;
+    for (q = 0; q < nprobe; q++)
+        for (i = 0; i < n; i++)
+            if (fabs(Yx[i+q*n]) > ymax[q])
+                ymax[q] = fabs(Yx[i+q*n]) ;
+
+    // One pass over X: X(i,j) is in column j and, by symmetry, in column i
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    err = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        for (p = Xp[j]; p < Xp[j+1]; p++)
+        {
+            i = Xi[p] ;
+            if (probe[j] >= 0)
+            {
+                q = probe[j] ;
+                err = fmax(err, fabs(Xx[p] - Yx[i+q*n]) / ymax[q]) ;
+            }
+            if (i != j && probe[i] >= 0)
+            {
+                q = probe[i] ;
+                err = fmax(err, fabs(Xx[p] - Yx[j+q*n]) / ymax[q]) ;
+            }
+        }
+    }
+
+    free(ymax) ;
+    free(probe) ;
+    cholmod_free_dense(&Y, Common) ;
+    cholmod_free_dense(&B, Common) ;
+    return err ;
+}
+
+/*
+ * Index of the element (i,k), i >= k, in the layout of L->x, or -1
+ */
+long layout_locate(cholmod_factor *L, int *col2super, int i, int k)
+{
+    int s, lo, hi, mid, ms ;
+    int *Super, *Lpi, *Lpx, *Ls, *Lp, *Li ;
+
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        Lpx = L->px ;
+        Ls = L->s ;
+        s = col2super[k] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        lo = Lpi[s] ;
+        hi = Lpi[s+1] - 1 ;
+        while (lo <= hi)
+        {
+            mid = (lo + hi) / 2 ;
+            if (Ls[mid] < i)
+                lo = mid + 1 ;
+            else if (Ls[mid] > i)
+                hi = mid - 1 ;
+            else
+                return Lpx[s] + (mid - Lpi[s]) + (long) (k - Super[s]) * ms ;
+        }
+    }
+    else
+    {
+        Lp = L->p ;
+        Li = L->i ;
+        lo = Lp[k] ;
+        hi = Lp[k+1] - 1 ;
+        while (lo <= hi)
+        {
+            mid = (lo + hi) / 2 ;
+            if (Li[mid] < i)
+                lo = mid + 1 ;
+            else if (Li[mid] > i)
+                hi = mid - 1 ;
+            else
+                return mid ;
+        }
+    }
+    return -1 ;
+}
+
+double takahashi_error(cholmod_factor *L, int nprobe, cholmod_common *Common)
+{
+    int n, q, j, s, a, b, m, i, k ;
+    int *col2super, *rows, *Super, *Lpi, *Lpx, *Ls, *Lp, *Li ;
+    long kz ;
+    double *Lx, *Zx, *lval ;
+    double r, scale, target, err ;
+    cholmod_factor *Z ;
+
+    n = L->n ;
+    Lx = L->x ;
+    Z = cholmod_spinv_factor(L, Common) ;
+    Zx = Z->x ;
+    col2super = NULL ;
+    if (L->is_super)
+    {
+        Super = L->super ;
+        col2super = malloc(n * sizeof(int)) ;
+        for (s = 0; s < L->nsuper; s++)
+            for (j = Super[s]; j < Super[s+1]; j++)
+                col2super[j] = s ;
+    }
+    rows = malloc(n * sizeof(int)) ;
+    lval = malloc(n * sizeof(double)) ;
+
+    err = 0 ;
+    for (q = 0; q < nprobe && q < n; q++)
+    {
+        j = (int) (uniform() * n) ;
+
+        // Pattern and values of L(:,j), the diagonal first
+        if (L->is_super)
+        {
+            Super = L->super ;
+            Lpi = L->pi ;
+            Lpx = L->px ;
+            Ls = L->s ;
+            s = col2super[j] ;
+            b = j - Super[s] ;
+            m = 0 ;
+            for (a = b; a < Lpi[s+1] - Lpi[s]; a++)
+            {
+                rows[m] = Ls[Lpi[s]+a] ;
+                lval[m] = Lx[Lpx[s] + a + b*(Lpi[s+1]-Lpi[s])] ;
+                m++ ;
+            }
+            target = 1.0 / lval[0] ;
+        }
+        else
+        {
+            Lp = L->p ;
+            Li = L->i ;
+            m = 0 ;
+            for (kz = Lp[j]; kz < Lp[j+1]; kz++)
+            {
+                rows[m] = Li[kz] ;
+                lval[m] = Lx[kz] ;
+                m++ ;
+            }
+            // Unit diagonal, D(j,j) is stored in its place
+            target = 1.0 / lval[0] ;
+            lval[0] = 1.0 ;
+        }
+
+        for (a = 0; a < m; a++)
+        {
+            i = rows[a] ;
+            r = (a == 0) ? -target : 0.0 ;
+            scale = (a == 0) ? fabs(target) : 0.0 ;
+            for (b = 0; b < m; b++)
+            {
+                k = rows[b] ;
+                kz = (i >= k) ? layout_locate(L, col2super, i, k) :
+                    layout_locate(L, col2super, k, i) ;
+                if (kz < 0)
+                {
+                    fprintf(stderr, "element (%d,%d) missing from the "
+                            "pattern\n", i, k) ;
+                    return INFINITY ;
+                }
+                r += Zx[kz] * lval[b] ;
+                scale += fabs(Zx[kz] * lval[b]) ;
+            }
+            if (scale > 0)
+                err = fmax(err, fabs(r) / scale) ;
+        }
+    }
+
+    free(lval) ;
+    free(rows) ;
+    free(col2super) ;
+    cholmod_spinv_free_factor(&Z, Common) ;
+    return err ;
+}
+
+void bench(const char *name, cholmod_sparse *A, cholmod_common *Common)
+{
+    int mode ;
+    long nnzL ;
+    double t0, ta, tf, ts, tz, fl, ep = 0, et = 0 ;
+    cholmod_factor *L, *Z ;
+    cholmod_sparse *X ;
+    static int header = 0 ;
+
+    if (!json && !header)
+    {
+        printf("matrix,n,nnz_A,factor,pages,nnz_L,nnz_X,analyze_s,"
+               "factorize_s,spinv_s,spinv_factor_s,spinv_gflops,"
+               "peak_rss_kb%s\n",
+               (nverify > 0) ? ",probe_err,takahashi_err" : "") ;
+        header = 1 ;
+    }
+
+    for (mode = 0; mode < 2; mode++)
+    {
+        Common->supernodal = mode ? CHOLMOD_SUPERNODAL : CHOLMOD_SIMPLICIAL ;
+
+        t0 = wall_time() ;
+        L = cholmod_analyze(A, Common) ;
+        ta = wall_time() - t0 ;
+
+        t0 = wall_time() ;
+        cholmod_factorize(A, L, Common) ;
+        tf = wall_time() - t0 ;
+        if (Common->status != CHOLMOD_OK)
+        {
+            fprintf(stderr, "%s: factorization failed\n", name) ;
+            cholmod_free_factor(&L, Common) ;
+            continue ;
+        }
+
+        t0 = wall_time() ;
+        X = cholmod_spinv(L, Common) ;
+        ts = wall_time() - t0 ;
+
+        t0 = wall_time() ;
+        Z = cholmod_spinv_factor(L, Common) ;
+        tz = wall_time() - t0 ;
+
+        fl = spinv_flops(L) ;
+        nnzL = L->is_super ? (long) L->xsize : (long) ((int *) L->p)[L->n] ;
+
+        if (nverify > 0)
+        {
+            ep = probe_error(L, X, nverify, Common) ;
+            et = takahashi_error(L, nverify, Common) ;
+            if (!(ep <= VERIFY_TOL && et <= VERIFY_TOL))
+            {
+                fprintf(stderr, "%s: verification FAILED\n", name) ;
+                failed = 1 ;
+            }
+        }
+
+        if (json)
+            printf("{\"matrix\": \"%s\", \"n\": %ld, \"nnz_A\": %ld, "
+                   "\"factor\": \"%s\", \"pages\": \"%s\", "
+                   "\"nnz_L\": %ld, \"nnz_X\": %ld, "
+                   "\"analyze_s\": %.6f, \"factorize_s\": %.6f, "
+                   "\"spinv_s\": %.6f, \"spinv_factor_s\": %.6f, "
+                   "\"spinv_gflops\": %.3f, \"peak_rss_kb\": %ld",
+                   name, (long) A->nrow, (long) ((int *) A->p)[A->ncol],
+                   mode ? "supernodal" : "simplicial", pages, nnzL,
+                   (long) ((int *) X->p)[X->ncol], ta, tf, ts, tz,
+                   1e-9*fl/tz, peak_rss_kb()) ;
+        else
+            printf("%s,%ld,%ld,%s,%s,%ld,%ld,%.6f,%.6f,%.6f,%.6f,%.3f,%ld",
+                   name, (long) A->nrow, (long) ((int *) A->p)[A->ncol],
+                   mode ? "supernodal" : "simplicial", pages, nnzL,
+                   (long) ((int *) X->p)[X->ncol], ta, tf, ts, tz,
+                   1e-9*fl/tz, peak_rss_kb()) ;
+        if (nverify > 0)
+            printf(json ? ", \"probe_err\": %.3g, \"takahashi_err\": %.3g" :
+                   ",%.3g,%.3g", ep, et) ;
+        printf(json ? "}\n" : "\n") ;
+        fflush(stdout) ;
+
+        cholmod_spinv_free_factor(&Z, Common) ;
+        cholmod_free_sparse(&X, Common) ;
+        cholmod_free_factor(&L, Common) ;
+    }
+}
+
+int wanted(const char *family, long n)
+{
+    return ((only == NULL || strcmp(family, only) == 0) &&
+            (maxn == 0 || n <= maxn)) ;
+}
+
+void run(const char *family, int size, cholmod_sparse *A,
+         cholmod_common *Common)
+{
+    char name[64] ;
+
+    if (A == NULL)
+        return ;
+    snprintf(name, sizeof(name), "%s_%d", family, size) ;
+    bench(name, A, Common) ;
+    cholmod_free_sparse(&A, Common) ;
+}
+
+int main(int argc, char **argv)
+{
+    int k, a, nsizes ;
+    int quick = 0 ;
+    int s2d[] = {32, 64, 128, 256, 512, 1024} ;
+    int s3d[] = {8, 16, 24, 32, 48, 64} ;
+    int sband[] = {1000, 10000, 100000, 1000000} ;
+    int srgg[] = {1000, 10000, 100000, 1000000} ;
+    // In the order of CHOLMOD_SPINV_PAGES_*
+    const char *page_modes[] = {"malloc", "touch", "thp", "hugetlb"} ;
+    FILE *f ;
+    cholmod_sparse *A ;
+    cholmod_common Common ;
+
+    cholmod_start(&Common) ;
+
+    for (a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-json") == 0)
+            json = 1 ;
+        else if (strcmp(argv[a], "-quick") == 0)
+            quick = 1 ;
+        else if (strcmp(argv[a], "-max") == 0 && a+1 < argc)
+            maxn = atol(argv[++a]) ;
+        else if (strcmp(argv[a], "-verify") == 0 && a+1 < argc)
+            nverify = atoi(argv[++a]) ;
+        else if (strcmp(argv[a], "-only") == 0 && a+1 < argc)
+            only = argv[++a] ;
+        else if (strcmp(argv[a], "-pages") == 0 && a+1 < argc)
+            pages = argv[++a] ;
+    }
+
+    if (pages == NULL)
+        pages = getenv("CHOLMOD_SPINV_PAGES") ;
+    if (pages == NULL)
+        pages = "touch" ;
+    for (k = 0; k < 4 && strcmp(pages, page_modes[k]) != 0; k++) ;
+    if (k == 4)
+    {
+        fprintf(stderr, "unknown page mode %s\n", pages) ;
+        return 1 ;
+    }
+    cholmod_spinv_pages(k, &Common) ;
+
+    /* MATRIX MARKET FILES */
+
+    for (a = 1; a < argc; a++)
+    {
+        if (argv[a][0] == '-')
+        {
+            if (strcmp(argv[a], "-max") == 0 ||
+                strcmp(argv[a], "-verify") == 0 ||
+                strcmp(argv[a], "-only") == 0 ||
+                strcmp(argv[a], "-pages") == 0)
+                a++ ;
+            continue ;
+        }
+        f = fopen(argv[a], "r") ;
+        if (f == NULL)
+        {
+            fprintf(stderr, "%s: cannot open\n", argv[a]) ;
+            continue ;
+        }
+        A = cholmod_read_sparse(f, &Common) ;
+        fclose(f) ;
+        if (A == NULL || A->nrow != A->ncol)
+        {
+            fprintf(stderr, "%s: not a square sparse matrix\n", argv[a]) ;
+            cholmod_free_sparse(&A, &Common) ;
+            continue ;
+        }
+        if (A->stype == 0)
+            A->stype = 1 ;
+        bench(argv[a], A, &Common) ;
+        cholmod_free_sparse(&A, &Common) ;
+    }
+
+    /* GENERATED MATRICES */
+
+    nsizes = quick ? 2 : 6 ;
+    for (k = 0; k < nsizes; k++)
+        if (wanted("lap2d", (long) s2d[k]*s2d[k]))
+            run("lap2d", s2d[k], lap2d(s2d[k], &Common), &Common) ;
+    for (k = 0; k < nsizes; k++)
+        if (wanted("lap3d", (long) s3d[k]*s3d[k]*s3d[k]))
+            run("lap3d", s3d[k], lap3d(s3d[k], &Common), &Common) ;
+    nsizes = quick ? 2 : 4 ;
+    for (k = 0; k < nsizes; k++)
+        if (wanted("banded", sband[k]))
+            run("banded", sband[k], banded(sband[k], 10, &Common), &Common) ;
+    for (k = 0; k < nsizes; k++)
+        if (wanted("rgg", srgg[k]))
+            run("rgg", srgg[k], rgg(srgg[k], &Common), &Common) ;
+
+    cholmod_finish(&Common) ;
+    return failed ;
+}
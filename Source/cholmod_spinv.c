@@ -33,104 +33,23 @@
  * Given an LL' or LDL' factorization of A, compute the sparse inverse
  * of A, that is, a matrix with the same sparsity as A but elements
  * from inv(A).  Note that, in general, inv(A) is dense but this
- * computes only some elements of it.  At the moment, only simplicial
- * LDL factorization and real xtypes are supported.
+ * computes only some elements of it.  At the moment, supernodal LL' and
+ * simplicial LDL' factorizations are supported, for real and complex
+ * (Hermitian) matrices.
  *
  * References:
  * -------------------------------------------------------------------------- */
 
-// Start: no internal headers available.
-//#include "cholmod_extra.h"
-//#include "cholmod_internal.h"
-//#include <cholmod_cholesky.h>
+#include "cholmod_extra_internal.h"
+#include <string.h>
 
-#include <cblas.h>
-#ifdef OPENBLAS_USE64BITINT // openblas_config.h
-#  define BLAS64  // SuiteSparse_config.h: SUITESPARSE_BLAS_INT int64_t/int32_t
+#ifdef _OPENMP
+#include <omp.h>
 #endif
-#include <cholmod.h>
-
-// SuiteSparse distinguishes Int and SUITESPARSE_BLAS_INT
-// and copy-converts Int to SUITESPARSE_BLAS_INT
-// when calling BLAS functions through its macros.
-// But below, BLAS is called directly with arguments of type Int.
-// CHOLMOD_INT, CHOLMOD_LONG: cholmod.h
-// cholmod_types.h
-#undef Int
-#undef CHOLMOD
-#undef ITYPE
-#ifdef OPENBLAS_USE64BITINT
-// CHOLMOD_INT64
-#  define Int int64_t
-#  define CHOLMOD(name) cholmod_l_ ## name
-#  define ITYPE CHOLMOD_LONG
-#else
-// CHOLMOD_INT32
-#  define Int int32_t
-#  define CHOLMOD(name) cholmod_ ## name
-#  define ITYPE CHOLMOD_INT
-#endif
-
-// cholmod_internal.h
-#undef ASSERT
-#undef FALSE
-#undef MAX
-#undef MIN
-#undef ERROR
-#ifndef NDEBUG
-#  include <assert.h>
-#  define ASSERT(expression) (assert (expression))
-#else
-#  define ASSERT(expression)
-#endif
-#define FALSE 0
-#define MAX(a,b) (((a) > (b)) ? (a) : (b))
-#define MIN(a,b) (((a) < (b)) ? (a) : (b))
-#define ERROR(status,msg) \
-    CHOLMOD(error) (status, __FILE__, __LINE__, msg, Common)
-#define RETURN_IF_NULL(A,result)                            \
-{                                                           \
-    if ((A) == NULL)                                        \
-    {                                                       \
-        if (Common->status != CHOLMOD_OUT_OF_MEMORY)        \
-        {                                                   \
-            ERROR (CHOLMOD_INVALID, "argument missing") ;   \
-        }                                                   \
-        return (result) ;                                   \
-    }                                                       \
-}
-
-// Return if Common is NULL or invalid
-#define RETURN_IF_NULL_COMMON(result)                       \
-{                                                           \
-    if (Common == NULL)                                     \
-    {                                                       \
-        return (result) ;                                   \
-    }                                                       \
-    if (Common->itype != ITYPE)                             \
-    {                                                       \
-        Common->status = CHOLMOD_INVALID ;                  \
-        return (result) ;                                   \
-    }                                                       \
-}
-#define RETURN_IF_XTYPE_INVALID(A,xtype1,xtype2,result)                       \
-{                                                                             \
-    if ((A)->xtype < (xtype1) || (A)->xtype > (xtype2) ||                     \
-        ((A)->xtype != CHOLMOD_PATTERN && ((A)->x) == NULL) ||                \
-        ((A)->xtype == CHOLMOD_ZOMPLEX && ((A)->z) == NULL) ||                \
-        !(((A)->dtype == CHOLMOD_DOUBLE) || ((A)->dtype == CHOLMOD_SINGLE)))  \
-    {                                                                         \
-        if (Common->status != CHOLMOD_OUT_OF_MEMORY)                          \
-        {                                                                     \
-            ERROR (CHOLMOD_INVALID, "invalid xtype or dtype") ;               \
-        }                                                                     \
-        return (result) ;                                                     \
-    }                                                                         \
-}
 
-// End: no internal headers available.
-
-#define PERM(j) (Lperm != NULL ? Lperm[j] : j)
+// Least elements of the sparse inverse for which cholmod_spinv_gather (and
+// the sort of spinv_gather_inplace) uses threads
+#define SPINV_GATHER_PARALLEL 100000
 
 void CHOLMOD(spinv_block)
 (
@@ -173,16 +92,16 @@ void CHOLMOD(spinv_block)
            CblasColMajor,       // const enum CBLAS_ORDER Order,
            CblasLeft,           // const enum CBLAS_SIDE Side,
            CblasLower,          // const enum CBLAS_UPLO Uplo,
-           m2,                  // const int M,
-           n,                   // const int N,
+           (BLAS_INT) m2,       // const int M,
+           (BLAS_INT) n,        // const int N,
            -1.0,                // const double alpha,
            V,                   // const double *A,
-           m2,                  // const int lda,
+           (BLAS_INT) m2,       // const int lda,
            L2,                  // const double *B,
-           ld,                  // const int ldb,
+           (BLAS_INT) ld,       // const int ldb,
            0.0,                 // const double beta,
            Z2,                  // double *C,
-           ld                   // const int ldc
+           (BLAS_INT) ld        // const int ldc
            ) ;
 
         // Z1 = -Z2'*L2 + Z1 = -L2'*V*L2 + I
@@ -191,17 +110,17 @@ void CHOLMOD(spinv_block)
            CblasColMajor, // const enum CBLAS_ORDER Order
            CblasTrans,    // const enum CBLAS_TRANSPOSE TransA
            CblasNoTrans,  // const enum CBLAS_TRANSPOSE TransB
-           m1,            // const int M
-           m1,            // const int N
-           m2,            // const int K
+           (BLAS_INT) m1, // const int M
+           (BLAS_INT) m1, // const int N
+           (BLAS_INT) m2, // const int K
            -1.0,          // const double alpha
            Z2,            // const double *A
-           ld,            // const int lda
+           (BLAS_INT) ld, // const int lda
            L2,            // const double *B
-           ld,            // const int ldb
+           (BLAS_INT) ld, // const int ldb
            1.0,           // const double beta
            Z1,            // double *C
-           ld             // const int ldc
+           (BLAS_INT) ld  // const int ldc
            ) ;
 
     }
@@ -214,13 +133,13 @@ void CHOLMOD(spinv_block)
        CblasLower,    // const enum CBLAS_UPLO Uplo
        CblasTrans,    // const enum CBLAS_TRANSPOSE TransA
        CblasNonUnit,  // const enum CBLAS_DIAG Diag
-       m1,            // const int M
-       m1,            // const int N
+       (BLAS_INT) m1, // const int M
+       (BLAS_INT) m1, // const int N
        1.0,           // const double alpha
        L1,            // const double *A
-       ld,            // const int lda
+       (BLAS_INT) ld, // const int lda
        Z1,            // double *B
-       ld             // const int ldb
+       (BLAS_INT) ld  // const int ldb
        ) ;
 
     // Z = Z / L1
@@ -231,560 +150,1190 @@ void CHOLMOD(spinv_block)
        CblasLower,    // const enum CBLAS_UPLO Uplo
        CblasNoTrans,  // const enum CBLAS_TRANSPOSE TransA
        CblasNonUnit,  // const enum CBLAS_DIAG Diag
-       m,             // const int M
-       n,             // const int N
+       (BLAS_INT) m,  // const int M
+       (BLAS_INT) n,  // const int N
        1.0,           // const double alpha
        L1,            // const double *A
-       ld,            // const int lda
+       (BLAS_INT) ld, // const int lda
        Z,             // double *B
-       ld             // const int ldb
+       (BLAS_INT) ld  // const int ldb
        ) ;
 
 }
 
 
+/*
+ * Length of the arrays that are indexed like L->x.
+ */
+size_t CHOLMOD(spinv_layout_size)
+(
+    cholmod_factor *L
+)
+{
+    return (L->is_super ? L->xsize : L->nzmax) ;
+}
 
 
-/* ========================================================================== */
-/* === cholmod_spinv_super ================================================== */
-/* ========================================================================== */
+/*
+ * Find the index of L[ip,jp] (ip >= jp, permuted indices) in L->x.  Row
+ * indices of a column/supernode are sorted, thus binary search is used.
+ * Returns -1 if the element is not in the pattern of L.
+ */
+Int CHOLMOD(spinv_locate)
+(
+    cholmod_factor *L,
+    Int ip,
+    Int jp
+)
+{
+    Int *Super, *Lpi, *Lpx, *Ls, *Lp, *Li ;
+    Int s, lo, hi, mid, ms ;
 
-cholmod_sparse *CHOLMOD(spinv_super)   /* returns the sparse inverse of X */
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        Lpx = L->px ;
+        Ls = L->s ;
+
+        // Find the supernode containing the column jp
+        lo = 0 ;
+        hi = L->nsuper - 1 ;
+        while (lo < hi)
+        {
+            mid = (lo + hi + 1) / 2 ;
+            if (Super[mid] <= jp)
+                lo = mid ;
+            else
+                hi = mid - 1 ;
+        }
+        s = lo ;
+        ms = Lpi[s+1] - Lpi[s] ;
+
+        // Find the row ip in the row indices of the supernode
+        lo = Lpi[s] ;
+        hi = Lpi[s+1] - 1 ;
+        while (lo <= hi)
+        {
+            mid = (lo + hi) / 2 ;
+            if (Ls[mid] < ip)
+                lo = mid + 1 ;
+            else if (Ls[mid] > ip)
+                hi = mid - 1 ;
+            else
+                return (Lpx[s] + (mid - Lpi[s]) + (jp - Super[s])*ms) ;
+        }
+    }
+    else
+    {
+        Lp = L->p ;
+        Li = L->i ;
+
+        lo = Lp[jp] ;
+        hi = Lp[jp+1] - 1 ;
+        while (lo <= hi)
+        {
+            mid = (lo + hi) / 2 ;
+            if (Li[mid] < ip)
+                lo = mid + 1 ;
+            else if (Li[mid] > ip)
+                hi = mid - 1 ;
+            else
+                return (mid) ;
+        }
+    }
+
+    return (-1) ;
+}
+
+
+/*
+ * Write (or add) the elements of a sparse matrix A to the array F that is
+ * indexed like L->x.  Iperm is the inverse of L->Perm.
+ */
+int CHOLMOD(spinv_scatter)
 (
-    /* ---- input ---- */
-    cholmod_factor *L,	/* (supernodal) factorization to use */
-    /* --------------- */
+    cholmod_factor *L,
+    cholmod_sparse *A,
+    Int *Iperm,
+    double *F,
+    int add,
     cholmod_common *Common
-    )
+)
 {
+    Int *Ap, *Ai, *Anz ;
+    double *Ax ;
+    Int i, j, p, pend, ip, jp, kl ;
 
-    Int s, i, j ;
-    Int *Super, *Ls, *Lpi, *Lpx ;
-    Int psi0, psi1, j0, j1 ;
-//    Int ms, ns, ld, m1, m2, scol ;
-    Int ms, ns, m1, m2, scol ;
-    int xtype;
-    cholmod_sparse *X ;
-    double *Lx, *Xx, *Z, *V ; //, *Z1, *Z2, *L1, *L2 ;
-    Int  *Xp, *Xi;
-    Int *perm, *Lperm, *ncol;
-    Int n, il, jl, kl, ix, jx, kx, ip, jp;
-    size_t nz, nsuper, maxsize;
+    Ap = A->p ;
+    Ai = A->i ;
+    Anz = A->nz ;
+    Ax = A->x ;
 
-    /*
-     * Compute the sparse inverse.
-     */
+    for (j = 0; j < A->ncol; j++)
+    {
+        pend = (A->packed) ? Ap[j+1] : Ap[j] + Anz[j] ;
+        for (p = Ap[j]; p < pend; p++)
+        {
+            i = Ai[p] ;
+            // Ignore the other triangle of a symmetric matrix
+            if ((A->stype > 0 && i > j) || (A->stype < 0 && i < j))
+                continue ;
+
+            ip = (Iperm != NULL) ? Iperm[i] : i ;
+            jp = (Iperm != NULL) ? Iperm[j] : j ;
+            kl = CHOLMOD(spinv_locate) (L, MAX(ip,jp), MIN(ip,jp)) ;
+            if (kl < 0)
+            {
+                if (Ax[p] != 0)
+                {
+                    ERROR (CHOLMOD_INVALID,
+                           "element outside the pattern of the factor") ;
+                    return (FALSE) ;
+                }
+                continue ;
+            }
 
-    // Dimensionality of the matrix
-    n = L->n ;
+            if (add)
+                F[kl] += Ax[p] ;
+            else
+                F[kl] = Ax[p] ;
+        }
+    }
 
-    // Number of non-zero elements
-    //nz = (L->xsize - n) / 2 + n;
+    return (TRUE) ;
+}
 
-    // Result has the same xtype as the factor
-    xtype = L->xtype ;
 
-    perm = NULL ;
-    ncol = NULL ;
-    V = NULL ;
-    Z = NULL ;
-    maxsize = 0 ;
+static void spinv_gather_value
+(
+    double *Xx,
+    Int kx,
+    double *F,
+    Int kl,
+    int xtype,
+    int conj
+)
+{
+    if (xtype == CHOLMOD_COMPLEX)
+    {
+        Xx[2*kx] = F[2*kl] ;
+        Xx[2*kx+1] = conj ? -F[2*kl+1] : F[2*kl+1] ;
+    }
+    else if (xtype == CHOLMOD_REAL)
+    {
+        Xx[kx] = F[kl] ;
+    }
+}
 
-    // Allocate the result X
-    X = CHOLMOD(spzeros) (n, n, 0, xtype, Common) ;
-    if (Common->status < CHOLMOD_OK)
-        goto cleanup ;
+/*
+ * One pass over the supernodes (or columns) k0..k1-1 of L for
+ * cholmod_spinv_gather.  Pass 0 counts the elements of each column of the
+ * result in ncol, pass 1 stores them at the cursors ncol.  Only the columns
+ * c0..c1-1 of the result are counted or stored.
+ */
+void CHOLMOD(spinv_gather_range)
+(
+    cholmod_factor *L,
+    double *F,
+    int xtype,
+    Int k0,
+    Int k1,
+    Int c0,
+    Int c1,
+    Int *ncol,
+    Int *Xi,
+    double *Xx,
+    int pass
+)
+{
+    Int *Super, *Lpi, *Lpx, *Ls, *Lp, *Li, *Lperm ;
+    Int s, i, j, ms, ns, psi0, kl, ip, jp, jx, kx ;
 
-    // Shorthand notation
-    Xp = X->p ;
+    Lperm = L->Perm ;
     Super = L->super ;
     Lpi = L->pi ;
     Lpx = L->px ;
     Ls = L->s ;
-    Lperm = L->Perm ;
-    Lx = L->x ;
-    nsuper = L->nsuper ;
-
-
-    /*
-     * Compute the mapping to the permuted result:
-     * X->x[perm[i]] ~ L->x[i]
-     * Both X and L are lower triangular
-     */
+    Lp = L->p ;
+    Li = L->i ;
 
-    /* Count non-zeros on columns */
-    nz = 0;
-    for (s = 0; s < nsuper; s++)
+    if (L->is_super)
     {
-        j0 = Super[s] ;   // first column of the supernode
-        j1 = Super[s+1] ; // last column (+1)
-        ns = j1 - j0;     // number of columns
-
-        psi0 = Lpi[s] ;    // "pointer" to first row index
-        psi1 = Lpi[s+1] ;  // "pointer" to last row index (+1)
-        ms = psi1 - psi0;  // number of rows
-
-        for (j = 0; j < ns; j++)
+        for (s = k0; s < k1; s++)
         {
-            jp = PERM(j0+j) ; // permuted column index
-            for (i = j; i < ms; i++)
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
             {
-                ip = PERM(Ls[psi0+i]) ; // permuted row index
-                // Increase the number of elements in the column
+                jp = PERM(Super[s]+j) ;
+                for (i = j; i < ms; i++)
+                {
+                    ip = PERM(Ls[psi0+i]) ;
+                    jx = MIN(ip,jp) ;
+                    if (jx < c0 || jx >= c1)
+                        continue ;
+                    if (pass == 0)
+                    {
+                        ncol[jx]++ ;
+                        continue ;
+                    }
+                    kl = Lpx[s] + i + j*ms ;
+                    kx = ncol[jx]++ ;
+                    Xi[kx] = MAX(ip,jp) ;
+                    spinv_gather_value (Xx, kx, F, kl, xtype, ip < jp) ;
+                }
+            }
+        }
+    }
+    else
+    {
+        for (j = k0; j < k1; j++)
+        {
+            jp = PERM(j) ;
+            for (kl = Lp[j]; kl < Lp[j+1]; kl++)
+            {
+                ip = PERM(Li[kl]) ;
                 jx = MIN(ip,jp) ;
-                Xp[jx+1]++ ;
-                // Increase the number of non-zero elements
-                nz++ ;
+                if (jx < c0 || jx >= c1)
+                    continue ;
+                if (pass == 0)
+                {
+                    ncol[jx]++ ;
+                    continue ;
+                }
+                kx = ncol[jx]++ ;
+                Xi[kx] = MAX(ip,jp) ;
+                spinv_gather_value (Xx, kx, F, kl, xtype, ip < jp) ;
             }
         }
+    }
+}
+
+static void spinv_swap
+(
+    Int *Xi,
+    double *Xx,
+    int w,
+    Int a,
+    Int b
+)
+{
+    Int ti, q ;
+    double tx ;
 
+    ti = Xi[a] ;
+    Xi[a] = Xi[b] ;
+    Xi[b] = ti ;
+    for (q = 0; q < w; q++)
+    {
+        tx = Xx[w*a+q] ;
+        Xx[w*a+q] = Xx[w*b+q] ;
+        Xx[w*b+q] = tx ;
+    }
+}
+
+// Move Xi[root] down the heap Xi[0..m-1] (with the values)
+static void spinv_sift
+(
+    Int *Xi,
+    double *Xx,
+    int w,
+    Int root,
+    Int m
+)
+{
+    Int child ;
+
+    for ( ; (child = 2*root+1) < m; root = child)
+    {
+        if (child+1 < m && Xi[child] < Xi[child+1])
+            child++ ;
+        if (Xi[root] >= Xi[child])
+            break ;
+        spinv_swap (Xi, Xx, w, root, child) ;
+    }
+}
+
+/*
+ * Sort the m row indices Xi of a column with their values (w doubles each):
+ * insertion sort for short columns, heapsort otherwise.
+ */
+void CHOLMOD(spinv_sort_column)
+(
+    Int *Xi,
+    double *Xx,
+    int w,
+    Int m
+)
+{
+    Int i, j ;
+
+    if (m <= 32)
+    {
+        for (i = 1; i < m; i++)
+            for (j = i; j > 0 && Xi[j-1] > Xi[j]; j--)
+                spinv_swap (Xi, Xx, w, j-1, j) ;
+        return ;
     }
-    CHOLMOD(reallocate_sparse)(nz, X, Common) ;
-    if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
 
+    for (i = m/2 - 1; i >= 0; i--)
+        spinv_sift (Xi, Xx, w, i, m) ;
+    for (i = m-1; i > 0; i--)
+    {
+        spinv_swap (Xi, Xx, w, 0, i) ;
+        spinv_sift (Xi, Xx, w, 0, i) ;
+    }
+}
+
+#ifdef _OPENMP
+
+/*
+ * Both passes of cholmod_spinv_gather and the sort with nthreads threads.
+ * The supernodes (or columns) of L are split into nthreads ranges with
+ * about the same number of elements.  Each thread counts its range into
+ * its own histogram of the columns.  The column pointers and the cursors of
+ * each thread are then computed by a scan in which each thread does a range
+ * of columns, thus every thread stores its elements at its own positions
+ * without conflicts.  Finally the columns are sorted in parallel.
+ *
+ * The ranges assume a team of exactly nthreads threads.  OpenMP may give
+ * fewer (dynamic adjustment, a thread limit shared with other calls), and
+ * then nothing is done and FALSE is returned with Common->status
+ * CHOLMOD_OK, so that the caller gathers serially.
+ */
+static int spinv_gather_threads
+(
+    cholmod_factor *L,
+    double *F,
+    int xtype,
+    cholmod_sparse *X,
+    int nthreads,
+    cholmod_common *Common
+)
+{
+    Int *Super, *Lpi, *Lp, *Xp, *Xi, *H, *Start, *Block ;
+    double *Xx ;
+    Int n, nitems, k, t, nz, acc ;
+    int w, team ;
+
+    n = L->n ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lp = L->p ;
     Xp = X->p ;
     Xi = X->i ;
     Xx = X->x ;
+    nz = X->nzmax ;
+    nitems = L->is_super ? (Int) L->nsuper : n ;
+    w = (xtype == CHOLMOD_COMPLEX) ? 2 : ((xtype == CHOLMOD_REAL) ? 1 : 0) ;
 
-    /* Compute column pointers by computing cumulative sum */
-    for (jx = 1; jx <= n; jx++)
-        Xp[jx] += Xp[jx-1] ;
-
-    /*
-     * Add row indices and compute permutation mapping
-     */
-    ncol = (Int*)CHOLMOD(calloc)(n, sizeof(Int), Common) ;
-    perm = CHOLMOD(malloc)(L->xsize, sizeof(Int), Common) ; // permutation mapping
+    H = CHOLMOD(malloc)(nthreads*n, sizeof(Int), Common) ;
+    Start = CHOLMOD(malloc)(nthreads+1, sizeof(Int), Common) ;
+    Block = CHOLMOD(malloc)(nthreads+1, sizeof(Int), Common) ;
     if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
-
-    for (s = 0; s < nsuper; s++)
     {
-        j0 = Super[s] ;   // first column of the supernode
-        j1 = Super[s+1] ; // last column (+1)
-        ns = j1 - j0;     // number of columns
+        CHOLMOD(free)(nthreads+1, sizeof(Int), Block, Common) ;
+        CHOLMOD(free)(nthreads+1, sizeof(Int), Start, Common) ;
+        CHOLMOD(free)(nthreads*n, sizeof(Int), H, Common) ;
+        return (FALSE) ;
+    }
 
-        psi0 = Lpi[s] ;    // "pointer" to first row index
-        psi1 = Lpi[s+1] ;  // "pointer" to last row index (+1)
-        ms = psi1 - psi0;  // number of rows
+    // Ranges of supernodes (or columns) with about nz/nthreads elements
+    Start[0] = 0 ;
+    t = 1 ;
+    acc = 0 ;
+    for (k = 0; k < nitems && t < nthreads; k++)
+    {
+        if (L->is_super)
+            acc += (Super[k+1]-Super[k]) * (Lpi[k+1]-Lpi[k])
+                - ((Super[k+1]-Super[k]) * (Super[k+1]-Super[k]-1)) / 2 ;
+        else
+            acc += Lp[k+1] - Lp[k] ;
+        while (t < nthreads && acc >= (nz / nthreads) * t)
+            Start[t++] = k+1 ;
+    }
+    while (t <= nthreads)
+        Start[t++] = nitems ;
 
-        for (j = 0; j < ns; j++)
+    team = nthreads ;
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num () ;
+        Int *h = H + tid*n ;
+        Int c0 = (n * tid) / nthreads ;
+        Int c1 = (n * (tid+1)) / nthreads ;
+        Int jx, u, c, cnt, off ;
+
+        // Every thread of a smaller team sees the same size and skips all
+        if (omp_get_num_threads () != nthreads)
         {
-            jp = PERM(j0+j) ; // permuted column index
-            for (i = j; i < ms; i++)
+            #pragma omp master
+            team = omp_get_num_threads () ;
+        }
+        else
+        {
+            // Count into the histogram of the thread
+            for (jx = 0; jx < n; jx++)
+                h[jx] = 0 ;
+            CHOLMOD(spinv_gather_range) (L, F, xtype, Start[tid],
+                                         Start[tid+1], 0, n, h, NULL, NULL,
+                                         0) ;
+            #pragma omp barrier
+
+            // Column counts in Xp and offsets of the threads in the columns
+            off = 0 ;
+            for (jx = c0; jx < c1; jx++)
+            {
+                cnt = 0 ;
+                for (u = 0; u < nthreads; u++)
+                {
+                    c = H[u*n+jx] ;
+                    H[u*n+jx] = cnt ;
+                    cnt += c ;
+                }
+                Xp[jx] = cnt ;
+                off += cnt ;
+            }
+            Block[tid+1] = off ;
+            #pragma omp barrier
+            #pragma omp single
             {
-                ip = PERM(Ls[psi0+i]) ; // permuted row index
-                // Increase the number of elements in the column
-                jx = MIN(ip,jp) ;      // column of X
-                ix = MAX(ip,jp) ;      // row of X
-                kx = Xp[jx]+ncol[jx] ; // index of X
-                // Increase the number of elements on the column
-                ncol[jx]++ ;
-                // Add row index
-                Xi[kx] = ix ;
-                // Mapping X[perm[k]] ~ L[k]
-                kl = Lpx[s] + i + j*ms ; // index of L
-                //kl = Lpx[s] + j + i*ms ; // index of L
-                perm[kl] = kx ;
+                Block[0] = 0 ;
+                for (u = 0; u < nthreads; u++)
+                    Block[u+1] += Block[u] ;
+            }
+
+            // Column pointers and the cursors of the threads
+            off = Block[tid] ;
+            for (jx = c0; jx < c1; jx++)
+            {
+                cnt = Xp[jx] ;
+                Xp[jx] = off ;
+                for (u = 0; u < nthreads; u++)
+                    H[u*n+jx] += off ;
+                off += cnt ;
+            }
+            if (tid == nthreads - 1)
+                Xp[n] = off ;
+            #pragma omp barrier
+
+            // Store the elements of the range of the thread
+            CHOLMOD(spinv_gather_range) (L, F, xtype, Start[tid],
+                                         Start[tid+1], 0, n, h, Xi, Xx, 1) ;
+            #pragma omp barrier
+
+            #pragma omp for schedule(dynamic,256)
+            for (jx = 0; jx < n; jx++)
+            {
+                CHOLMOD(spinv_sort_column) (Xi + Xp[jx],
+                                            (w > 0) ? Xx + w*Xp[jx] : NULL,
+                                            w, Xp[jx+1] - Xp[jx]) ;
             }
         }
+    }
+
+    CHOLMOD(free)(nthreads+1, sizeof(Int), Block, Common) ;
+    CHOLMOD(free)(nthreads+1, sizeof(Int), Start, Common) ;
+    CHOLMOD(free)(nthreads*n, sizeof(Int), H, Common) ;
+    if (team != nthreads)
+        return (FALSE) ;
+    X->sorted = TRUE ;
+    return (TRUE) ;
+}
 
+#endif
+
+/*
+ * Sparse matrix (lower triangle, stype -1) with the pattern of the sparse
+ * inverse from the array F that is indexed like L->x.  Inverse of
+ * cholmod_spinv_scatter.  If xtype is CHOLMOD_COMPLEX, F is interleaved
+ * complex and the elements moved to the upper triangle by the permutation
+ * are conjugated (F is Hermitian).  If xtype is CHOLMOD_PATTERN, F is not
+ * used and only the pattern is formed.
+ *
+ * With OpenMP and at least SPINV_GATHER_PARALLEL elements the passes and
+ * the sort are done by spinv_gather_threads.  The threads are limited so
+ * that their histograms take no more memory than the row indices.
+ */
+cholmod_sparse *CHOLMOD(spinv_gather)
+(
+    cholmod_factor *L,
+    double *F,
+    int xtype,
+    cholmod_common *Common
+)
+{
+    cholmod_sparse *X ;
+    Int *Super, *Lpi, *Lp, *Xp, *ncol ;
+    Int n, s, ms, ns, jx, nitems ;
+    size_t nz ;
+
+    n = L->n ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lp = L->p ;
+    nz = 0 ;
+    if (L->is_super)
+    {
+        for (s = 0; s < L->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            nz += ns*ms - (ns*(ns-1))/2 ;
+        }
+        nitems = L->nsuper ;
+    }
+    else
+    {
+        nz = Lp[n] ;
+        nitems = n ;
     }
-    ncol = CHOLMOD(free)(n, sizeof(Int), ncol, Common) ;
-    X->sorted = FALSE ;
 
-    /*
-     * Allocate workspace using the size of the largest supernode
-     */
-    for (s = 0; s < L->nsuper; s++)
+    X = CHOLMOD(allocate_sparse) (n, n, nz, FALSE, TRUE, -1, xtype, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (NULL) ;
+
+#ifdef _OPENMP
+    if (nz >= SPINV_GATHER_PARALLEL && !omp_in_parallel ())
     {
-        if (Lpx[s+1] - Lpx[s] > maxsize)
-            maxsize = Lpx[s+1] - Lpx[s] ;
+        int nthreads, ok ;
+
+        // Shared with the other inverses running in the process
+        nthreads = CHOLMOD(spinv_threads_enter) (Common) ;
+        nthreads = (int) MIN ((size_t) nthreads, nz / MAX (n, 1)) ;
+        ok = (nthreads > 1
+              && spinv_gather_threads (L, F, xtype, X, nthreads, Common)) ;
+        CHOLMOD(spinv_threads_leave) () ;
+        if (ok)
+            return (X) ;
+        if (Common->status < CHOLMOD_OK)
+        {
+            CHOLMOD(free_sparse) (&X, Common) ;
+            return (NULL) ;
+        }
     }
-    V = CHOLMOD(malloc)(L->maxesize*L->maxesize, sizeof(double), Common) ;
-    Z = CHOLMOD(malloc)(maxsize, sizeof(double), Common) ;
+#endif
+
+    ncol = CHOLMOD(calloc)(n+1, sizeof(Int), Common) ;
     if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
+    {
+        CHOLMOD(free_sparse) (&X, Common) ;
+        return (NULL) ;
+    }
+    Xp = X->p ;
 
     /*
-     * Compute the sparse inverse
+     * First pass counts the elements of the columns, second pass fills them
      */
-    for (s = nsuper - 1; s >= 0; s--)
+    CHOLMOD(spinv_gather_range) (L, F, xtype, 0, nitems, 0, n, ncol, NULL,
+                                 NULL, 0) ;
+    Xp[0] = 0 ;
+    for (jx = 0; jx < n; jx++)
     {
+        Xp[jx+1] = Xp[jx] + ncol[jx] ;
+        ncol[jx] = Xp[jx] ;
+    }
+    CHOLMOD(spinv_gather_range) (L, F, xtype, 0, nitems, 0, n, ncol, X->i,
+                                 X->x, 1) ;
+    CHOLMOD(free)(n+1, sizeof(Int), ncol, Common) ;
 
-        /*
-         * Define some helpful variables for the active supernode
-         */
+    CHOLMOD(sort) (X, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        CHOLMOD(free_sparse) (&X, Common) ;
+    return (X) ;
+}
 
-        j0 = Super[s] ;   // first column of the supernode
-        j1 = Super[s+1] ; // last column (+1)
-        ns = j1 - j0 ;     // number of columns
 
-        psi0 = Lpi[s] ;    // "pointer" to first row index
-        psi1 = Lpi[s+1] ;  // "pointer" to last row index (+1)
-        ms = psi1 - psi0 ; // number of rows
+/*
+ * Position in the result of each element of L, in the order in which
+ * cholmod_spinv_gather_range visits them: Xi[k] is the position of the k-th
+ * element, from the cursors ncol.  The elements of the interleaved complex
+ * F (w = 2) that go to the upper triangle are conjugated in place.
+ */
+static void spinv_gather_positions
+(
+    cholmod_factor *L,
+    double *F,
+    int w,
+    Int *ncol,
+    Int *Xi
+)
+{
+    Int *Super, *Lpi, *Ls, *Lp, *Li, *Lperm ;
+    Int s, i, j, ms, ns, psi0, kl, ip, jp, k ;
 
-        // Z = [Z1; Z2] where Z1 is ns x ns and Z2 is (ms-ns) x ns
-        // L = [L1; L2] where L1 is ns x ns and L2 is (ms-ns) x ns
-        m1 = ns ;               // rows of Z1/L1
-        m2 = ms - ns ;          // rows of Z2/L2
+    Lperm = L->Perm ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Ls = L->s ;
+    Lp = L->p ;
+    Li = L->i ;
 
-        /*
-         * Collect V (symmetric in lower triangular form)
-         */
-        scol = s + 1 ;
-        for (j = 0; j < m2; j++)
+    k = 0 ;
+    if (L->is_super)
+    {
+        for (s = 0; s < (Int) L->nsuper; s++)
         {
-            // Row index of the j:th non-zero
-            // element in L2
-            // = relevant column index of X
-            jx = Ls[psi0+m1+j] ;
-
-            // Find supernode containing the column jx
-            while (Super[scol+1]-1 < jx)
-                scol++ ;
-            jl = jx - Super[scol] ; // column of the supernode
-
-            // Set lower triangular elements of column
-            // jz (no need to set upper triangular
-            // elements because of the symmetry).
-            il = 0 ;
-            for (i = j; i < m2; i++)
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
             {
-                ix = Ls[psi0+m1+i] ;
-                // Find L[ix,jx]
-                while (Ls[Lpi[scol]+il] < ix)
-                    il++ ;
-
-                // To summarize the finding:
-                // L[ix,jx] is the element (il,jl) in supernode scol
-                kl = Lpx[scol] + il + jl*(Lpi[scol+1]-Lpi[scol]) ;
-
-                // Use the permutation mapping to get the
-                // index of the corresponding element in X
-                kx = perm[kl] ;
-
-                // Set V[i,j] = X[ix,jx]
-                V[i+j*m2] = Xx[kx] ;
+                jp = PERM(Super[s]+j) ;
+                for (i = j; i < ms; i++, k++)
+                {
+                    ip = PERM(Ls[psi0+i]) ;
+                    Xi[k] = ncol[MIN(ip,jp)]++ ;
+                    if (w == 2 && ip < jp)
+                        F[2*k+1] = -F[2*k+1] ;
+                }
             }
-
         }
-
-        /*
-         * Compute the inverse of the supernode block
-         */
-        CHOLMOD(spinv_block) (Lx + Lpx[s], Z, V, ms, ns, Common) ;
-
-        /*
-         * Store the result Z = [Z1; Z2] in X
-         */
-        for (j = 0; j < ns; j++)
+    }
+    else
+    {
+        for (j = 0; j < (Int) L->n; j++)
         {
-            for (i = j; i < m1; i++)
+            jp = PERM(j) ;
+            for (kl = Lp[j]; kl < Lp[j+1]; kl++, k++)
             {
-                // Index of the corresponding element L[kl] ~ Z[i,j]
-                kl = Lpx[s] + i + j*ms ;
-                // Mapping X[perm[kl]] ~ L[kl]
-                kx = perm[kl] ;
-                // Set the value (try to stabilize by utilizing
-                // symmetry)
-                Xx[kx] = 0.5*(Z[i+j*ms]+Z[j+i*ms]) ;
+                ip = PERM(Li[kl]) ;
+                Xi[k] = ncol[MIN(ip,jp)]++ ;
+                if (w == 2 && ip < jp)
+                    F[2*k+1] = -F[2*k+1] ;
             }
-            for (i = m1; i < ms; i++)
+        }
+    }
+}
+
+/*
+ * Same result as cholmod_spinv_gather, formed in F itself.  F has fsize
+ * doubles from CHOLMOD(malloc) and becomes X->x, or is freed on failure.
+ * The strictly upper parts of the diagonal blocks are dropped by moving the
+ * elements down in place, and F is shrunk to the nz elements of the
+ * result.  The row indices of X first hold the position of each element in
+ * the result, the elements are moved there by following the cycles of the
+ * permutation, and the row indices are then stored by the second pass of
+ * cholmod_spinv_gather_range.  Thus the peak memory is the larger of F and
+ * the result, and the values are never copied to a second array.
+ */
+static cholmod_sparse *spinv_gather_inplace
+(
+    cholmod_factor *L,
+    double *F,
+    size_t fsize,
+    int xtype,
+    cholmod_common *Common
+)
+{
+    cholmod_sparse *X ;
+    double t ;
+    Int *Super, *Lpi, *Lpx, *Lp, *Xp, *Xi, *ncol ;
+    Int n, s, j, q, ms, ns, jx, k, kx, nitems ;
+    size_t nz ;
+    int w ;
+
+    n = L->n ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Lp = L->p ;
+    w = (xtype == CHOLMOD_COMPLEX) ? 2 : 1 ;
+
+    // Lower triangles of the columns of the supernodes, in the order of
+    // cholmod_spinv_gather_range
+    nz = 0 ;
+    if (L->is_super)
+    {
+        for (s = 0; s < (Int) L->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            for (j = 0; j < ns; j++)
             {
-                // Index of the corresponding element L[kl] ~ Z[i,j]
-                kl = Lpx[s] + i + j*ms ;
-                // Mapping X[perm[kl]] ~ L[kl]
-                kx = perm[kl] ;
-                // Set the value
-                Xx[kx] = Z[i+j*ms] ;
+                memmove (F + w*nz, F + w*(Lpx[s] + j + j*ms),
+                         w*(ms-j) * sizeof(double)) ;
+                nz += ms - j ;
             }
         }
+        nitems = L->nsuper ;
+    }
+    else
+    {
+        nz = Lp[n] ;
+        nitems = n ;
+    }
 
+    F = CHOLMOD(realloc)(w*nz, sizeof(double), F, &fsize, Common) ;
+    X = CHOLMOD(allocate_sparse) (n, n, nz, TRUE, TRUE, -1, CHOLMOD_PATTERN,
+                                  Common) ;
+    ncol = CHOLMOD(calloc)(n+1, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free)(n+1, sizeof(Int), ncol, Common) ;
+        CHOLMOD(free_sparse) (&X, Common) ;
+        CHOLMOD(free)(fsize, sizeof(double), F, Common) ;
+        return (NULL) ;
     }
+    Xp = X->p ;
+    Xi = X->i ;
 
-cleanup:
-    // Free workspace
-    CHOLMOD(free)(maxsize, sizeof(double), Z, Common) ;
-    CHOLMOD(free)(L->maxesize*L->maxesize, sizeof(double), V, Common) ;
-    CHOLMOD(free)(L->xsize, sizeof(Int), perm, Common) ;
-    CHOLMOD(free)(n, sizeof(Int), ncol, Common) ;
+    CHOLMOD(spinv_gather_range) (L, NULL, CHOLMOD_PATTERN, 0, nitems, 0, n,
+                                 ncol, NULL, NULL, 0) ;
+    Xp[0] = 0 ;
+    for (jx = 0; jx < n; jx++)
+    {
+        Xp[jx+1] = Xp[jx] + ncol[jx] ;
+        ncol[jx] = Xp[jx] ;
+    }
+    spinv_gather_positions (L, F, w, ncol, Xi) ;
 
-    if (Common->status >= CHOLMOD_OK)
+    // Every swap puts the element at k in its place kx
+    for (k = 0; k < (Int) nz; k++)
     {
-        // The result is symmetric but only the lower triangular part was
-        // computed.
-        X->stype = -1 ;
+        while ((kx = Xi[k]) != k)
+        {
+            for (q = 0; q < w; q++)
+            {
+                t = F[w*k+q] ;
+                F[w*k+q] = F[w*kx+q] ;
+                F[w*kx+q] = t ;
+            }
+            Xi[k] = Xi[kx] ;
+            Xi[kx] = kx ;
+        }
+    }
 
-        // Sort columns (is it necessary?)
-        CHOLMOD(sort) (X, Common) ;
+    for (jx = 0; jx < n; jx++)
+        ncol[jx] = Xp[jx] ;
+    CHOLMOD(spinv_gather_range) (L, NULL, CHOLMOD_PATTERN, 0, nitems, 0, n,
+                                 ncol, Xi, NULL, 1) ;
+    CHOLMOD(free)(n+1, sizeof(Int), ncol, Common) ;
 
-        if (Common->status >= CHOLMOD_OK)
-            return (X) ;
-    }
+    X->x = F ;
+    X->xtype = xtype ;
 
-    CHOLMOD(free_sparse) (&X, Common) ;
-    return (NULL) ;
+#ifdef _OPENMP
+    {
+        int nthreads = CHOLMOD(spinv_threads_enter) (Common) ;
 
+        #pragma omp parallel for num_threads(nthreads) \
+            schedule(dynamic,256) if (nz >= SPINV_GATHER_PARALLEL)
+        for (jx = 0; jx < n; jx++)
+        {
+            CHOLMOD(spinv_sort_column) (Xi + Xp[jx], F + w*Xp[jx], w,
+                                        Xp[jx+1] - Xp[jx]) ;
+        }
+        CHOLMOD(spinv_threads_leave) () ;
+    }
+#else
+    for (jx = 0; jx < n; jx++)
+    {
+        CHOLMOD(spinv_sort_column) (Xi + Xp[jx], F + w*Xp[jx], w,
+                                    Xp[jx+1] - Xp[jx]) ;
+    }
+#endif
+    X->sorted = TRUE ;
+    return (X) ;
 }
-/* ========================================================================== */
-/* === cholmod_spinv_simplicial ============================================= */
-/* ========================================================================== */
 
-cholmod_sparse *CHOLMOD(spinv_simplicial)  /* returns the sparse solution X */
+
+/*
+ * Indices (in L->x) of the elements X[ix,jx] needed for the lower triangle
+ * of the m2 x m2 matrix V of the supernode s.  Same search as in
+ * cholmod_spinv_super.
+ */
+void CHOLMOD(spinv_super_map)
 (
-    /* ---- input ---- */
-    cholmod_factor *L,	/* (simplicial) factorization to use */
-    /* --------------- */
-    cholmod_common *Common
-    )
+    cholmod_factor *L,
+    Int s,
+    Int *map
+)
 {
+    Int *Super, *Lpi, *Lpx, *Ls ;
+    Int i, j, il, jl, ix, jx, scol, psi0, ms, m1, m2 ;
 
-    int xtype ;
-    cholmod_sparse *X ;
-    double *Lx, *Xx, *V, *z, *Lxj ;
-    double djj ;
-    Int *Li, *Lp, *Xp, *Xi ;
-    Int *perm, *Lperm, *ncol ;
-    Int n, kmin, kmax, nj, iz, jz, il, jl, kl, ix, jx, kx, ip, jp ;
-    size_t nz, maxsize ;
-
-    // Dimensionality of the matrix
-    n = L->n ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Ls = L->s ;
 
-    // Number of non-zero elements
-    nz = L->nzmax ;
+    psi0 = Lpi[s] ;
+    ms = Lpi[s+1] - psi0 ;
+    m1 = Super[s+1] - Super[s] ;
+    m2 = ms - m1 ;
 
-    // Result has the same xtype as the factor
-    xtype = L->xtype ;
+    scol = s + 1 ;
+    for (j = 0; j < m2; j++)
+    {
+        jx = Ls[psi0+m1+j] ;
+        while (Super[scol+1]-1 < jx)
+            scol++ ;
+        jl = jx - Super[scol] ;
 
-    V = NULL ;
-    z = NULL ;
-    perm = NULL ;
-    ncol = NULL ;
-    maxsize = 0 ;
+        il = 0 ;
+        for (i = j; i < m2; i++)
+        {
+            ix = Ls[psi0+m1+i] ;
+            while (Ls[Lpi[scol]+il] < ix)
+                il++ ;
+            map[i+j*m2] = Lpx[scol] + il + jl*(Lpi[scol+1]-Lpi[scol]) ;
+        }
+    }
+}
 
 
-    // Allocate the result X
-    X = CHOLMOD(spzeros) (n, n, nz, xtype, Common) ;
-    if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
+/*
+ * Indices (in L->x) of the elements X[ix,jx] needed for the lower triangle
+ * of the nj x nj matrix V of the column jl.  Same search as in
+ * cholmod_spinv_simplicial.
+ */
+void CHOLMOD(spinv_simplicial_map)
+(
+    cholmod_factor *L,
+    Int jl,
+    Int *map
+)
+{
+    Int *Lp, *Li ;
+    Int iz, jz, ix, jx, kx, kmin, nj ;
 
-    // Shorthand notation
-    Xp = X->p ;
-    Xi = X->i ;
-    Xx = X->x ;
     Lp = L->p ;
     Li = L->i ;
-    Lx = L->x ;
-    Lperm = L->Perm ;
 
-    Lxj = NULL ;
+    kmin = Lp[jl] ;
+    nj = Lp[jl+1] - 1 - kmin ;
 
-    /*
-     * Compute the mapping to the permuted result:
-     * X->x[perm[i]] ~ L->x[i]
-     * Both X and L are lower triangular
-     */
-
-    /* Count non-zeros on columns */
-    for (jl = 0; jl < n; jl++)
+    for (jz = 0; jz < nj; jz++)
     {
-        jp = PERM(jl) ; // permuted column
-        for (kl = Lp[jl]; kl < Lp[jl+1]; kl++)
+        jx = Li[kmin+1+jz] ;
+        kx = Lp[jx] ;
+        for (iz = jz; iz < nj; iz++)
         {
-            il = Li[kl] ;    // row of L
-            ip = PERM(il) ; // permuted row
-            // Increase the number of elements in the column
-            jx = MIN(ip,jp) ;
-            Xp[jx+1]++ ;
+            ix = Li[kmin+1+iz] ;
+            while (Li[kx] < ix)
+                kx++ ;
+            map[iz+jz*nj] = kx ;
         }
     }
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_super ================================================== */
+/* ========================================================================== */
+
+/*
+ * Inverse of the supernode s in the layout of L->x, the supernodes it depends
+ * on (its ancestors) must be done.  V, Z and map are workspace of the size of
+ * the supernode.
+ */
+void CHOLMOD(spinv_supernode)
+(
+    cholmod_factor *L,
+    Int s,
+    double *Xf,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+)
+{
+    Int *Super, *Lpi, *Lpx ;
+    double *Lx ;
+    Int i, j, kl, ms, ns, m1, m2 ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Lx = L->x ;
 
-    /* Compute column pointers by computing cumulative sum */
-    for (jx = 1; jx <= n; jx++)
+    // Z = [Z1; Z2] where Z1 is ns x ns and Z2 is (ms-ns) x ns
+    // L = [L1; L2] where L1 is ns x ns and L2 is (ms-ns) x ns
+    ns = Super[s+1] - Super[s] ;
+    ms = Lpi[s+1] - Lpi[s] ;
+    m1 = ns ;
+    m2 = ms - ns ;
+
+    /*
+     * Collect V (symmetric in lower triangular form)
+     */
+    if (m2 > 0)
     {
-        if (Xp[jx] > maxsize)
-            maxsize = Xp[jx] - 1 ; // number of non-zeros (without diagonal)
-        Xp[jx] += Xp[jx-1] ;
+        CHOLMOD(spinv_super_map) (L, s, map) ;
+        CHOLMOD(spinv_gather_lower) (V, Xf, map, m2) ;
     }
 
-    /* Add row indices */
-    ncol = (Int*)CHOLMOD(calloc)(n, sizeof(Int), Common) ;
-    perm = CHOLMOD(malloc)(nz, sizeof(Int), Common) ; // permutation mapping
-    if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
+    /*
+     * Compute the inverse of the supernode block
+     */
+    CHOLMOD(spinv_block) (Lx + Lpx[s], Z, V, ms, ns, Common) ;
 
-    for (jl = 0; jl < n; jl++)
+    /*
+     * Store the result Z = [Z1; Z2], the diagonal block is made exactly
+     * symmetric
+     */
+    for (j = 0; j < ns; j++)
     {
-        jp = PERM(jl) ; // permuted column
-        for (kl = Lp[jl]; kl < Lp[jl+1]; kl++)
+        for (i = j; i < ms; i++)
         {
-            il = Li[kl] ;          // row of L
-            ip = PERM(il) ;       // permuted row
-            jx = MIN(ip,jp) ;      // column of X
-            ix = MAX(ip,jp) ;      // row of X
-            kx = Xp[jx]+ncol[jx] ; // index of X
-            // Increase elements on the column
-            ncol[jx]++ ;
-            // Add row index
-            Xi[kx] = ix ;
-            // Mapping X[perm[i]] ~ L[i]
-            perm[kl] = kx ;
+            kl = Lpx[s] + i + j*ms ;
+            if (i < m1)
+                Xf[kl] = 0.5*(Z[i+j*ms]+Z[j+i*ms]) ;
+            else
+                Xf[kl] = Z[i+j*ms] ;
         }
     }
-    ncol = CHOLMOD(free)(n, sizeof(Int), ncol, Common) ;
-    X->sorted = FALSE ;
+}
 
-    // Allocate memory for a temporary matrix and vector
-    z = CHOLMOD(malloc)(maxsize+1, sizeof(double), Common) ;
-    V = CHOLMOD(malloc)(maxsize*maxsize, sizeof(double), Common) ;
-    if (Common->status < CHOLMOD_OK)
-      goto cleanup ;
 
-    if (L->is_ll)
+/*
+ * Sparse inverse of a supernodal LL' factorization in the layout of L->x:
+ * Xf[kl] is the element of the inverse at the position of L->x[kl].  With
+ * more than one thread the supernodes are scheduled by
+ * cholmod_spinv_super_hybrid, otherwise they are done from the root down.
+ */
+static void spinv_super
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+)
+{
+    Int s ;
+
+    if (CHOLMOD(spinv_super_hybrid) (L, Xf, V, Z, map, Common))
+        return ;
+
+    for (s = L->nsuper - 1; s >= 0; s--)
+        CHOLMOD(spinv_supernode) (L, s, Xf, V, Z, map, Common) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_simplicial ============================================= */
+/* ========================================================================== */
+
+/*
+ * Sparse inverse of a simplicial LDL' factorization in the layout of L->x.
+ */
+static void spinv_simplicial
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *V,
+    double *z,
+    Int *map
+)
+{
+    Int *Lp ;
+    double *Lx ;
+    Int jl, iz, kmin, nj ;
+
+    Lp = L->p ;
+    Lx = L->x ;
+
+    for (jl = L->n - 1; jl >= 0; jl--)
     {
+        // Non-zero elements of the column without the diagonal D[j,j]
+        kmin = Lp[jl] ;
+        nj = Lp[jl+1] - 1 - kmin ;
+
+        Xf[kmin] = 1.0/Lx[kmin] ;
 
-        switch (xtype)
+        if (nj > 0)
         {
-        case CHOLMOD_REAL:
-            ERROR (CHOLMOD_INVALID,"Real xtype for L*L' not implemented.") ;
-            break ;
+            CHOLMOD(spinv_simplicial_map) (L, jl, map) ;
+            CHOLMOD(spinv_gather_lower) (V, Xf, map, nj) ;
 
-        case CHOLMOD_COMPLEX:
-            ERROR (CHOLMOD_INVALID,"Complex xtype for L*L' not implemented.") ;
-            break ;
+            // z = V * l
+            cblas_dsymv (CblasColMajor, CblasLower, (BLAS_INT) nj, 1.0, V,
+                         (BLAS_INT) nj, Lx + (kmin+1), 1, 0.0, z, 1) ;
 
-        case CHOLMOD_ZOMPLEX:
-            ERROR (CHOLMOD_INVALID,"Zomplex xtype for L*L' not implemented.") ;
-            break ;
+            // X[j,j] = 1/D[j,j] + z'*l
+            Xf[kmin] += cblas_ddot ((BLAS_INT) nj, z, 1, Lx + (kmin+1), 1) ;
 
+            for (iz = 0; iz < nj; iz++)
+                Xf[kmin+1+iz] = -z[iz] ;
         }
     }
-    else
-    {
+}
+
+
+/*
+ * TRUE if every column of the simplicial factor is contiguous from the
+ * diagonal down and the column after it reaches at least as far, as for a
+ * banded or block-tridiagonal matrix in its natural ordering.
+ */
+static int spinv_is_band
+(
+    cholmod_factor *L
+)
+{
+    Int *Lp, *Li ;
+    Int j, kl, nj, n ;
 
-        switch (xtype)
+    Lp = L->p ;
+    Li = L->i ;
+    n = L->n ;
+
+    for (j = 0; j < n; j++)
+    {
+        nj = Lp[j+1] - 1 - Lp[j] ;
+        for (kl = Lp[j]; kl < Lp[j+1]; kl++)
         {
-        case CHOLMOD_REAL:
+            if (Li[kl] != j + (kl - Lp[j]))
+                return (FALSE) ;
+        }
+        if (nj > 0 && Lp[j+2] - Lp[j+1] < nj)
+            return (FALSE) ;
+    }
+    return (TRUE) ;
+}
 
-            for (jl = n-1; jl >= 0; jl--)
-            {
-                // Indices of non-zero elements in j-th column
-                kmin = Lp[jl];         // first index
-                kmax = Lp[jl+1] - 1;   // last index
-                nj = kmax - kmin; // number of non-zero elements (without diagonal)
-
-                // Diagonal entry of D: D[j,j]
-                djj = Lx[kmin] ;
-                if (kmax > kmin)
-                {
-                    // j-th column vector of L (without the
-                    // diagonal element and zeros)
-                    Lxj = Lx + (kmin+1) ;
 
-                    // Form Z
-                    for (jz = 0; jz < nj; jz++)
-                    {
-                        // Row index of the (jz+1):th non-zero
-                        // element on column j
-                        // = relevant column index of X
-                        jx = Li[kmin+1+jz] ;
-                        // Index of the diagonal element on column
-                        // jx
-                        kx = Lp[jx] ;
-
-                        // Set lower triangular elements of column
-                        // jz (no need to set upper triangular
-                        // elements because of the symmetry).
-                        for (iz = jz; iz < nj; iz++)
-                        {
-                            ix = Li[kmin+1+iz] ;
-                            // Find X[row,jx]
-                            while (Li[kx] < ix)
-                                kx++ ;
-
-                            // Set Z[iz,jz] = X[ix,jx]
-                            V[iz+jz*nj] = Xx[perm[kx]] ;
-                        }
+/*
+ * Sparse inverse of a banded simplicial LDL' factorization (see
+ * spinv_is_band).  The part V of the inverse needed by the column j is in
+ * the columns j+1..j+nj of Xf, and the part of each of them is contiguous,
+ * thus z = V*l is computed directly from Xf without V, map or searches.
+ * The columns read are a sliding window of the last computed ones, read in
+ * order, and the cost is O(n*b^2) for the bandwidth b.
+ */
+static void spinv_simplicial_band
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *z
+)
+{
+    Int *Lp ;
+    double *Lx, *l, *x ;
+    Int jl, iz, jz, kmin, nj ;
 
-                    }
+    Lp = L->p ;
+    Lx = L->x ;
 
-                    cblas_dsymv
-                      (
-                       CblasColMajor, // const enum CBLAS_ORDER order
-                       CblasLower,    // const enum CBLAS_UPLO Uplo
-                       nj,            // const int N
-                       1.0,           // const double alpha
-                       V,             // const double *A
-                       nj,            // const int lda
-                       Lxj,           // const double *X
-                       1,             // const int incX
-                       0.0,           // const double beta
-                       z,             // double *Y
-                       1              // const int incY
-                       ) ;
-
-                    // Copy the result to the lower part of X
-                    for (iz = 0; iz < nj; iz++)
-                    {
-                        kx = kmin + 1 + iz ;
-                        Xx[perm[kx]] = -z[iz] ;
-                    }
+    for (jl = L->n - 1; jl >= 0; jl--)
+    {
+        kmin = Lp[jl] ;
+        nj = Lp[jl+1] - 1 - kmin ;
+        l = Lx + (kmin+1) ;
 
-                    // Compute the diagonal element X[j,j]
-                    Xx[perm[kmin]] = 1.0/djj + cblas_ddot
-                      (
-                       nj,  // const int N
-                       z,   // const double *X
-                       1,   // const int incX
-                       Lxj, // const double *Y
-                       1    // const int incY
-                       ) ;
+        Xf[kmin] = 1.0/Lx[kmin] ;
 
-                }
-                else
+        if (nj > 0)
+        {
+            // z = V * l, x[iz] = X[jl+1+iz,jl+1+jz] for iz >= jz
+            for (iz = 0; iz < nj; iz++)
+                z[iz] = 0 ;
+            for (jz = 0; jz < nj; jz++)
+            {
+                x = Xf + (Lp[jl+1+jz] - jz) ;
+                z[jz] += x[jz] * l[jz] ;
+                for (iz = jz+1; iz < nj; iz++)
                 {
-                    // Compute the diagonal element X[j,j]
-                    Xx[perm[kmin]] = 1.0/djj ;
+                    z[iz] += x[iz] * l[jz] ;
+                    z[jz] += x[iz] * l[iz] ;
                 }
             }
-            break ;
 
-        case CHOLMOD_COMPLEX:
-            ERROR (CHOLMOD_INVALID,"Complex xtype for L*D*L' not implemented.") ;
-            break ;
+            // X[j,j] = 1/D[j,j] + z'*l
+            for (iz = 0; iz < nj; iz++)
+                Xf[kmin] += z[iz] * l[iz] ;
 
-        case CHOLMOD_ZOMPLEX:
-            ERROR (CHOLMOD_INVALID,"Zomplex xtype for L*D*L' not implemented.") ;
-            break ;
+            for (iz = 0; iz < nj; iz++)
+                Xf[kmin+1+iz] = -z[iz] ;
         }
-
     }
+}
 
-cleanup:
-    CHOLMOD(free)(maxsize*maxsize, sizeof(double), V, Common) ;
-    CHOLMOD(free)(maxsize+1, sizeof(double), z, Common) ;
-    CHOLMOD(free)(nz, sizeof(Int), perm, Common) ;
-    CHOLMOD(free)(n, sizeof(Int), ncol, Common) ;
 
-    if (Common->status >= CHOLMOD_OK)
+/* ========================================================================== */
+/* === cholmod_spinv_numeric ================================================ */
+/* ========================================================================== */
+
+/*
+ * Sparse inverse in the layout of L->x.  Xf has spinv_layout_size(L)
+ * doubles, or twice that (interleaved complex) if L is complex or zomplex.
+ */
+int CHOLMOD(spinv_numeric)
+(
+    cholmod_factor *L,
+    double *Xf,
+    cholmod_common *Common
+)
+{
+    double *V, *Z ;
+    Int *Lpx, *Lp, *map ;
+    Int n, s, jl ;
+    size_t vsize, zsize, maxsize ;
+    int band ;
+
+    if (L->xtype != CHOLMOD_REAL)
+        return (CHOLMOD(spinv_complex_numeric) (L, Xf, Common)) ;
+
+    if (!L->is_super && L->is_ll)
     {
-        // The result is symmetric but only the lower triangular part was
-        // computed.
-        X->stype = -1 ;
+        ERROR (CHOLMOD_INVALID, "Real xtype for L*L' not implemented.") ;
+        return (FALSE) ;
+    }
 
-        // Sort columns (is it necessary?)
-        CHOLMOD(sort) (X, Common) ;
+    n = L->n ;
 
-        if (Common->status >= CHOLMOD_OK)
-            return (X) ;
+    /*
+     * Workspace using the size of the largest supernode or column, a banded
+     * factor needs no V
+     */
+    maxsize = 0 ;
+    band = FALSE ;
+    if (L->is_super)
+    {
+        Lpx = L->px ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            if (Lpx[s+1] - Lpx[s] > maxsize)
+                maxsize = Lpx[s+1] - Lpx[s] ;
+        }
+        vsize = MAX (L->maxesize*L->maxesize, 1) ;
+        zsize = MAX (maxsize, 1) ;
+    }
+    else
+    {
+        Lp = L->p ;
+        for (jl = 0; jl < n; jl++)
+        {
+            if (Lp[jl+1] - Lp[jl] - 1 > maxsize)
+                maxsize = Lp[jl+1] - Lp[jl] - 1 ;
+        }
+        band = spinv_is_band (L) ;
+        vsize = band ? 1 : MAX (maxsize*maxsize, 1) ;
+        zsize = maxsize + 1 ;
     }
 
-    CHOLMOD(free_sparse) (&X, Common) ;
-    return (NULL) ;
+    V = CHOLMOD(spinv_malloc)(vsize, sizeof(double), Common) ;
+    Z = CHOLMOD(spinv_malloc)(zsize, sizeof(double), Common) ;
+    map = CHOLMOD(spinv_malloc)(vsize, sizeof(Int), Common) ;
+    if (Common->status >= CHOLMOD_OK)
+    {
+        if (L->is_super)
+            spinv_super (L, Xf, V, Z, map, Common) ;
+        else if (band)
+            spinv_simplicial_band (L, Xf, Z) ;
+        else
+            spinv_simplicial (L, Xf, V, Z, map) ;
+    }
 
+    CHOLMOD(spinv_free)(vsize, sizeof(Int), map, Common) ;
+    CHOLMOD(spinv_free)(zsize, sizeof(double), Z, Common) ;
+    CHOLMOD(spinv_free)(vsize, sizeof(double), V, Common) ;
+
+    return (Common->status >= CHOLMOD_OK) ;
 }
 
 
@@ -800,6 +1349,10 @@ cholmod_sparse *CHOLMOD(spinv)    /* returns the sparse solution X */
     cholmod_common *Common
     )
 {
+    cholmod_sparse *X ;
+    double *Xf ;
+    size_t fsize ;
+    int xtype, cached ;
 
     ASSERT (L->xtype != CHOLMOD_PATTERN) ;  /* L is not symbolic */
 
@@ -812,15 +1365,31 @@ cholmod_sparse *CHOLMOD(spinv)    /* returns the sparse solution X */
     RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
     Common->status = CHOLMOD_OK ;
 
+    // Symbolic part from the plan cache, if it is on
+    X = CHOLMOD(spinv_cache_numeric) (L, &cached, Common) ;
+    if (cached)
+        return (X) ;
+
     /*
-     * Compute the sparse inverse.
+     * Compute the sparse inverse in the layout of L->x and permute it in
+     * place to the result.  Complex and zomplex give an interleaved complex
+     * result.
      */
-    if (L->is_super)
-    {
-        return CHOLMOD(spinv_super) (L, Common) ;
-    }
-    else
+    xtype = (L->xtype == CHOLMOD_REAL) ? CHOLMOD_REAL : CHOLMOD_COMPLEX ;
+    fsize = CHOLMOD(spinv_layout_size) (L) ;
+    if (xtype == CHOLMOD_COMPLEX)
+        fsize *= 2 ;
+
+    // The array of the recursion becomes the values of the result, thus it
+    // is from CHOLMOD(malloc) and not cholmod_spinv_malloc
+    Xf = CHOLMOD(malloc)(fsize, sizeof(double), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (NULL) ;
+
+    if (!CHOLMOD(spinv_numeric) (L, Xf, Common))
     {
-        return CHOLMOD(spinv_simplicial) (L, Common) ;
+        CHOLMOD(free)(fsize, sizeof(double), Xf, Common) ;
+        return (NULL) ;
     }
+    return (spinv_gather_inplace (L, Xf, fsize, xtype, Common)) ;
 }
@@ -0,0 +1,619 @@
+/* ========================================================================== */
+/* === cholmod_spinv_adjoint ================================================ */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_adjoint.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Reverse-mode derivative of the sparse inverse.  Given the factorization L
+ * of A, the sparse inverse X = cholmod_spinv (L) and the partial derivatives
+ * Xbar of a scalar function f with respect to the elements of X, compute the
+ * partial derivatives of f with respect to the elements of A.  The result has
+ * the same sparsity pattern as X.
+ *
+ * A symmetric matrix is parameterized by the elements of its stored
+ * triangle, thus an off-diagonal element of Xbar or of the result is the
+ * derivative with respect to both X[i,j] and X[j,i].  If Xbar is
+ * unsymmetric (stype 0), both of its triangles are used and the
+ * derivatives of the symmetric positions are summed.
+ *
+ * The computation consists of two sweeps over the factor.  The reverse of
+ * the Takahashi recursion (first to last column) gives the derivatives with
+ * respect to L and the reverse of the Cholesky factorization (last to first
+ * column) gives the derivatives with respect to A.  Both sweeps work in the
+ * layout of L->x and use the same blocked kernels as cholmod_spinv_super,
+ * thus the cost is comparable to that of cholmod_spinv.
+ *
+ * At the moment, the same methods as in cholmod_spinv are supported, that
+ * is, real supernodal LL' and real simplicial LDL' factorizations.
+ *
+ * References:
+ *
+ * Murray I (2016). Differentiation of the Cholesky decomposition.
+ * arXiv:1602.07527.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+/* ========================================================================== */
+/* === cholmod_spinv_adjoint_super ========================================== */
+/* ========================================================================== */
+
+/*
+ * On input, F contains Xbar and Xf contains X, both in the layout of L->x.
+ * On output, F contains the derivatives with respect to A.
+ */
+static void spinv_adjoint_super
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *F,
+    double *Work,
+    Int *map
+)
+{
+    Int *Super, *Lpi, *Lpx ;
+    double *Lx, *V, *W1, *W2, *A, *B, *XA, *XB, *FA, *FB ;
+    Int s, i, j, n, ms, m2, nsuper ;
+    size_t maxsize ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Lx = L->x ;
+    nsuper = L->nsuper ;
+
+    /*
+     * Split the workspace using the size of the largest supernode
+     */
+    maxsize = 0 ;
+    for (s = 0; s < nsuper; s++)
+    {
+        if (Lpx[s+1] - Lpx[s] > maxsize)
+            maxsize = Lpx[s+1] - Lpx[s] ;
+    }
+    W1 = Work ;
+    W2 = W1 + maxsize ;
+    V = W2 + maxsize ;
+
+    /*
+     * Reverse of the Takahashi recursion: Xbar -> Lbar
+     *
+     * Forward step for a supernode with L = [A; B] and V = X[R,R]:
+     *   T = V*B,  XB = -T/A,  XA = A'\(I + B'*T)/A
+     */
+    for (s = 0; s < nsuper; s++)
+    {
+        n = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        m2 = ms - n ;
+
+        A = Lx + Lpx[s] ;
+        B = A + n ;
+        XA = Xf + Lpx[s] ;
+        XB = XA + n ;
+        FA = F + Lpx[s] ;
+        FB = FA + n ;
+
+        // W1A = G, the symmetric derivative with respect to XA
+        for (j = 0; j < n; j++)
+        {
+            for (i = 0; i < n; i++)
+            {
+                if (i > j)
+                    W1[i+j*ms] = 0.5*FA[i+j*ms] ;
+                else if (i < j)
+                    W1[i+j*ms] = 0.5*FA[j+i*ms] ;
+                else
+                    W1[i+j*ms] = FA[i+i*ms] ;
+            }
+        }
+
+        // W2A = 2*XA*G + XB'*FB
+        cblas_dsymm (CblasColMajor, CblasLeft, CblasLower, (BLAS_INT) n,
+                     (BLAS_INT) n, 2.0, XA, (BLAS_INT) ms, W1, (BLAS_INT) ms,
+                     0.0, W2, (BLAS_INT) ms) ;
+        if (m2 > 0)
+        {
+            cblas_dgemm (CblasColMajor, CblasTrans, CblasNoTrans, (BLAS_INT) n,
+                         (BLAS_INT) n, (BLAS_INT) m2, 1.0, XB, (BLAS_INT) ms,
+                         FB, (BLAS_INT) ms, 1.0, W2, (BLAS_INT) ms) ;
+        }
+
+        // Abar = -tril(W2A/A')
+        cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W2, (BLAS_INT) ms) ;
+        for (j = 0; j < n; j++)
+        {
+            for (i = 0; i < n; i++)
+                FA[i+j*ms] = (i >= j) ? -W2[i+j*ms] : 0.0 ;
+        }
+
+        // W1A = Pbar = A\G/A', the derivative with respect to B'*T
+        cblas_dtrsm (CblasColMajor, CblasLeft, CblasLower, CblasNoTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W1, (BLAS_INT) ms) ;
+        cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W1, (BLAS_INT) ms) ;
+
+        if (m2 > 0)
+        {
+            // W2B = Tbar = B*Pbar - FB/A'
+            for (j = 0; j < n; j++)
+            {
+                for (i = n; i < ms; i++)
+                    W2[i+j*ms] = FA[i+j*ms] ;
+            }
+            cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasTrans,
+                         CblasNonUnit, (BLAS_INT) m2, (BLAS_INT) n, 1.0, A,
+                         (BLAS_INT) ms, W2+n, (BLAS_INT) ms) ;
+            cblas_dgemm (CblasColMajor, CblasNoTrans, CblasNoTrans,
+                         (BLAS_INT) m2, (BLAS_INT) n, (BLAS_INT) n, 1.0, B,
+                         (BLAS_INT) ms, W1, (BLAS_INT) ms, -1.0, W2+n,
+                         (BLAS_INT) ms) ;
+
+            // W1B = T = -XB*A
+            for (j = 0; j < n; j++)
+            {
+                for (i = n; i < ms; i++)
+                    W1[i+j*ms] = XA[i+j*ms] ;
+            }
+            cblas_dtrmm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                         CblasNonUnit, (BLAS_INT) m2, (BLAS_INT) n, -1.0, A,
+                         (BLAS_INT) ms, W1+n, (BLAS_INT) ms) ;
+
+            // Bbar = T*Pbar + V*Tbar
+            CHOLMOD(spinv_super_map) (L, s, map) ;
+            CHOLMOD(spinv_gather_lower) (V, Xf, map, m2) ;
+            cblas_dgemm (CblasColMajor, CblasNoTrans, CblasNoTrans,
+                         (BLAS_INT) m2, (BLAS_INT) n, (BLAS_INT) n, 1.0, W1+n,
+                         (BLAS_INT) ms, W1, (BLAS_INT) ms, 0.0, FB,
+                         (BLAS_INT) ms) ;
+            cblas_dsymm (CblasColMajor, CblasLeft, CblasLower, (BLAS_INT) m2,
+                         (BLAS_INT) n, 1.0, V, (BLAS_INT) m2, W2+n,
+                         (BLAS_INT) ms, 1.0, FB, (BLAS_INT) ms) ;
+
+            // Vbar = Tbar*B' (folded to the lower triangle) is added to the
+            // derivatives of the elements of X in the later supernodes
+            cblas_dsyr2k (CblasColMajor, CblasLower, CblasNoTrans,
+                          (BLAS_INT) m2, (BLAS_INT) n, 1.0, W2+n,
+                          (BLAS_INT) ms, B, (BLAS_INT) ms, 0.0, V,
+                          (BLAS_INT) m2) ;
+            for (j = 0; j < m2; j++)
+            {
+                F[map[j+j*m2]] += 0.5*V[j+j*m2] ;
+                for (i = j+1; i < m2; i++)
+                    F[map[i+j*m2]] += V[i+j*m2] ;
+            }
+        }
+    }
+
+    /*
+     * Reverse of the supernodal Cholesky factorization: Lbar -> Abar
+     *
+     * Forward step for a supernode:
+     *   A = chol(SA),  B = SB/A',  SC = SC - tril(B*B')
+     */
+    for (s = nsuper - 1; s >= 0; s--)
+    {
+        n = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        m2 = ms - n ;
+
+        A = Lx + Lpx[s] ;
+        B = A + n ;
+        FA = F + Lpx[s] ;
+        FB = FA + n ;
+
+        if (m2 > 0)
+        {
+            // V = SCbar + SCbar' (the later supernodes are already done)
+            CHOLMOD(spinv_super_map) (L, s, map) ;
+            for (j = 0; j < m2; j++)
+            {
+                V[j+j*m2] = 2.0*F[map[j+j*m2]] ;
+                for (i = j+1; i < m2; i++)
+                    V[i+j*m2] = F[map[i+j*m2]] ;
+            }
+
+            // SBbar = (Bbar - V*B)/A
+            cblas_dsymm (CblasColMajor, CblasLeft, CblasLower, (BLAS_INT) m2,
+                         (BLAS_INT) n, -1.0, V, (BLAS_INT) m2, B,
+                         (BLAS_INT) ms, 1.0, FB, (BLAS_INT) ms) ;
+            cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                         CblasNonUnit, (BLAS_INT) m2, (BLAS_INT) n, 1.0, A,
+                         (BLAS_INT) ms, FB, (BLAS_INT) ms) ;
+
+            // Abar = Abar - tril(SBbar'*B)
+            cblas_dgemm (CblasColMajor, CblasTrans, CblasNoTrans, (BLAS_INT) n,
+                         (BLAS_INT) n, (BLAS_INT) m2, 1.0, FB, (BLAS_INT) ms,
+                         B, (BLAS_INT) ms, 0.0, W1, (BLAS_INT) ms) ;
+            for (j = 0; j < n; j++)
+            {
+                for (i = j; i < n; i++)
+                    FA[i+j*ms] -= W1[i+j*ms] ;
+            }
+        }
+
+        // W1 = A'*tril(Abar) with the upper triangle copied from the lower
+        for (j = 0; j < n; j++)
+        {
+            for (i = 0; i < n; i++)
+                W1[i+j*ms] = (i >= j) ? FA[i+j*ms] : 0.0 ;
+        }
+        cblas_dtrmm (CblasColMajor, CblasLeft, CblasLower, CblasTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W1, (BLAS_INT) ms) ;
+        for (j = 0; j < n; j++)
+        {
+            for (i = 0; i < j; i++)
+                W1[i+j*ms] = W1[j+i*ms] ;
+        }
+
+        // SAbar = Phi(A'\W1/A), Phi halves the diagonal
+        cblas_dtrsm (CblasColMajor, CblasLeft, CblasLower, CblasTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W1, (BLAS_INT) ms) ;
+        cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                     CblasNonUnit, (BLAS_INT) n, (BLAS_INT) n, 1.0, A,
+                     (BLAS_INT) ms, W1, (BLAS_INT) ms) ;
+        for (j = 0; j < n; j++)
+        {
+            FA[j+j*ms] = 0.5*W1[j+j*ms] ;
+            for (i = j+1; i < n; i++)
+                FA[i+j*ms] = 0.5*(W1[i+j*ms] + W1[j+i*ms]) ;
+        }
+    }
+
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_adjoint_simplicial ===================================== */
+/* ========================================================================== */
+
+/*
+ * On input, F contains Xbar and Xf contains X, both in the layout of L->x.
+ * On output, F contains the derivatives with respect to A.
+ */
+static void spinv_adjoint_simplicial
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *F,
+    double *Work,
+    Int *map
+)
+{
+    double *Lx, *V, *w, *y, *Lxj, *Fj ;
+    double djj, xbar, dbar ;
+    Int *Lp ;
+    Int n, jl, iz, jz, kmin, nj ;
+    size_t maxsize ;
+
+    n = L->n ;
+    Lp = L->p ;
+    Lx = L->x ;
+
+    maxsize = 0 ;
+    for (jl = 0; jl < n; jl++)
+    {
+        if (Lp[jl+1] - Lp[jl] - 1 > maxsize)
+            maxsize = Lp[jl+1] - Lp[jl] - 1 ;
+    }
+    w = Work ;
+    y = w + (maxsize+1) ;
+    V = y + (maxsize+1) ;
+
+    /*
+     * Reverse of the Takahashi recursion: Xbar -> (Lbar, Dbar)
+     *
+     * Forward step for a column with L[R,j] = l and V = X[R,R]:
+     *   X[R,j] = -V*l,  X[j,j] = 1/d + l'*V*l
+     */
+    for (jl = 0; jl < n; jl++)
+    {
+        kmin = Lp[jl] ;
+        nj = Lp[jl+1] - 1 - kmin ;
+        djj = Lx[kmin] ;
+        Lxj = Lx + (kmin+1) ;
+        Fj = F + (kmin+1) ;
+        xbar = F[kmin] ;
+
+        if (nj > 0)
+        {
+            CHOLMOD(spinv_simplicial_map) (L, jl, map) ;
+            for (jz = 0; jz < nj; jz++)
+            {
+                for (iz = jz; iz < nj; iz++)
+                    V[iz+jz*nj] = Xf[map[iz+jz*nj]] ;
+            }
+
+            // w = V*Xbar[R,j] and y = xbar*l - Xbar[R,j]
+            cblas_dsymv (CblasColMajor, CblasLower, (BLAS_INT) nj, 1.0, V,
+                         (BLAS_INT) nj, Fj, 1, 0.0, w, 1) ;
+            for (iz = 0; iz < nj; iz++)
+                y[iz] = xbar*Lxj[iz] - Fj[iz] ;
+
+            // lbar = -2*xbar*X[R,j] - V*Xbar[R,j]
+            for (iz = 0; iz < nj; iz++)
+                Fj[iz] = -2.0*xbar*Xf[kmin+1+iz] - w[iz] ;
+
+            // Vbar = l*y' + y*l' (folded to the lower triangle) is added to
+            // the derivatives of the elements of X in the later columns
+            for (jz = 0; jz < nj; jz++)
+            {
+                for (iz = jz; iz < nj; iz++)
+                    V[iz+jz*nj] = 0.0 ;
+            }
+            cblas_dsyr2 (CblasColMajor, CblasLower, (BLAS_INT) nj, 1.0, Lxj, 1,
+                         y, 1, V, (BLAS_INT) nj) ;
+            for (jz = 0; jz < nj; jz++)
+            {
+                F[map[jz+jz*nj]] += 0.5*V[jz+jz*nj] ;
+                for (iz = jz+1; iz < nj; iz++)
+                    F[map[iz+jz*nj]] += V[iz+jz*nj] ;
+            }
+        }
+
+        // dbar = -xbar/d^2
+        F[kmin] = -xbar/(djj*djj) ;
+    }
+
+    /*
+     * Reverse of the LDL' factorization: (Lbar, Dbar) -> Abar
+     *
+     * Forward step for a column:
+     *   d = S[j,j],  l = S[R,j]/d,  S[R,R] = S[R,R] - tril(d*l*l')
+     */
+    for (jl = n-1; jl >= 0; jl--)
+    {
+        kmin = Lp[jl] ;
+        nj = Lp[jl+1] - 1 - kmin ;
+        djj = Lx[kmin] ;
+        Lxj = Lx + (kmin+1) ;
+        Fj = F + (kmin+1) ;
+        dbar = F[kmin] ;
+
+        if (nj > 0)
+        {
+            // V = Sbar[R,R] + Sbar[R,R]' (the later columns are done)
+            CHOLMOD(spinv_simplicial_map) (L, jl, map) ;
+            for (jz = 0; jz < nj; jz++)
+            {
+                V[jz+jz*nj] = 2.0*F[map[jz+jz*nj]] ;
+                for (iz = jz+1; iz < nj; iz++)
+                    V[iz+jz*nj] = F[map[iz+jz*nj]] ;
+            }
+
+            // w = V*l, lbar = lbar - d*w, dbar = dbar - l'*w/2
+            cblas_dsymv (CblasColMajor, CblasLower, (BLAS_INT) nj, 1.0, V,
+                         (BLAS_INT) nj, Lxj, 1, 0.0, w, 1) ;
+            cblas_daxpy ((BLAS_INT) nj, -djj, w, 1, Fj, 1) ;
+            dbar -= 0.5*cblas_ddot ((BLAS_INT) nj, Lxj, 1, w, 1) ;
+
+            // Sbar[j,j] = dbar - lbar'*l/d, Sbar[R,j] = lbar/d
+            dbar -= cblas_ddot ((BLAS_INT) nj, Fj, 1, Lxj, 1) / djj ;
+            cblas_dscal ((BLAS_INT) nj, 1.0/djj, Fj, 1) ;
+        }
+
+        F[kmin] = dbar ;
+    }
+
+}
+
+
+/*
+ * Size of the workspace of cholmod_spinv_adjoint_numeric: *dsize doubles
+ * and *isize Ints.
+ */
+void CHOLMOD(spinv_adjoint_worksize)
+(
+    cholmod_factor *L,
+    size_t *dsize,
+    size_t *isize
+)
+{
+    Int *Lpx, *Lp ;
+    Int s, jl, n ;
+    size_t maxsize ;
+
+    maxsize = 0 ;
+    if (L->is_super)
+    {
+        Lpx = L->px ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            if (Lpx[s+1] - Lpx[s] > maxsize)
+                maxsize = Lpx[s+1] - Lpx[s] ;
+        }
+        *isize = L->maxesize*L->maxesize ;
+        *dsize = *isize + 2*maxsize ;
+    }
+    else
+    {
+        n = L->n ;
+        Lp = L->p ;
+        for (jl = 0; jl < n; jl++)
+        {
+            if (Lp[jl+1] - Lp[jl] - 1 > maxsize)
+                maxsize = Lp[jl+1] - Lp[jl] - 1 ;
+        }
+        *isize = maxsize*maxsize ;
+        *dsize = *isize + 2*(maxsize+1) ;
+    }
+}
+
+
+/*
+ * Propagate the derivatives Xbar in F (layout of L->x) to the derivatives
+ * with respect to A in F.  The inputs must have been checked already, thus
+ * this can be called from several threads with separate F and workspace.
+ */
+void CHOLMOD(spinv_adjoint_numeric)
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *F,
+    double *Work,
+    Int *Iwork
+)
+{
+    if (L->is_super)
+        spinv_adjoint_super (L, Xf, F, Work, Iwork) ;
+    else
+        spinv_adjoint_simplicial (L, Xf, F, Work, Iwork) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_adjoint ================================================ */
+/* ========================================================================== */
+
+cholmod_sparse *CHOLMOD(spinv_adjoint)  /* returns the derivatives wrt A */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse *X,	/* sparse inverse computed by cholmod_spinv */
+    cholmod_sparse *Xbar, /* derivatives with respect to X */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *Abar ;
+    double *Xf, *F, *Ax, *Work ;
+    Int *Lperm, *Iperm, *Iwork, *Ap, *Ai, *Anz ;
+    Int n, i, j, p, pend, ip, jp, kl ;
+    size_t lsize, dsize, isize ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_NULL (X, NULL) ;
+    RETURN_IF_NULL (Xbar, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    RETURN_IF_XTYPE_INVALID (X, CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+    RETURN_IF_XTYPE_INVALID (Xbar, CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    n = L->n ;
+    if (X->nrow != n || X->ncol != n || Xbar->nrow != n || Xbar->ncol != n)
+    {
+        ERROR (CHOLMOD_INVALID, "dimensions do not match") ;
+        return (NULL) ;
+    }
+    if (X->stype == 0)
+    {
+        ERROR (CHOLMOD_INVALID, "X must be symmetric") ;
+        return (NULL) ;
+    }
+    if (L->xtype != CHOLMOD_REAL)
+    {
+        ERROR (CHOLMOD_INVALID, "Complex xtype not implemented.") ;
+        return (NULL) ;
+    }
+    if (!L->is_super && L->is_ll)
+    {
+        ERROR (CHOLMOD_INVALID, "Real xtype for L*L' not implemented.") ;
+        return (NULL) ;
+    }
+
+    Abar = NULL ;
+    Iperm = NULL ;
+    Xf = NULL ;
+    F = NULL ;
+    Work = NULL ;
+    Iwork = NULL ;
+    lsize = CHOLMOD(spinv_layout_size) (L) ;
+    CHOLMOD(spinv_adjoint_worksize) (L, &dsize, &isize) ;
+    Lperm = L->Perm ;
+
+    /*
+     * Move X and Xbar to the layout of L->x
+     */
+    Iperm = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Xf = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    F = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    Work = CHOLMOD(malloc)(dsize, sizeof(double), Common) ;
+    Iwork = CHOLMOD(malloc)(isize, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    for (i = 0; i < n; i++)
+        Iperm[PERM(i)] = i ;
+
+    if (!CHOLMOD(spinv_scatter) (L, X, Iperm, Xf, FALSE, Common) ||
+        !CHOLMOD(spinv_scatter) (L, Xbar, Iperm, F, TRUE, Common))
+        goto cleanup ;
+
+    /*
+     * Compute the derivatives
+     */
+    CHOLMOD(spinv_adjoint_numeric) (L, Xf, F, Work, Iwork) ;
+
+    /*
+     * The result has the same pattern as X
+     */
+    Abar = CHOLMOD(copy_sparse) (X, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    Ap = Abar->p ;
+    Ai = Abar->i ;
+    Anz = Abar->nz ;
+    Ax = Abar->x ;
+    for (j = 0; j < n; j++)
+    {
+        pend = (Abar->packed) ? Ap[j+1] : Ap[j] + Anz[j] ;
+        for (p = Ap[j]; p < pend; p++)
+        {
+            i = Ai[p] ;
+            ip = Iperm[i] ;
+            jp = Iperm[j] ;
+            kl = CHOLMOD(spinv_locate) (L, MAX(ip,jp), MIN(ip,jp)) ;
+            Ax[p] = (kl >= 0) ? F[kl] : 0.0 ;
+        }
+    }
+
+cleanup:
+    CHOLMOD(free)(isize, sizeof(Int), Iwork, Common) ;
+    CHOLMOD(free)(dsize, sizeof(double), Work, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), F, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Xf, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Iperm, Common) ;
+
+    if (Common->status < CHOLMOD_OK)
+        CHOLMOD(free_sparse) (&Abar, Common) ;
+
+    return (Abar) ;
+}
@@ -0,0 +1,319 @@
+/* ========================================================================== */
+/* === cholmod_spinv_async ================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_async.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Asynchronous sparse inverse.  cholmod_spinv_submit queues a job that a
+ * pool of worker threads runs with cholmod_spinv, and returns at once.
+ * cholmod_spinv_poll tells if the job has finished and cholmod_spinv_wait
+ * blocks until it has, returns the inverse and frees the job.  A callback
+ * given to submit is called by the worker when the job finishes, before
+ * poll returns TRUE.  Every job must be finished with cholmod_spinv_wait.
+ *
+ * The pool is started on the first submit.  Its size is set with
+ * cholmod_spinv_async_threads or, if it is not called, with the environment
+ * variable CHOLMOD_SPINV_ASYNC_THREADS; the default is the number of
+ * processors.  The jobs are taken from a single queue in the order of
+ * submission.  A job runs the parallel modes of cholmod_spinv (the
+ * threaded supernodes and gather) with Common->nthreads_max of the
+ * submitting call (or the OpenMP default), which the scheduler shares
+ * among the running jobs while they run (see cholmod_spinv_sched.c), as
+ * it does with the BLAS threads.  Thus a single inverse uses all the
+ * threads, while the factorization of the next matrix can run in the
+ * calling thread at the same time.
+ *
+ * A job has its own cholmod_common, so the caller may use its Common while
+ * the job runs.  L must not be modified or freed before the job finishes.
+ * The memory of the result is counted in the Common given to wait.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+struct cholmod_spinv_job_struct
+{
+    cholmod_factor *L ;
+    cholmod_sparse *X ;
+    cholmod_common Common ;		/* used by the worker */
+    cholmod_spinv_callback callback ;
+    void *data ;
+    int nthreads ;			/* threads shared by the running jobs */
+    int status ;
+    int done ;
+    struct cholmod_spinv_job_struct *next ;
+} ;
+
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t async_queued = PTHREAD_COND_INITIALIZER ;
+static pthread_cond_t async_finished = PTHREAD_COND_INITIALIZER ;
+static cholmod_spinv_job *async_head = NULL ;
+static cholmod_spinv_job *async_tail = NULL ;
+static int async_limit = 0 ;		/* pool size, 0 if not configured */
+static int async_workers = 0 ;		/* started workers */
+static int async_idle = 0 ;		/* workers waiting for a job */
+
+// Pool size from the environment, async_lock is held
+static void spinv_async_configure (void)
+{
+    const char *s ;
+    long n ;
+
+    if (async_limit > 0)
+        return ;
+    s = getenv ("CHOLMOD_SPINV_ASYNC_THREADS") ;
+    n = (s != NULL) ? atol (s) : sysconf (_SC_NPROCESSORS_ONLN) ;
+    async_limit = (int) MAX (1, MIN (n, 1024)) ;
+}
+
+static void *spinv_async_worker (void *arg)
+{
+    cholmod_spinv_job *job ;
+
+    pthread_mutex_lock (&async_lock) ;
+    for ( ; ; )
+    {
+        // Workers above a reduced pool size exit when idle
+        while (async_head == NULL && async_workers <= async_limit)
+        {
+            async_idle++ ;
+            pthread_cond_wait (&async_queued, &async_lock) ;
+            async_idle-- ;
+        }
+        if (async_head == NULL)
+            break ;
+        job = async_head ;
+        async_head = job->next ;
+        if (async_head == NULL)
+            async_tail = NULL ;
+        job->Common.nthreads_max = job->nthreads ;
+        pthread_mutex_unlock (&async_lock) ;
+
+        job->X = CHOLMOD(spinv)(job->L, &job->Common) ;
+        job->status = job->Common.status ;
+        if (job->callback != NULL)
+            job->callback (job->status, job->data) ;
+
+        pthread_mutex_lock (&async_lock) ;
+        job->done = TRUE ;
+        pthread_cond_broadcast (&async_finished) ;
+    }
+    async_workers-- ;
+    pthread_mutex_unlock (&async_lock) ;
+    return (NULL) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_async_threads ========================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_async_threads)
+(
+    /* ---- input ---- */
+    int nworkers,	/* number of worker threads, at least 1 */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    if (nworkers < 1)
+    {
+        ERROR (CHOLMOD_INVALID, "invalid number of workers") ;
+        return (FALSE) ;
+    }
+
+    pthread_mutex_lock (&async_lock) ;
+    async_limit = nworkers ;
+    pthread_cond_broadcast (&async_queued) ;
+    pthread_mutex_unlock (&async_lock) ;
+    return (TRUE) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_submit ================================================= */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_submit)
+(
+    /* ---- input ---- */
+    cholmod_factor *L,			/* factorization */
+    cholmod_spinv_callback callback,	/* called when done, may be NULL */
+    void *data,				/* passed to callback */
+    /* ---- output --- */
+    cholmod_spinv_job **Job,		/* the job, for poll and wait */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    cholmod_spinv_job *job ;
+    pthread_attr_t attr ;
+    pthread_t thread ;
+    int nthreads, ok ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    RETURN_IF_NULL (L, FALSE) ;
+    RETURN_IF_NULL (Job, FALSE) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, FALSE) ;
+    Common->status = CHOLMOD_OK ;
+    *Job = NULL ;
+
+    job = CHOLMOD(malloc)(1, sizeof(cholmod_spinv_job), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        return (FALSE) ;
+    }
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads () ;
+#else
+    nthreads = 1 ;
+#endif
+    if (Common->nthreads_max > 0)
+        nthreads = MIN (nthreads, Common->nthreads_max) ;
+
+    CHOLMOD(start)(&job->Common) ;
+    job->Common.print = Common->print ;
+    job->L = L ;
+    job->X = NULL ;
+    job->callback = callback ;
+    job->data = data ;
+    job->nthreads = nthreads ;
+    job->status = CHOLMOD_OK ;
+    job->done = FALSE ;
+    job->next = NULL ;
+
+    pthread_mutex_lock (&async_lock) ;
+    spinv_async_configure () ;
+    ok = TRUE ;
+    if (async_idle == 0 && async_workers < async_limit)
+    {
+        // Detached: the workers live as long as the process
+        pthread_attr_init (&attr) ;
+        pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED) ;
+        if (pthread_create (&thread, &attr, spinv_async_worker, NULL) == 0)
+            async_workers++ ;
+        else
+            ok = (async_workers > 0) ;
+        pthread_attr_destroy (&attr) ;
+    }
+    if (ok)
+    {
+        if (async_tail != NULL)
+            async_tail->next = job ;
+        else
+            async_head = job ;
+        async_tail = job ;
+        pthread_cond_signal (&async_queued) ;
+    }
+    pthread_mutex_unlock (&async_lock) ;
+
+    if (!ok)
+    {
+        CHOLMOD(finish)(&job->Common) ;
+        CHOLMOD(free)(1, sizeof(cholmod_spinv_job), job, Common) ;
+        ERROR (CHOLMOD_OUT_OF_MEMORY, "cannot start a worker thread") ;
+        return (FALSE) ;
+    }
+    *Job = job ;
+    return (TRUE) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_poll =================================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_poll)
+(
+    /* ---- input ---- */
+    cholmod_spinv_job *Job,	/* job from cholmod_spinv_submit */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    int done ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    RETURN_IF_NULL (Job, FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    pthread_mutex_lock (&async_lock) ;
+    done = Job->done ;
+    pthread_mutex_unlock (&async_lock) ;
+    return (done) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_wait =================================================== */
+/* ========================================================================== */
+
+cholmod_sparse *CHOLMOD(spinv_wait)
+(
+    /* ---- in/out --- */
+    cholmod_spinv_job **Job,	/* freed and set to NULL */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    cholmod_spinv_job *job ;
+    cholmod_sparse *X ;
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (Job, NULL) ;
+    RETURN_IF_NULL (*Job, NULL) ;
+    Common->status = CHOLMOD_OK ;
+    job = *Job ;
+
+    pthread_mutex_lock (&async_lock) ;
+    while (!job->done)
+        pthread_cond_wait (&async_finished, &async_lock) ;
+    pthread_mutex_unlock (&async_lock) ;
+
+    // The result stays allocated, thus it is counted in Common from now on
+    X = job->X ;
+    CHOLMOD(finish)(&job->Common) ;
+    Common->memory_inuse += job->Common.memory_inuse ;
+    Common->memory_usage = MAX (Common->memory_usage, Common->memory_inuse) ;
+    Common->malloc_count += job->Common.malloc_count ;
+    Common->status = job->status ;
+    CHOLMOD(free)(1, sizeof(cholmod_spinv_job), job, Common) ;
+    *Job = NULL ;
+    return (X) ;
+}
@@ -0,0 +1,394 @@
+/* ========================================================================== */
+/* === cholmod_spinv_cache ================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_cache.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Cache of symbolic plans used by cholmod_spinv.  It is off by default and
+ * turned on by cholmod_spinv_cache_config (budget) or, without changing the
+ * program, by the environment variable CHOLMOD_SPINV_CACHE=budget (in
+ * bytes, read at the first call of cholmod_spinv).  When it is on,
+ * cholmod_spinv hashes the symbolic part of L (Perm and Super, Lpi, Lpx, Ls
+ * or Lp, Li) and, for a pattern seen before, computes the result with the
+ * cached plan (cholmod_spinv_plan_numeric), which skips forming and sorting
+ * the pattern of the result.  For a new pattern, a plan is created and
+ * kept if it fits in the budget.  The least recently used plans are
+ * evicted to stay within the budget.  The size of the plan is known from L
+ * before it is created, and a call whose plan would not fit in the budget
+ * bypasses the cache: creating a plan for one use costs more than the
+ * plain cholmod_spinv.
+ *
+ * A hit is accepted on an equal 64-bit hash and an equal symbolic part,
+ * compared with the copy in the plan (including Ls or Li), so a hash
+ * collision is never taken for a hit.  The cache is shared by all threads
+ * of the process and protected by a mutex; a plan that is evicted while
+ * another thread uses it is freed after the use.  Two threads that miss on
+ * the same pattern both create a plan, but only the first one is kept.
+ * cholmod_* and cholmod_l_* have separate caches.  The memory of a cached
+ * plan is counted in the Common of the call that created it and released in
+ * the Common of the call that frees it.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct spinv_cache_entry
+{
+    uint64_t key ;
+    cholmod_spinv_plan *Plan ;
+    int refs ;			/* calls using the plan */
+    int evicted ;		/* removed from the list, free when unused */
+    struct spinv_cache_entry *prev, *next ;
+} spinv_cache_entry ;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER ;
+static int cache_configured = FALSE ;
+static size_t cache_budget = 0 ;
+static size_t cache_bytes = 0 ;
+static size_t cache_nplans = 0 ;
+static size_t cache_hits = 0 ;
+static size_t cache_misses = 0 ;
+static size_t cache_bypasses = 0 ;
+static size_t cache_evictions = 0 ;
+static spinv_cache_entry *cache_head = NULL ;	/* most recently used */
+static spinv_cache_entry *cache_tail = NULL ;
+
+
+/*
+ * Hash of an array, continued from h
+ */
+static uint64_t spinv_cache_hash
+(
+    uint64_t h,
+    const void *array,
+    size_t bytes
+)
+{
+    const unsigned char *a = array ;
+    uint64_t w ;
+    size_t k ;
+
+    if (array == NULL)
+        return (h) ;
+    for (k = 0; k + 8 <= bytes; k += 8)
+    {
+        memcpy (&w, a + k, 8) ;
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL ;
+        h ^= h >> 29 ;
+    }
+    for ( ; k < bytes; k++)
+        h = (h ^ a[k]) * 0x100000001B3ULL ;
+    return (h) ;
+}
+
+static uint64_t spinv_cache_key
+(
+    cholmod_factor *L
+)
+{
+    uint64_t h ;
+    size_t n, nsuper1 ;
+
+    n = L->n ;
+    h = spinv_cache_hash (0xCBF29CE484222325ULL, &n, sizeof (n)) ;
+    h = spinv_cache_hash (h, L->Perm, n * sizeof (Int)) ;
+    if (L->is_super)
+    {
+        nsuper1 = L->nsuper + 1 ;
+        h = spinv_cache_hash (h, L->super, nsuper1 * sizeof (Int)) ;
+        h = spinv_cache_hash (h, L->pi, nsuper1 * sizeof (Int)) ;
+        h = spinv_cache_hash (h, L->px, nsuper1 * sizeof (Int)) ;
+        h = spinv_cache_hash (h, L->s, L->ssize * sizeof (Int)) ;
+    }
+    else
+    {
+        h = spinv_cache_hash (h, L->p, (n+1) * sizeof (Int)) ;
+        h = spinv_cache_hash (h, L->i, ((Int *) L->p)[n] * sizeof (Int)) ;
+    }
+    return (h) ;
+}
+
+
+static void spinv_cache_unlink
+(
+    spinv_cache_entry *e
+)
+{
+    if (e->prev != NULL)
+        e->prev->next = e->next ;
+    else
+        cache_head = e->next ;
+    if (e->next != NULL)
+        e->next->prev = e->prev ;
+    else
+        cache_tail = e->prev ;
+    e->prev = NULL ;
+    e->next = NULL ;
+}
+
+static void spinv_cache_push_front
+(
+    spinv_cache_entry *e
+)
+{
+    e->prev = NULL ;
+    e->next = cache_head ;
+    if (cache_head != NULL)
+        cache_head->prev = e ;
+    cache_head = e ;
+    if (cache_tail == NULL)
+        cache_tail = e ;
+}
+
+/*
+ * Remove e from the cache, and free it unless a call is using it.  The
+ * lock is held.
+ */
+static void spinv_cache_evict
+(
+    spinv_cache_entry *e,
+    cholmod_common *Common
+)
+{
+    spinv_cache_unlink (e) ;
+    cache_bytes -= e->Plan->size ;
+    cache_nplans-- ;
+    cache_evictions++ ;
+    e->evicted = TRUE ;
+    if (e->refs == 0)
+    {
+        CHOLMOD(spinv_plan_free) (&e->Plan, Common) ;
+        free (e) ;
+    }
+}
+
+/*
+ * Evict the least recently used plans until the cache fits in the budget.
+ * The lock is held.
+ */
+static void spinv_cache_shrink
+(
+    cholmod_common *Common
+)
+{
+    while (cache_tail != NULL && cache_bytes > cache_budget)
+        spinv_cache_evict (cache_tail, Common) ;
+}
+
+static void spinv_cache_configure_from_env (void)
+{
+    const char *s ;
+
+    if (cache_configured)
+        return ;
+    cache_configured = TRUE ;
+    s = getenv ("CHOLMOD_SPINV_CACHE") ;
+    if (s != NULL)
+        cache_budget = strtoull (s, NULL, 10) ;
+}
+
+
+/*
+ * The sparse inverse through the cache.  Sets *cached to FALSE and returns
+ * NULL if the cache is off or the plan of L is larger than the budget,
+ * otherwise returns the result (NULL on failure).
+ */
+cholmod_sparse *CHOLMOD(spinv_cache_numeric)
+(
+    cholmod_factor *L,
+    int *cached,
+    cholmod_common *Common
+)
+{
+    spinv_cache_entry *e, *f ;
+    cholmod_spinv_plan *Plan ;
+    cholmod_sparse *X ;
+    uint64_t key ;
+    size_t size ;
+
+    pthread_mutex_lock (&cache_lock) ;
+    spinv_cache_configure_from_env () ;
+    *cached = (cache_budget > 0) ;
+    pthread_mutex_unlock (&cache_lock) ;
+    if (!*cached)
+        return (NULL) ;
+
+    size = CHOLMOD(spinv_plan_size) (L) ;
+    pthread_mutex_lock (&cache_lock) ;
+    if (size > cache_budget)
+    {
+        cache_bypasses++ ;
+        *cached = FALSE ;
+    }
+    pthread_mutex_unlock (&cache_lock) ;
+    if (!*cached)
+        return (NULL) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* look up the plan */
+    /* ---------------------------------------------------------------------- */
+
+    key = spinv_cache_key (L) ;
+    pthread_mutex_lock (&cache_lock) ;
+    for (e = cache_head; e != NULL; e = e->next)
+        if (e->key == key && CHOLMOD(spinv_plan_matches) (e->Plan, L))
+            break ;
+    if (e != NULL)
+    {
+        cache_hits++ ;
+        e->refs++ ;
+        spinv_cache_unlink (e) ;
+        spinv_cache_push_front (e) ;
+    }
+    else
+    {
+        cache_misses++ ;
+    }
+    pthread_mutex_unlock (&cache_lock) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* new pattern: create the plan and keep it if it fits */
+    /* ---------------------------------------------------------------------- */
+
+    if (e == NULL)
+    {
+        Plan = CHOLMOD(spinv_plan_create) (L, Common) ;
+        if (Plan == NULL)
+            return (NULL) ;
+        e = calloc (1, sizeof (spinv_cache_entry)) ;
+        if (e == NULL)
+        {
+            CHOLMOD(spinv_plan_free) (&Plan, Common) ;
+            ERROR (CHOLMOD_OUT_OF_MEMORY, "out of memory") ;
+            return (NULL) ;
+        }
+        e->key = key ;
+        e->Plan = Plan ;
+        e->refs = 1 ;
+        pthread_mutex_lock (&cache_lock) ;
+
+        // Another thread may have added the plan since the lookup; this
+        // call then uses its own plan and frees it afterwards
+        for (f = cache_head; f != NULL; f = f->next)
+            if (f->key == key && CHOLMOD(spinv_plan_matches) (f->Plan, L))
+                break ;
+        if (f != NULL)
+        {
+            spinv_cache_unlink (f) ;
+            spinv_cache_push_front (f) ;
+            e->evicted = TRUE ;
+        }
+        else if (Plan->size <= cache_budget)
+        {
+            spinv_cache_push_front (e) ;
+            cache_bytes += Plan->size ;
+            cache_nplans++ ;
+            spinv_cache_shrink (Common) ;
+        }
+        else
+        {
+            e->evicted = TRUE ;
+        }
+        pthread_mutex_unlock (&cache_lock) ;
+    }
+
+    X = CHOLMOD(spinv_plan_numeric) (e->Plan, L, Common) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* release the plan */
+    /* ---------------------------------------------------------------------- */
+
+    pthread_mutex_lock (&cache_lock) ;
+    e->refs-- ;
+    if (e->evicted && e->refs == 0)
+    {
+        CHOLMOD(spinv_plan_free) (&e->Plan, Common) ;
+        free (e) ;
+    }
+    pthread_mutex_unlock (&cache_lock) ;
+
+    return (X) ;
+}
+
+
+int CHOLMOD(spinv_cache_config)
+(
+    /* ---- input ---- */
+    size_t budget,	/* bytes of plans to keep, 0 turns the cache off */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    pthread_mutex_lock (&cache_lock) ;
+    cache_configured = TRUE ;
+    cache_budget = budget ;
+    spinv_cache_shrink (Common) ;
+    pthread_mutex_unlock (&cache_lock) ;
+    return (TRUE) ;
+}
+
+
+int CHOLMOD(spinv_cache_stats)
+(
+    /* ---- output --- */
+    size_t *hits,	/* lookups that found a plan, or NULL */
+    size_t *misses,	/* lookups that created a plan, or NULL */
+    size_t *bypasses,	/* calls with a plan over the budget, or NULL */
+    size_t *evictions,	/* plans removed to fit in the budget, or NULL */
+    size_t *nplans,	/* plans in the cache, or NULL */
+    size_t *bytes,	/* their size, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    pthread_mutex_lock (&cache_lock) ;
+    if (hits != NULL)
+        *hits = cache_hits ;
+    if (misses != NULL)
+        *misses = cache_misses ;
+    if (bypasses != NULL)
+        *bypasses = cache_bypasses ;
+    if (evictions != NULL)
+        *evictions = cache_evictions ;
+    if (nplans != NULL)
+        *nplans = cache_nplans ;
+    if (bytes != NULL)
+        *bytes = cache_bytes ;
+    pthread_mutex_unlock (&cache_lock) ;
+    return (TRUE) ;
+}
@@ -0,0 +1,612 @@
+/* ========================================================================== */
+/* === cholmod_spinv_cli ==================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_cli.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * cholmod-spinv: command-line front end of cholmod_spinv.
+ *
+ * Usage: cholmod-spinv [options] input output
+ *
+ *   -ordering o   fill-reducing ordering: default (CHOLMOD's choice),
+ *                 natural, amd, metis, nesdis or spinv (the cheapest for
+ *                 the inverse, see cholmod_spinv_analyze_ordering)
+ *   -mode m       auto (default), simplicial or supernodal factorization
+ *   -diag         write only the diagonal of the inverse
+ *   -pattern f    write the inverse at the pattern of the matrix in file f
+ *   -convert      write the input matrix itself, e.g. to convert a Matrix
+ *                 Market file to the binary format once
+ *   -plan f       use the symbolic plan in file f instead of the ordering
+ *                 and the analysis (see cholmod_spinv_plan.c), or write it
+ *                 there if f does not exist; -ordering and -mode apply
+ *                 only when the plan is written
+ *   -budget b     compute the full inverse out of core with b bytes of
+ *                 memory for it, written directly to the output (see
+ *                 cholmod_spinv_file in cholmod_spinv_ooc.c)
+ *   -q            do not print the timings
+ *
+ * The input and the -pattern file are read in the binary format below if
+ * they begin with its magic bytes and as Matrix Market otherwise.  An
+ * unsymmetric input is used through its upper triangle.  The output is
+ * always binary.  The full inverse is the lower triangle (stype -1) of the
+ * pattern of L+L' in the original order of the rows and columns.  Elements
+ * of a -pattern outside of that pattern are not computed and written as NaN.
+ * The wall time of each phase is printed to stderr.
+ *
+ * The binary format is a compressed sparse column matrix in native byte
+ * order.  All fields are 8 bytes, so the arrays are aligned in the file:
+ *
+ *   char    magic[8]      "CSPINV01"
+ *   int64   nrow, ncol, nnz, stype
+ *   int64   p[ncol+1]     column pointers, p[0] = 0 and p[ncol] = nnz
+ *   int64   i[nnz]        row indices, increasing within each column
+ *   double  x[nnz]        values
+ *
+ * A binary file is mapped with mmap and used by CHOLMOD in place (through
+ * the cholmod_l_* routines, which use int64 indices), so reading it costs
+ * only the validation pass over p and i.
+ * -------------------------------------------------------------------------- */
+
+
+#include "cholmod_extra.h"
+#include <cholmod.h>
+#include <math.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAGIC "CSPINV01"
+
+typedef struct
+{
+    char magic[8] ;
+    int64_t nrow, ncol, nnz, stype ;
+} binary_header ;
+
+/*
+ * Matrix read from a file.  A points either to the mapped file (map is not
+ * NULL) or to a matrix allocated by CHOLMOD.
+ */
+typedef struct
+{
+    cholmod_sparse *A ;
+    cholmod_sparse mapped ;
+    void *map ;
+    size_t size ;
+} matrix_file ;
+
+static int quiet = 0 ;
+
+double wall_time(void)
+{
+    struct timespec t ;
+    clock_gettime(CLOCK_MONOTONIC, &t) ;
+    return t.tv_sec + 1e-9*t.tv_nsec ;
+}
+
+void report(const char *phase, double t0)
+{
+    if (!quiet)
+        fprintf(stderr, "%-10s %12.6f s\n", phase, wall_time() - t0) ;
+}
+
+int is_binary(const char *name)
+{
+    char magic[8] ;
+    FILE *f ;
+    int ok ;
+
+    f = fopen(name, "rb") ;
+    if (f == NULL)
+        return 0 ;
+    ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, MAGIC, 8) == 0 ;
+    fclose(f) ;
+    return ok ;
+}
+
+/*
+ * Map a binary file and check that it is a valid sparse matrix
+ */
+int read_binary(const char *name, matrix_file *M)
+{
+    int fd ;
+    struct stat st ;
+    binary_header *h ;
+    int64_t *p, *i, j, k ;
+    uint64_t avail ;
+
+    fd = open(name, O_RDONLY) ;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "%s: cannot open\n", name) ;
+        if (fd >= 0)
+            close(fd) ;
+        return 0 ;
+    }
+    if ((uint64_t) st.st_size < sizeof(binary_header))
+    {
+        fprintf(stderr, "%s: invalid or truncated binary matrix\n", name) ;
+        close(fd) ;
+        return 0 ;
+    }
+    M->size = st.st_size ;
+    M->map = mmap(NULL, M->size, PROT_READ, MAP_PRIVATE, fd, 0) ;
+    close(fd) ;
+    if (M->map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: cannot map\n", name) ;
+        M->map = NULL ;
+        return 0 ;
+    }
+    madvise(M->map, M->size, MADV_WILLNEED) ;
+
+    // Number of 8-byte words after the header; p, i and x must fit in it,
+    // checked so that no sum can overflow
+    h = M->map ;
+    avail = (M->size - sizeof(binary_header)) / 8 ;
+    if (h->nrow < 0 || h->ncol < 0 || h->nnz < 0
+        || h->stype < -1 || h->stype > 1
+        || (uint64_t) h->ncol >= avail
+        || (uint64_t) h->nnz > (avail - (uint64_t) h->ncol - 1) / 2)
+    {
+        fprintf(stderr, "%s: invalid or truncated binary matrix\n", name) ;
+        return 0 ;
+    }
+
+    p = (int64_t *) (h + 1) ;
+    i = p + h->ncol + 1 ;
+    if (p[0] != 0 || p[h->ncol] != h->nnz)
+    {
+        fprintf(stderr, "%s: invalid column pointers\n", name) ;
+        return 0 ;
+    }
+    for (j = 0; j < h->ncol; j++)
+    {
+        if (p[j] > p[j+1])
+        {
+            fprintf(stderr, "%s: invalid column pointers\n", name) ;
+            return 0 ;
+        }
+        for (k = p[j]; k < p[j+1]; k++)
+        {
+            if (i[k] < 0 || i[k] >= h->nrow || (k > p[j] && i[k] <= i[k-1]))
+            {
+                fprintf(stderr, "%s: invalid row indices in column %ld\n",
+                        name, (long) j) ;
+                return 0 ;
+            }
+        }
+    }
+
+    memset(&M->mapped, 0, sizeof(cholmod_sparse)) ;
+    M->mapped.nrow = h->nrow ;
+    M->mapped.ncol = h->ncol ;
+    M->mapped.nzmax = h->nnz ;
+    M->mapped.p = p ;
+    M->mapped.i = i ;
+    M->mapped.x = i + h->nnz ;
+    M->mapped.stype = h->stype ;
+    M->mapped.itype = CHOLMOD_LONG ;
+    M->mapped.xtype = CHOLMOD_REAL ;
+    M->mapped.dtype = CHOLMOD_DOUBLE ;
+    M->mapped.sorted = 1 ;
+    M->mapped.packed = 1 ;
+    M->A = &M->mapped ;
+    return 1 ;
+}
+
+/*
+ * Read a binary or Matrix Market file
+ */
+int read_matrix(const char *name, matrix_file *M, cholmod_common *Common)
+{
+    FILE *f ;
+
+    M->A = NULL ;
+    M->map = NULL ;
+    if (is_binary(name))
+        return read_binary(name, M) ;
+
+    f = fopen(name, "r") ;
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", name) ;
+        return 0 ;
+    }
+    M->A = cholmod_l_read_sparse(f, Common) ;
+    fclose(f) ;
+    if (M->A == NULL || M->A->xtype == CHOLMOD_COMPLEX
+        || M->A->xtype == CHOLMOD_ZOMPLEX)
+    {
+        fprintf(stderr, "%s: not a real sparse matrix\n", name) ;
+        return 0 ;
+    }
+    return 1 ;
+}
+
+void free_matrix(matrix_file *M, cholmod_common *Common)
+{
+    if (M->map != NULL)
+        munmap(M->map, M->size) ;
+    else
+        cholmod_l_free_sparse(&M->A, Common) ;
+    M->A = NULL ;
+    M->map = NULL ;
+}
+
+/*
+ * Write a packed sparse matrix with sorted columns in the binary format.
+ * The values of a pattern matrix are written as ones.
+ */
+int write_binary(const char *name, cholmod_sparse *A)
+{
+    FILE *f ;
+    binary_header h ;
+    int64_t *Ap, k ;
+    double one = 1.0 ;
+    int ok ;
+
+    Ap = A->p ;
+    memcpy(h.magic, MAGIC, 8) ;
+    h.nrow = A->nrow ;
+    h.ncol = A->ncol ;
+    h.nnz = Ap[A->ncol] ;
+    h.stype = A->stype ;
+
+    f = fopen(name, "wb") ;
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: cannot open for writing\n", name) ;
+        return 0 ;
+    }
+    ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(Ap, 8, h.ncol+1, f) == (size_t) h.ncol+1
+        && fwrite(A->i, 8, h.nnz, f) == (size_t) h.nnz ;
+    if (A->x != NULL)
+        ok = ok && fwrite(A->x, 8, h.nnz, f) == (size_t) h.nnz ;
+    else
+        for (k = 0; ok && k < h.nnz; k++)
+            ok = fwrite(&one, 8, 1, f) == 1 ;
+    ok = (fclose(f) == 0) && ok ;
+    if (!ok)
+        fprintf(stderr, "%s: write failed\n", name) ;
+    return ok ;
+}
+
+/*
+ * Element (i,j) of the sparse inverse X (lower triangle, sorted columns),
+ * or NaN if it is not in the pattern of X
+ */
+double lookup(cholmod_sparse *X, int64_t i, int64_t j)
+{
+    int64_t *Xp = X->p ;
+    int64_t *Xi = X->i ;
+    double *Xx = X->x ;
+    int64_t lo, hi, mid, t ;
+
+    if (i < j)
+    {
+        t = i ;
+        i = j ;
+        j = t ;
+    }
+    lo = Xp[j] ;
+    hi = Xp[j+1] - 1 ;
+    while (lo <= hi)
+    {
+        mid = lo + (hi - lo) / 2 ;
+        if (Xi[mid] == i)
+            return Xx[mid] ;
+        if (Xi[mid] < i)
+            lo = mid + 1 ;
+        else
+            hi = mid - 1 ;
+    }
+    return NAN ;
+}
+
+/*
+ * The elements of X at the pattern of P (or at the diagonal if P is NULL)
+ */
+cholmod_sparse *extract(cholmod_sparse *X, cholmod_sparse *P,
+                        cholmod_common *Common)
+{
+    cholmod_sparse *R ;
+    int64_t *Rp, *Ri, *Pp, j, k, n, nz, missing ;
+    double *Rx ;
+
+    n = X->ncol ;
+    nz = (P == NULL) ? n : ((int64_t *) P->p)[P->ncol] ;
+    R = cholmod_l_allocate_sparse(n, n, nz, 1, 1, P ? P->stype : 0,
+                                  CHOLMOD_REAL, Common) ;
+    if (R == NULL)
+        return NULL ;
+    Rp = R->p ;
+    Ri = R->i ;
+    Rx = R->x ;
+    if (P == NULL)
+    {
+        for (j = 0; j < n; j++)
+        {
+            Rp[j] = j ;
+            Ri[j] = j ;
+        }
+        Rp[n] = n ;
+    }
+    else
+    {
+        Pp = P->p ;
+        memcpy(Rp, Pp, (n+1) * sizeof(int64_t)) ;
+        memcpy(Ri, P->i, nz * sizeof(int64_t)) ;
+    }
+
+    missing = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        for (k = Rp[j]; k < Rp[j+1]; k++)
+        {
+            Rx[k] = lookup(X, Ri[k], j) ;
+            missing += isnan(Rx[k]) ;
+        }
+    }
+    if (missing > 0)
+        fprintf(stderr, "warning: %ld elements of the pattern are not in "
+                "the pattern of the inverse\n", (long) missing) ;
+    return R ;
+}
+
+void usage(void)
+{
+    fprintf(stderr,
+            "usage: cholmod-spinv [-ordering default|natural|amd|metis|nesdis|"
+            "spinv]\n"
+            "                     [-mode auto|simplicial|supernodal]\n"
+            "                     [-diag | -pattern file | -convert]\n"
+            "                     [-plan file] [-budget bytes] [-q]\n"
+            "                     input output\n") ;
+}
+
+int main(int argc, char **argv)
+{
+    int a, ok, supernodal, order ;
+    const char *ordering = "default" ;
+    const char *mode = "auto" ;
+    const char *pattern = NULL ;
+    const char *planfile = NULL ;
+    const char *input = NULL ;
+    const char *output = NULL ;
+    int diag = 0 ;
+    int convert = 0 ;
+    const char *budget = NULL ;
+    double t0 ;
+    matrix_file M, P ;
+    cholmod_factor *L = NULL ;
+    cholmod_sparse *X = NULL ;
+    cholmod_sparse *R = NULL ;
+    cholmod_spinv_plan *Plan = NULL ;
+    cholmod_common Common ;
+
+    for (a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-ordering") == 0 && a+1 < argc)
+            ordering = argv[++a] ;
+        else if (strcmp(argv[a], "-mode") == 0 && a+1 < argc)
+            mode = argv[++a] ;
+        else if (strcmp(argv[a], "-pattern") == 0 && a+1 < argc)
+            pattern = argv[++a] ;
+        else if (strcmp(argv[a], "-plan") == 0 && a+1 < argc)
+            planfile = argv[++a] ;
+        else if (strcmp(argv[a], "-budget") == 0 && a+1 < argc)
+            budget = argv[++a] ;
+        else if (strcmp(argv[a], "-diag") == 0)
+            diag = 1 ;
+        else if (strcmp(argv[a], "-convert") == 0)
+            convert = 1 ;
+        else if (strcmp(argv[a], "-q") == 0)
+            quiet = 1 ;
+        else if (argv[a][0] != '-' && input == NULL)
+            input = argv[a] ;
+        else if (argv[a][0] != '-' && output == NULL)
+            output = argv[a] ;
+        else
+        {
+            usage() ;
+            return EXIT_FAILURE ;
+        }
+    }
+
+    if (strcmp(mode, "simplicial") == 0)
+        supernodal = CHOLMOD_SIMPLICIAL ;
+    else if (strcmp(mode, "supernodal") == 0)
+        supernodal = CHOLMOD_SUPERNODAL ;
+    else if (strcmp(mode, "auto") == 0)
+        supernodal = CHOLMOD_AUTO ;
+    else
+        supernodal = -1 ;
+
+    if (strcmp(ordering, "default") == 0)
+        order = -1 ;
+    else if (strcmp(ordering, "natural") == 0)
+        order = CHOLMOD_NATURAL ;
+    else if (strcmp(ordering, "amd") == 0)
+        order = CHOLMOD_AMD ;
+    else if (strcmp(ordering, "metis") == 0)
+        order = CHOLMOD_METIS ;
+    else if (strcmp(ordering, "nesdis") == 0)
+        order = CHOLMOD_NESDIS ;
+    else if (strcmp(ordering, "spinv") == 0)
+        order = -1 ;
+    else
+        order = -2 ;
+
+    if (output == NULL || diag + convert + (pattern != NULL) > 1
+        || (budget != NULL && diag + convert + (pattern != NULL) > 0)
+        || supernodal < 0 || order < -1)
+    {
+        usage() ;
+        return EXIT_FAILURE ;
+    }
+
+    cholmod_l_start(&Common) ;
+    Common.supernodal = supernodal ;
+    if (order >= 0)
+    {
+        Common.nmethods = 1 ;
+        Common.method[0].ordering = order ;
+    }
+
+    /* READ */
+
+    P.A = NULL ;
+    P.map = NULL ;
+    t0 = wall_time() ;
+    ok = read_matrix(input, &M, &Common) ;
+    if (ok && pattern != NULL)
+        ok = read_matrix(pattern, &P, &Common) ;
+    report("read", t0) ;
+    if (ok && !convert && M.A->nrow != M.A->ncol)
+    {
+        fprintf(stderr, "%s: not a square matrix\n", input) ;
+        ok = 0 ;
+    }
+    if (ok && P.A != NULL
+        && (P.A->nrow != M.A->nrow || P.A->ncol != M.A->ncol))
+    {
+        fprintf(stderr, "%s: dimensions differ from %s\n", pattern, input) ;
+        ok = 0 ;
+    }
+
+    if (ok && convert)
+    {
+        t0 = wall_time() ;
+        ok = write_binary(output, M.A) ;
+        report("write", t0) ;
+        goto cleanup ;
+    }
+    if (!ok)
+        goto cleanup ;
+    if (M.A->stype == 0)
+        M.A->stype = 1 ;
+
+    /* FACTORIZE */
+
+    if (planfile != NULL && access(planfile, R_OK) == 0)
+    {
+        t0 = wall_time() ;
+        Plan = cholmod_l_spinv_plan_load(planfile, &Common) ;
+        L = cholmod_l_spinv_plan_factor(Plan, &Common) ;
+        report("plan", t0) ;
+    }
+    else
+    {
+        t0 = wall_time() ;
+        if (strcmp(ordering, "spinv") == 0)
+            L = cholmod_l_spinv_analyze_ordering(M.A, &Common) ;
+        else
+            L = cholmod_l_analyze(M.A, &Common) ;
+        report("analyze", t0) ;
+    }
+    t0 = wall_time() ;
+    ok = L != NULL && cholmod_l_factorize(M.A, L, &Common)
+        && Common.status == CHOLMOD_OK ;
+    report("factorize", t0) ;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: factorization failed (status %d)\n", input,
+                Common.status) ;
+        goto cleanup ;
+    }
+
+    if (planfile != NULL && Plan == NULL)
+    {
+        t0 = wall_time() ;
+        Plan = cholmod_l_spinv_plan_create(L, &Common) ;
+        ok = Plan != NULL
+            && cholmod_l_spinv_plan_save(Plan, planfile, &Common) ;
+        report("save plan", t0) ;
+        if (!ok)
+            goto cleanup ;
+    }
+
+    /* SPARSE INVERSE */
+
+    if (budget != NULL)
+    {
+        t0 = wall_time() ;
+        ok = cholmod_l_spinv_file(L, output, strtoull(budget, NULL, 10),
+                                  &Common) ;
+        report("spinv file", t0) ;
+        goto cleanup ;
+    }
+
+    t0 = wall_time() ;
+    if (Plan != NULL)
+        X = cholmod_l_spinv_plan_numeric(Plan, L, &Common) ;
+    else
+        X = cholmod_l_spinv(L, &Common) ;
+    report("spinv", t0) ;
+    ok = X != NULL ;
+    if (!ok)
+        goto cleanup ;
+    cholmod_l_free_factor(&L, &Common) ;
+
+    if (diag || pattern != NULL)
+    {
+        t0 = wall_time() ;
+        R = extract(X, P.A, &Common) ;
+        report("extract", t0) ;
+        ok = R != NULL ;
+        if (!ok)
+            goto cleanup ;
+        cholmod_l_free_sparse(&X, &Common) ;
+        X = R ;
+    }
+
+    /* WRITE */
+
+    t0 = wall_time() ;
+    ok = write_binary(output, X) ;
+    report("write", t0) ;
+
+cleanup:
+
+    cholmod_l_free_sparse(&X, &Common) ;
+    cholmod_l_free_factor(&L, &Common) ;
+    cholmod_l_spinv_plan_free(&Plan, &Common) ;
+    free_matrix(&P, &Common) ;
+    free_matrix(&M, &Common) ;
+    cholmod_l_finish(&Common) ;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE ;
+}
@@ -0,0 +1,336 @@
+/* ========================================================================== */
+/* === cholmod_spinv_complex ================================================ */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_complex.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Sparse inverse of a complex Hermitian matrix, called by
+ * cholmod_spinv_numeric for complex and zomplex factors.  The recursion is
+ * the same as for real matrices with the transposes replaced by conjugate
+ * transposes:
+ *
+ *   supernodal LL':      zhemm, zgemm and ztrsm in the block kernel,
+ *   simplicial LDL':     zhemv and zdotc (D is real).
+ *
+ * The inverse is computed in the layout of L->x (interleaved complex), thus
+ * the elements that the permutation moves to the upper triangle are
+ * conjugated only once, when the result is formed by cholmod_spinv.  The
+ * result is always CHOLMOD_COMPLEX (interleaved), Hermitian with the lower
+ * triangle stored.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+/*
+ * Complex version of cholmod_spinv_block.  All matrices are interleaved
+ * complex, V is Hermitian with the lower triangle stored.
+ */
+static void spinv_complex_block
+(
+    double *L,
+    double *Z,
+    double *V,
+    Int m,
+    Int n
+)
+{
+    double *L1, *L2, *Z1, *Z2 ;
+    double one[2] = {1.0, 0.0}, minus_one[2] = {-1.0, 0.0},
+        zero[2] = {0.0, 0.0} ;
+    Int i, j ;
+
+    Int m1 = n ;      // rows of Z1/L1
+    Int m2 = m - m1 ; // rows of Z2/L2
+    Int ld = m ;      // leading dimension of Z1/Z2/L1/L2
+
+    Z1 = Z ;
+    Z2 = Z + 2*m1 ;
+    L1 = L ;
+    L2 = L + 2*m1 ;
+
+    for (i = 0; i < m1; i++)
+    {
+        for (j = 0; j < m1; j++)
+        {
+            Z1[2*(i+j*ld)] = ((i == j) ? 1.0 : 0.0) ;
+            Z1[2*(i+j*ld)+1] = 0.0 ;
+        }
+    }
+
+    if (m2 > 0)
+    {
+        // Z2 = - V * L2
+        cblas_zhemm (CblasColMajor, CblasLeft, CblasLower, (BLAS_INT) m2,
+                     (BLAS_INT) n, minus_one, V, (BLAS_INT) m2, L2,
+                     (BLAS_INT) ld, zero, Z2, (BLAS_INT) ld) ;
+
+        // Z1 = -Z2^H*L2 + Z1 = L2^H*V*L2 + I
+        cblas_zgemm (CblasColMajor, CblasConjTrans, CblasNoTrans,
+                     (BLAS_INT) m1, (BLAS_INT) m1, (BLAS_INT) m2, minus_one,
+                     Z2, (BLAS_INT) ld, L2, (BLAS_INT) ld, one, Z1,
+                     (BLAS_INT) ld) ;
+    }
+
+    // Z1 = L1^H \ Z1
+    cblas_ztrsm (CblasColMajor, CblasLeft, CblasLower, CblasConjTrans,
+                 CblasNonUnit, (BLAS_INT) m1, (BLAS_INT) m1, one, L1,
+                 (BLAS_INT) ld, Z1, (BLAS_INT) ld) ;
+
+    // Z = Z / L1
+    cblas_ztrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                 CblasNonUnit, (BLAS_INT) m, (BLAS_INT) n, one, L1,
+                 (BLAS_INT) ld, Z, (BLAS_INT) ld) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_complex_super ========================================== */
+/* ========================================================================== */
+
+static void spinv_complex_super
+(
+    cholmod_factor *L,
+    double *Lx,
+    double *Xc,
+    double *V,
+    double *Z,
+    Int *map
+)
+{
+    Int *Super, *Lpi, *Lpx ;
+    Int s, i, j, kl, kv, ms, ns, m1, m2 ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+
+    for (s = L->nsuper - 1; s >= 0; s--)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        m1 = ns ;
+        m2 = ms - ns ;
+
+        /*
+         * Collect V (Hermitian in lower triangular form)
+         */
+        if (m2 > 0)
+        {
+            CHOLMOD(spinv_super_map) (L, s, map) ;
+            for (j = 0; j < m2; j++)
+            {
+                for (i = j; i < m2; i++)
+                {
+                    kv = i + j*m2 ;
+                    V[2*kv] = Xc[2*map[kv]] ;
+                    V[2*kv+1] = Xc[2*map[kv]+1] ;
+                }
+            }
+        }
+
+        spinv_complex_block (Lx + 2*Lpx[s], Z, V, ms, ns) ;
+
+        /*
+         * Store the result, the diagonal block is made exactly Hermitian
+         */
+        for (j = 0; j < ns; j++)
+        {
+            for (i = j; i < ms; i++)
+            {
+                kl = Lpx[s] + i + j*ms ;
+                if (i < m1)
+                {
+                    Xc[2*kl] = 0.5*(Z[2*(i+j*ms)] + Z[2*(j+i*ms)]) ;
+                    Xc[2*kl+1] = 0.5*(Z[2*(i+j*ms)+1] - Z[2*(j+i*ms)+1]) ;
+                }
+                else
+                {
+                    Xc[2*kl] = Z[2*(i+j*ms)] ;
+                    Xc[2*kl+1] = Z[2*(i+j*ms)+1] ;
+                }
+            }
+        }
+    }
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_complex_simplicial ===================================== */
+/* ========================================================================== */
+
+static void spinv_complex_simplicial
+(
+    cholmod_factor *L,
+    double *Lx,
+    double *Xc,
+    double *V,
+    double *z,
+    Int *map
+)
+{
+    Int *Lp ;
+    double one[2] = {1.0, 0.0}, zero[2] = {0.0, 0.0}, dot[2] ;
+    Int jl, iz, jz, kv, kmin, nj ;
+
+    Lp = L->p ;
+
+    for (jl = L->n - 1; jl >= 0; jl--)
+    {
+        kmin = Lp[jl] ;
+        nj = Lp[jl+1] - 1 - kmin ;
+
+        // The diagonal D[j,j] is real
+        Xc[2*kmin] = 1.0/Lx[2*kmin] ;
+        Xc[2*kmin+1] = 0.0 ;
+
+        if (nj > 0)
+        {
+            CHOLMOD(spinv_simplicial_map) (L, jl, map) ;
+            for (jz = 0; jz < nj; jz++)
+            {
+                for (iz = jz; iz < nj; iz++)
+                {
+                    kv = iz + jz*nj ;
+                    V[2*kv] = Xc[2*map[kv]] ;
+                    V[2*kv+1] = Xc[2*map[kv]+1] ;
+                }
+            }
+
+            // z = V * l
+            cblas_zhemv (CblasColMajor, CblasLower, (BLAS_INT) nj, one, V,
+                         (BLAS_INT) nj, Lx + 2*(kmin+1), 1, zero, z, 1) ;
+
+            // X[j,j] = 1/D[j,j] + z^H*l
+            cblas_zdotc_sub ((BLAS_INT) nj, z, 1, Lx + 2*(kmin+1), 1, dot) ;
+            Xc[2*kmin] += dot[0] ;
+
+            for (iz = 0; iz < nj; iz++)
+            {
+                Xc[2*(kmin+1+iz)] = -z[2*iz] ;
+                Xc[2*(kmin+1+iz)+1] = -z[2*iz+1] ;
+            }
+        }
+    }
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_complex_numeric ======================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_complex_numeric)
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* complex or zomplex factorization to use */
+    /* ---- output --- */
+    double *Xc,		/* inverse in the layout of L->x, interleaved */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    double *Lx, *Lc, *V, *Z ;
+    Int *Lpx, *Lp, *map ;
+    Int n, s, jl ;
+    size_t k, lsize, vsize, zsize, maxsize ;
+
+    if (!L->is_super && L->is_ll)
+    {
+        ERROR (CHOLMOD_INVALID, "Complex xtype for L*L' not implemented.") ;
+        return (FALSE) ;
+    }
+
+    n = L->n ;
+    lsize = CHOLMOD(spinv_layout_size) (L) ;
+
+    /*
+     * Workspace sizes, see cholmod_spinv_numeric
+     */
+    maxsize = 0 ;
+    if (L->is_super)
+    {
+        Lpx = L->px ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            if (Lpx[s+1] - Lpx[s] > maxsize)
+                maxsize = Lpx[s+1] - Lpx[s] ;
+        }
+        vsize = MAX (L->maxesize*L->maxesize, 1) ;
+        zsize = MAX (maxsize, 1) ;
+    }
+    else
+    {
+        Lp = L->p ;
+        for (jl = 0; jl < n; jl++)
+        {
+            if (Lp[jl+1] - Lp[jl] - 1 > maxsize)
+                maxsize = Lp[jl+1] - Lp[jl] - 1 ;
+        }
+        vsize = MAX (maxsize*maxsize, 1) ;
+        zsize = maxsize + 1 ;
+    }
+
+    Lc = NULL ;
+    V = CHOLMOD(malloc)(2*vsize, sizeof(double), Common) ;
+    Z = CHOLMOD(malloc)(2*zsize, sizeof(double), Common) ;
+    map = CHOLMOD(malloc)(vsize, sizeof(Int), Common) ;
+
+    // The kernels need interleaved values
+    if (L->xtype == CHOLMOD_ZOMPLEX)
+    {
+        Lc = CHOLMOD(malloc)(2*lsize, sizeof(double), Common) ;
+        if (Common->status < CHOLMOD_OK)
+            goto cleanup ;
+        for (k = 0; k < lsize; k++)
+        {
+            Lc[2*k] = ((double *) L->x)[k] ;
+            Lc[2*k+1] = ((double *) L->z)[k] ;
+        }
+        Lx = Lc ;
+    }
+    else
+    {
+        Lx = L->x ;
+    }
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    if (L->is_super)
+        spinv_complex_super (L, Lx, Xc, V, Z, map) ;
+    else
+        spinv_complex_simplicial (L, Lx, Xc, V, Z, map) ;
+
+cleanup:
+    CHOLMOD(free)(2*lsize, sizeof(double), Lc, Common) ;
+    CHOLMOD(free)(vsize, sizeof(Int), map, Common) ;
+    CHOLMOD(free)(2*zsize, sizeof(double), Z, Common) ;
+    CHOLMOD(free)(2*vsize, sizeof(double), V, Common) ;
+
+    return (Common->status >= CHOLMOD_OK) ;
+}
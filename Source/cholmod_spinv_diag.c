@@ -0,0 +1,417 @@
+/* ========================================================================== */
+/* === cholmod_spinv_diag =================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_diag.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Estimate the diagonal of inv(A) without the sparse inverse, for problems
+ * where the fill of the root supernodes makes cholmod_spinv too expensive.
+ * Only solves with the existing factorization L are needed.
+ *
+ * The nodes are coloured so that nodes within the given distance of each
+ * other in the graph of A get different colours.  The graph is the pattern
+ * of A+A', so A may also be stored unsymmetric (stype 0).  For each colour
+ * c, the probes z are random +-1 vectors on the nodes of colour c (zero
+ * elsewhere) and, for a node i of colour c,
+ *
+ *   z[i] * (inv(A)*z)[i] = inv(A)[i,i] + sum_j z[i]*z[j]*inv(A)[i,j],
+ *
+ * where the sum is over the other nodes j of colour c.  The estimate is the
+ * mean over nsamples probes.  It is unbiased, and because the elements of
+ * the inverse usually decay with the distance in the graph, the error is
+ * small if the distance is large enough.  With distance 0, all nodes have
+ * the same colour and the estimate is Hutchinson's estimator with Rademacher
+ * probes.  The standard errors of the estimates are computed from the
+ * sample variances, thus they need nsamples >= 2.
+ *
+ * The cost is ncolours*nsamples solves, done in blocks of at most
+ * SPINV_DIAG_BLOCK right-hand sides, so the distance and nsamples trade
+ * cost for accuracy.  If two nodes of the same colour have no path between
+ * them in the graph of A, their element of the inverse is zero, thus the
+ * result is exact if distance >= n-1.  The random numbers are generated
+ * from a fixed seed, so the result is reproducible.
+ *
+ * The result is returned as a symmetric (stype -1) sparse matrix that
+ * contains only the diagonal, that is, the same layout as the diagonal of
+ * the result of cholmod_spinv.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+#include <math.h>
+
+// Number of right-hand sides in one call to cholmod_solve
+#define SPINV_DIAG_BLOCK 16
+
+/*
+ * Random signs: xorshift64*, one bit per probe element.
+ */
+static double spinv_diag_sign (unsigned long long *state)
+{
+    *state ^= *state >> 12 ;
+    *state ^= *state << 25 ;
+    *state ^= *state >> 27 ;
+    return ((*state * 2685821657736338717ULL) >> 63) ? 1.0 : -1.0 ;
+}
+
+/*
+ * Graph of A: the pattern of A+A' without the diagonal, from the stored
+ * triangle if A is symmetric (stype != 0) and from all of A otherwise, so
+ * that an unsymmetric pattern gives an undirected graph.  A column may list
+ * a neighbour twice, which the colouring skips.
+ */
+static cholmod_sparse *spinv_diag_graph
+(
+    cholmod_sparse *A,
+    cholmod_common *Common
+)
+{
+    cholmod_sparse *G ;
+    Int *Ap, *Ai, *Anz, *Gp, *Gi, *W ;
+    Int n, i, j, k, pend, nz ;
+
+    n = A->ncol ;
+    Ap = A->p ;
+    Ai = A->i ;
+    Anz = A->nz ;
+
+    W = CHOLMOD(calloc)(n, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (NULL) ;
+    nz = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        pend = (A->packed) ? Ap[j+1] : Ap[j] + Anz[j] ;
+        for (k = Ap[j]; k < pend; k++)
+        {
+            i = Ai[k] ;
+            if (i == j || (A->stype > 0 && i > j) || (A->stype < 0 && i < j))
+                continue ;
+            W[i]++ ;
+            W[j]++ ;
+            nz += 2 ;
+        }
+    }
+
+    G = CHOLMOD(allocate_sparse) (n, n, nz, FALSE, TRUE, 0, CHOLMOD_PATTERN,
+                                  Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free)(n, sizeof(Int), W, Common) ;
+        return (NULL) ;
+    }
+    Gp = G->p ;
+    Gi = G->i ;
+    Gp[0] = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        Gp[j+1] = Gp[j] + W[j] ;
+        W[j] = Gp[j] ;
+    }
+    for (j = 0; j < n; j++)
+    {
+        pend = (A->packed) ? Ap[j+1] : Ap[j] + Anz[j] ;
+        for (k = Ap[j]; k < pend; k++)
+        {
+            i = Ai[k] ;
+            if (i == j || (A->stype > 0 && i > j) || (A->stype < 0 && i < j))
+                continue ;
+            Gi[W[j]++] = i ;
+            Gi[W[i]++] = j ;
+        }
+    }
+    CHOLMOD(free)(n, sizeof(Int), W, Common) ;
+    return (G) ;
+}
+
+/*
+ * Greedy distance-k colouring (k >= 1) of the graph G from
+ * spinv_diag_graph, in the natural order.  Returns the number of colours.
+ */
+static Int spinv_diag_colour
+(
+    cholmod_sparse *G,
+    Int distance,
+    Int *Colour,
+    Int *Mark,		// size n, last node that saw the colour
+    Int *Visited,	// size n
+    Int *Queue,		// size n
+    Int *Depth		// size n
+)
+{
+    Int *Gp, *Gi ;
+    Int n, v, u, w, k, head, tail, c, ncolours ;
+
+    n = G->ncol ;
+    Gp = G->p ;
+    Gi = G->i ;
+
+    for (v = 0; v < n; v++)
+    {
+        Colour[v] = -1 ;
+        Mark[v] = -1 ;
+        Visited[v] = -1 ;
+    }
+
+    ncolours = 0 ;
+    for (v = 0; v < n; v++)
+    {
+        // Mark the colours of the nodes within the distance
+        head = 0 ;
+        tail = 0 ;
+        Queue[tail++] = v ;
+        Depth[v] = 0 ;
+        Visited[v] = v ;
+        while (head < tail)
+        {
+            u = Queue[head++] ;
+            if (Colour[u] >= 0)
+                Mark[Colour[u]] = v ;
+            if (Depth[u] == distance)
+                continue ;
+            for (k = Gp[u]; k < Gp[u+1]; k++)
+            {
+                w = Gi[k] ;
+                if (Visited[w] != v)
+                {
+                    Visited[w] = v ;
+                    Depth[w] = Depth[u] + 1 ;
+                    Queue[tail++] = w ;
+                }
+            }
+        }
+
+        // Smallest colour not used within the distance
+        for (c = 0; c < ncolours && Mark[c] == v; c++) ;
+        Colour[v] = c ;
+        ncolours = MAX (ncolours, c+1) ;
+    }
+
+    return (ncolours) ;
+}
+
+cholmod_sparse *CHOLMOD(spinv_diag)   /* returns the estimated diagonal */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse *A,	/* matrix whose graph is coloured, or NULL */
+    int distance,	/* colouring distance, 0 for plain Hutchinson */
+    size_t nsamples,	/* number of random probes for each colour */
+    /* ---- output --- */
+    cholmod_dense **E,	/* standard errors of the estimates, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *X, *G ;
+    cholmod_dense *B, *Y ;
+    double *Bx, *Yx, *Xx, *Ex, *Sum, *Sumsq ;
+    double z, m, var ;
+    Int *Xp, *Xi, *Colour, *Cp, *Ci, *Iwork ;
+    Int n, i, j, k, c, r, r0, r1, ncolours, nrhs, nb ;
+    unsigned long long state ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    n = L->n ;
+    if (L->xtype != CHOLMOD_REAL)
+    {
+        ERROR (CHOLMOD_INVALID, "Complex xtype not implemented.") ;
+        return (NULL) ;
+    }
+    if (distance > 0)
+    {
+        RETURN_IF_NULL (A, NULL) ;
+        if (A->nrow != n || A->ncol != n)
+        {
+            ERROR (CHOLMOD_INVALID, "dimensions do not match") ;
+            return (NULL) ;
+        }
+    }
+    if (nsamples < 1 || (E != NULL && nsamples < 2))
+    {
+        ERROR (CHOLMOD_INVALID, "too few samples") ;
+        return (NULL) ;
+    }
+    if (E != NULL)
+        *E = NULL ;
+
+    X = NULL ;
+    G = NULL ;
+    B = NULL ;
+    Y = NULL ;
+    Sum = NULL ;
+    Sumsq = NULL ;
+    Colour = NULL ;
+    Cp = NULL ;
+    Ci = NULL ;
+    Iwork = NULL ;
+    nb = 0 ;
+
+    Colour = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Cp = CHOLMOD(calloc)(n+1, sizeof(Int), Common) ;
+    Ci = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Sum = CHOLMOD(calloc)(n, sizeof(double), Common) ;
+    Sumsq = CHOLMOD(calloc)(n, sizeof(double), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    /*
+     * Colour the graph of A and bucket the nodes by colour
+     */
+    if (distance > 0)
+    {
+        Iwork = CHOLMOD(malloc)(4*n, sizeof(Int), Common) ;
+        if (Common->status < CHOLMOD_OK)
+            goto cleanup ;
+        G = spinv_diag_graph (A, Common) ;
+        if (Common->status < CHOLMOD_OK)
+            goto cleanup ;
+    }
+    if (distance > 0)
+    {
+        ncolours = spinv_diag_colour (G, distance, Colour, Iwork, Iwork + n,
+                                      Iwork + 2*n, Iwork + 3*n) ;
+    }
+    else
+    {
+        for (i = 0; i < n; i++)
+            Colour[i] = 0 ;
+        ncolours = (n > 0) ? 1 : 0 ;
+    }
+    for (i = 0; i < n; i++)
+        Cp[Colour[i]+1]++ ;
+    for (c = 0; c < ncolours; c++)
+        Cp[c+1] += Cp[c] ;
+    for (i = 0; i < n; i++)
+        Ci[Cp[Colour[i]]++] = i ;
+    for (c = ncolours; c > 0; c--)
+        Cp[c] = Cp[c-1] ;
+    Cp[0] = 0 ;
+
+    /*
+     * Probes in blocks: the r-th probe has the colour r / nsamples
+     */
+    nrhs = ncolours * nsamples ;
+    nb = MIN (SPINV_DIAG_BLOCK, nrhs) ;
+    B = CHOLMOD(zeros) (n, MAX (nb, 1), CHOLMOD_REAL, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+    Bx = B->x ;
+    state = 0x9e3779b97f4a7c15ULL ;
+
+    for (r0 = 0; r0 < nrhs; r0 = r1)
+    {
+        r1 = MIN (r0 + nb, nrhs) ;
+        B->ncol = r1 - r0 ;
+        for (r = r0; r < r1; r++)
+        {
+            c = r / nsamples ;
+            for (k = Cp[c]; k < Cp[c+1]; k++)
+                Bx[Ci[k] + (r-r0)*n] = spinv_diag_sign (&state) ;
+        }
+
+        Y = CHOLMOD(solve) (CHOLMOD_A, L, B, Common) ;
+        if (Common->status < CHOLMOD_OK)
+            goto cleanup ;
+        Yx = Y->x ;
+
+        for (r = r0; r < r1; r++)
+        {
+            c = r / nsamples ;
+            for (k = Cp[c]; k < Cp[c+1]; k++)
+            {
+                i = Ci[k] ;
+                z = Bx[i + (r-r0)*n] * Yx[i + (r-r0)*n] ;
+                Sum[i] += z ;
+                Sumsq[i] += z*z ;
+                Bx[i + (r-r0)*n] = 0.0 ;
+            }
+        }
+        CHOLMOD(free_dense) (&Y, Common) ;
+    }
+    B->ncol = nb ;
+
+    /*
+     * Diagonal sparse matrix in the layout of cholmod_spinv
+     */
+    X = CHOLMOD(allocate_sparse) (n, n, n, TRUE, TRUE, -1, CHOLMOD_REAL,
+                                  Common) ;
+    if (E != NULL)
+        *E = CHOLMOD(zeros) (n, 1, CHOLMOD_REAL, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    for (j = 0; j < n; j++)
+    {
+        m = Sum[j] / nsamples ;
+        Xp[j] = j ;
+        Xi[j] = j ;
+        Xx[j] = m ;
+        if (E != NULL)
+        {
+            var = (Sumsq[j] - nsamples*m*m) / (nsamples - 1) ;
+            Ex = (*E)->x ;
+            Ex[j] = sqrt (MAX (var, 0.0) / nsamples) ;
+        }
+    }
+    Xp[n] = n ;
+
+cleanup:
+    if (B != NULL)
+        B->ncol = MAX (nb, 1) ;
+    CHOLMOD(free_dense) (&Y, Common) ;
+    CHOLMOD(free_dense) (&B, Common) ;
+    CHOLMOD(free_sparse) (&G, Common) ;
+    CHOLMOD(free)(4*n, sizeof(Int), Iwork, Common) ;
+    CHOLMOD(free)(n, sizeof(double), Sumsq, Common) ;
+    CHOLMOD(free)(n, sizeof(double), Sum, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Ci, Common) ;
+    CHOLMOD(free)(n+1, sizeof(Int), Cp, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Colour, Common) ;
+
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free_sparse) (&X, Common) ;
+        if (E != NULL)
+            CHOLMOD(free_dense) (E, Common) ;
+    }
+
+    return (X) ;
+}
@@ -0,0 +1,118 @@
+/* ========================================================================== */
+/* === cholmod_spinv_factor ================================================= */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_factor.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * The sparse inverse in the layout of the factor.  The recursion computes
+ * the elements of the inverse at the positions of L->x, cholmod_spinv then
+ * permutes them in place to a sparse matrix with the original (unpermuted)
+ * indices and sorts it.  cholmod_spinv_factor returns the elements as they
+ * are computed, in a cholmod_factor Z whose x holds the inverse: Z->x[k] is
+ * the element of inv(P*A*P') at the position of L->x[k] (with L->Perm = P).
+ * Thus the element (i,j) of the permuted inverse is found exactly like the
+ * element (i,j) of L, and no index arrays are allocated for the result.
+ * Its peak memory is that of the recursion in cholmod_spinv, which is at
+ * least that of the result of cholmod_spinv without its row indices.
+ *
+ * Z shares everything except x with L (Perm, super, pi, px, s for a
+ * supernodal factor, p, i, nz, next, prev for a simplicial one), thus L
+ * must not be modified or freed while Z is used.  Z must be freed with
+ * cholmod_spinv_free_factor, not with cholmod_free_factor.  For a complex
+ * or zomplex L, Z is complex (interleaved).  For a simplicial LDL' factor,
+ * the "diagonal" of Z is the diagonal of the inverse, not D.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+cholmod_factor *CHOLMOD(spinv_factor)  /* returns the inverse in L's layout */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_factor *Z ;
+    size_t fsize ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    Z = CHOLMOD(malloc)(1, sizeof(cholmod_factor), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (NULL) ;
+
+    // Shallow copy of the symbolic part
+    *Z = *L ;
+    Z->z = NULL ;
+    Z->xtype = (L->xtype == CHOLMOD_REAL) ? CHOLMOD_REAL : CHOLMOD_COMPLEX ;
+    fsize = CHOLMOD(spinv_layout_size) (L) ;
+    if (Z->xtype == CHOLMOD_COMPLEX)
+        fsize *= 2 ;
+
+    Z->x = CHOLMOD(spinv_malloc)(fsize, sizeof(double), Common) ;
+    if (Common->status >= CHOLMOD_OK)
+        CHOLMOD(spinv_numeric) (L, Z->x, Common) ;
+
+    if (Common->status < CHOLMOD_OK)
+        CHOLMOD(spinv_free_factor) (&Z, Common) ;
+
+    return (Z) ;
+}
+
+
+int CHOLMOD(spinv_free_factor)
+(
+    /* ---- in/out --- */
+    cholmod_factor **Z,	/* inverse from cholmod_spinv_factor, NULL on output */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    size_t fsize ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    if (Z == NULL || *Z == NULL)
+        return (TRUE) ;
+
+    fsize = CHOLMOD(spinv_layout_size) (*Z) ;
+    if ((*Z)->xtype == CHOLMOD_COMPLEX)
+        fsize *= 2 ;
+    CHOLMOD(spinv_free)(fsize, sizeof(double), (*Z)->x, Common) ;
+    *Z = CHOLMOD(free)(1, sizeof(cholmod_factor), *Z, Common) ;
+
+    return (TRUE) ;
+}
@@ -0,0 +1,272 @@
+/* ========================================================================== */
+/* === cholmod_spinv_fisher ================================================= */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_fisher.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Given the factorization L of A and p symmetric sparse matrices dA[i]
+ * (typically dA[i] = dA/dtheta_i), compute the p x p dense matrix
+ *
+ *   F[i,j] = tr(inv(A)*dA[i]*inv(A)*dA[j]),
+ *
+ * for instance, the Fisher information of a Gaussian model with precision
+ * or covariance matrix A is F/2.  The patterns of dA[i] must be contained in
+ * the pattern of L (as is the case if they are contained in the pattern of
+ * A).
+ *
+ * The computation is exact.  Because tr(inv(A)*dA[i]) = sum(X.*dA[i]) on
+ * the pattern, where X is the sparse inverse, its derivative with respect
+ * to A is given by cholmod_spinv_adjoint and
+ *
+ *   F[i,j] = -sum(d tr(inv(A)*dA[i]) / dA .* dA[j]).
+ *
+ * Thus, the sparse inverse is computed once, then one reverse sweep per
+ * parameter gives a whole row of F.  The work shared by all the pairs (the
+ * sparse inverse and the positions of the elements of dA[i] in the layout of
+ * L) is done once.  The reverse sweeps are independent and they are run in
+ * parallel with OpenMP, using at most Common->nthreads_max threads.  Each
+ * thread needs a workspace as large as L->x.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+cholmod_dense *CHOLMOD(spinv_fisher)   /* returns the p x p matrix F */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* factorization to use */
+    cholmod_sparse **dA, /* p symmetric matrices */
+    size_t p,		/* number of matrices */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *A ;
+    cholmod_dense *F ;
+    double *Fx, *Xf, *G, *Work, *Ax, *dAw, *dAx, *Gt ;
+    double f ;
+    Int *Lperm, *Iperm, *Iwork, *Ap, *Ai, *Anz, *dAp, *dAk, *Iworkt ;
+    Int n, i, j, k, q, pend, ip, jp, kl, nthreads, t ;
+    size_t lsize, dsize, isize, nz ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_NULL (dA, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    n = L->n ;
+    nz = 0 ;
+    for (i = 0; i < p; i++)
+    {
+        RETURN_IF_NULL (dA[i], NULL) ;
+        RETURN_IF_XTYPE_INVALID (dA[i], CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+        if (dA[i]->nrow != n || dA[i]->ncol != n)
+        {
+            ERROR (CHOLMOD_INVALID, "dimensions do not match") ;
+            return (NULL) ;
+        }
+        nz += dA[i]->nzmax ;
+    }
+    if (L->xtype != CHOLMOD_REAL)
+    {
+        ERROR (CHOLMOD_INVALID, "Complex xtype not implemented.") ;
+        return (NULL) ;
+    }
+    if (!L->is_super && L->is_ll)
+    {
+        ERROR (CHOLMOD_INVALID, "Real xtype for L*L' not implemented.") ;
+        return (NULL) ;
+    }
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads () ;
+    if (Common->nthreads_max > 0)
+        nthreads = MIN (nthreads, Common->nthreads_max) ;
+#else
+    nthreads = 1 ;
+#endif
+    nthreads = MAX (1, MIN (nthreads, (Int) p)) ;
+
+    F = NULL ;
+    Iperm = NULL ;
+    Xf = NULL ;
+    G = NULL ;
+    Work = NULL ;
+    Iwork = NULL ;
+    dAp = NULL ;
+    dAk = NULL ;
+    dAw = NULL ;
+    dAx = NULL ;
+    Lperm = L->Perm ;
+    lsize = CHOLMOD(spinv_layout_size) (L) ;
+    CHOLMOD(spinv_adjoint_worksize) (L, &dsize, &isize) ;
+
+    F = CHOLMOD(zeros) (p, p, CHOLMOD_REAL, Common) ;
+    Iperm = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Xf = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    G = CHOLMOD(malloc)(nthreads*lsize, sizeof(double), Common) ;
+    Work = CHOLMOD(malloc)(nthreads*dsize, sizeof(double), Common) ;
+    Iwork = CHOLMOD(malloc)(nthreads*isize, sizeof(Int), Common) ;
+    dAp = CHOLMOD(malloc)(p+1, sizeof(Int), Common) ;
+    dAk = CHOLMOD(malloc)(nz, sizeof(Int), Common) ;
+    dAw = CHOLMOD(malloc)(nz, sizeof(double), Common) ;
+    dAx = CHOLMOD(malloc)(nz, sizeof(double), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    for (i = 0; i < n; i++)
+        Iperm[PERM(i)] = i ;
+
+    /*
+     * Compute the sparse inverse in the layout of L->x
+     */
+    if (!CHOLMOD(spinv_numeric) (L, Xf, Common))
+        goto cleanup ;
+
+    /*
+     * Positions of the elements of dA[i] in the layout of L->x.  For each
+     * element, dAx is the derivative of tr(inv(A)*dA[i]) with respect to
+     * the element of X and dAw is the weight of the element of the
+     * derivative (in which off-diagonal elements count twice).
+     */
+    q = 0 ;
+    dAp[0] = 0 ;
+    for (i = 0; i < p; i++)
+    {
+        A = dA[i] ;
+        Ap = A->p ;
+        Ai = A->i ;
+        Anz = A->nz ;
+        Ax = A->x ;
+        for (j = 0; j < n; j++)
+        {
+            pend = (A->packed) ? Ap[j+1] : Ap[j] + Anz[j] ;
+            for (k = Ap[j]; k < pend; k++)
+            {
+                // Ignore the other triangle of a symmetric matrix
+                if ((A->stype > 0 && Ai[k] > j) || (A->stype < 0 && Ai[k] < j))
+                    continue ;
+                ip = Iperm[Ai[k]] ;
+                jp = Iperm[j] ;
+                kl = CHOLMOD(spinv_locate) (L, MAX(ip,jp), MIN(ip,jp)) ;
+                if (kl < 0)
+                {
+                    if (Ax[k] != 0)
+                    {
+                        ERROR (CHOLMOD_INVALID,
+                               "element outside the pattern of the factor") ;
+                        goto cleanup ;
+                    }
+                    continue ;
+                }
+                dAk[q] = kl ;
+                if (Ai[k] == j)
+                {
+                    dAx[q] = Ax[k] ;
+                    dAw[q] = Ax[k] ;
+                }
+                else if (A->stype != 0)
+                {
+                    // Element represents both symmetric positions
+                    dAx[q] = 2.0*Ax[k] ;
+                    dAw[q] = Ax[k] ;
+                }
+                else
+                {
+                    // Both symmetric positions are stored
+                    dAx[q] = Ax[k] ;
+                    dAw[q] = 0.5*Ax[k] ;
+                }
+                q++ ;
+            }
+        }
+        dAp[i+1] = q ;
+    }
+
+    /*
+     * One reverse sweep for each row of F
+     */
+    Fx = F->x ;
+
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic,1) \
+        private(t, j, k, f, Gt, Iworkt)
+    for (i = 0; i < (Int) p; i++)
+    {
+#ifdef _OPENMP
+        t = omp_get_thread_num () ;
+#else
+        t = 0 ;
+#endif
+        Gt = G + t*lsize ;
+        Iworkt = Iwork + t*isize ;
+
+        // Derivatives of tr(inv(A)*dA[i]) with respect to X
+        for (k = 0; k < lsize; k++)
+            Gt[k] = 0.0 ;
+        for (k = dAp[i]; k < dAp[i+1]; k++)
+            Gt[dAk[k]] += dAx[k] ;
+
+        // Derivatives of tr(inv(A)*dA[i]) with respect to A
+        CHOLMOD(spinv_adjoint_numeric) (L, Xf, Gt, Work + t*dsize, Iworkt) ;
+
+        // F[i,j] = F[j,i] for j >= i
+        for (j = i; j < p; j++)
+        {
+            f = 0.0 ;
+            for (k = dAp[j]; k < dAp[j+1]; k++)
+                f -= Gt[dAk[k]] * dAw[k] ;
+            Fx[i+j*p] = f ;
+            Fx[j+i*p] = f ;
+        }
+    }
+
+cleanup:
+    CHOLMOD(free)(nz, sizeof(double), dAx, Common) ;
+    CHOLMOD(free)(nz, sizeof(double), dAw, Common) ;
+    CHOLMOD(free)(nz, sizeof(Int), dAk, Common) ;
+    CHOLMOD(free)(p+1, sizeof(Int), dAp, Common) ;
+    CHOLMOD(free)(nthreads*isize, sizeof(Int), Iwork, Common) ;
+    CHOLMOD(free)(nthreads*dsize, sizeof(double), Work, Common) ;
+    CHOLMOD(free)(nthreads*lsize, sizeof(double), G, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Xf, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Iperm, Common) ;
+
+    if (Common->status < CHOLMOD_OK)
+        CHOLMOD(free_dense) (&F, Common) ;
+
+    return (F) ;
+}
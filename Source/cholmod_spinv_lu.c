@@ -0,0 +1,533 @@
+/* ========================================================================== */
+/* === cholmod_spinv_lu ===================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_lu.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Selected inversion of an unsymmetric matrix from its LU factorization
+ * (Erisman and Tinney, 1975).  The factorization is given as
+ *
+ *   L*U = (R\A)(P,Q),
+ *
+ * where L is unit lower triangular and U is upper triangular, as returned
+ * by klu_extract (with BTF disabled, so that there is no off-diagonal block
+ * F).  UMFPACK gives L in row form (transpose it with cholmod_transpose)
+ * and R is diag(Rs) or inv(diag(Rs)) depending on do_recip.  P, Q and R
+ * may be NULL for identity.
+ *
+ * Denote B = L*U and Z = inv(B).  The identities Z*L = inv(U) and
+ * U*Z = inv(L) give, for a supernode with columns S and off-diagonal rows R,
+ *
+ *   Z[R,S] = -Z[R,R]*L[R,S]*inv(L[S,S]),
+ *   Z[S,R] = -inv(U[S,S])*U[S,R]*Z[R,R],
+ *   Z[S,S] = inv(U[S,S])*(I + U[S,R]*Z[R,R]*L[R,S])*inv(L[S,S]),
+ *
+ * thus the recursion is the same as in cholmod_spinv_super with both
+ * triangles of the inverse.  The recursion is closed on the Cholesky
+ * pattern of the symmetrized pattern of L+U, which is computed with
+ * cholmod_analyze (natural ordering, no postordering).  The values of L, U
+ * and Z are stored in the layout of that supernodal symbolic factor: the
+ * element of the pair (a,b), a >= b, is L[a,b] or Z[a,b] in the lower array
+ * and U[b,a] or Z[b,a] in the upper array.  Each supernode then costs two
+ * dgemm with V = Z[R,R] instead of one dsymm, that is, about twice a
+ * sparse inverse of a symmetric matrix with the same pattern.
+ *
+ * The result is an unsymmetric sparse matrix with the elements of inv(A)
+ * on that pattern, mapped back to the indices of A, that is, inv(A)[Q[j],
+ * P[i]] = Z[j,i] / R[P[i]].  It contains the pattern of A' (needed for
+ * traces tr(inv(A)*dA)) and the pattern of L+U.
+ *
+ * References:
+ *
+ * Erisman AM and Tinney WF (1975).  On computing certain elements of the
+ * inverse of a sparse matrix.  Communications of the ACM 18(3):177-179.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+/*
+ * Symmetrized pattern of L+U as a lower triangular (stype -1) matrix.
+ */
+static cholmod_sparse *spinv_lu_pattern
+(
+    cholmod_sparse *L,
+    cholmod_sparse *U,
+    cholmod_common *Common
+)
+{
+    cholmod_sparse *M ;
+    Int *Lp, *Li, *Lnz, *Up, *Ui, *Unz, *Mp, *Mi, *Tp, *Ti, *mark ;
+    Int n, i, j, p, pend, k ;
+    size_t nz, tnz ;
+
+    n = L->ncol ;
+    Lp = L->p ;
+    Li = L->i ;
+    Lnz = L->nz ;
+    Up = U->p ;
+    Ui = U->i ;
+    Unz = U->nz ;
+
+    // Rows of U in column form: T[:,i] holds the columns j of U[i,j]
+    tnz = 0 ;
+    for (j = 0; j < n; j++)
+        tnz += (U->packed) ? Up[j+1] - Up[j] : Unz[j] ;
+    Tp = CHOLMOD(calloc)(n+1, sizeof(Int), Common) ;
+    Ti = CHOLMOD(malloc)(tnz, sizeof(Int), Common) ;
+    mark = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        M = NULL ;
+        goto cleanup ;
+    }
+    for (j = 0; j < n; j++)
+    {
+        pend = (U->packed) ? Up[j+1] : Up[j] + Unz[j] ;
+        for (p = Up[j]; p < pend; p++)
+            Tp[Ui[p]+1]++ ;
+    }
+    for (i = 0; i < n; i++)
+        Tp[i+1] += Tp[i] ;
+    for (j = 0; j < n; j++)
+    {
+        pend = (U->packed) ? Up[j+1] : Up[j] + Unz[j] ;
+        for (p = Up[j]; p < pend; p++)
+            Ti[Tp[Ui[p]]++] = j ;
+    }
+    for (i = n; i > 0; i--)
+        Tp[i] = Tp[i-1] ;
+    Tp[0] = 0 ;
+
+    // Column j of M: the diagonal, the rows of L[:,j] and the columns of
+    // U[j,:] below the diagonal
+    nz = 0 ;
+    for (j = 0; j < n; j++)
+        nz += ((L->packed) ? Lp[j+1] - Lp[j] : Lnz[j]) + Tp[j+1] - Tp[j] + 1 ;
+    M = CHOLMOD(allocate_sparse) (n, n, nz, FALSE, TRUE, -1, CHOLMOD_PATTERN,
+                                  Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+    Mp = M->p ;
+    Mi = M->i ;
+    for (i = 0; i < n; i++)
+        mark[i] = -1 ;
+    k = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        Mp[j] = k ;
+        mark[j] = j ;
+        Mi[k++] = j ;
+        pend = (L->packed) ? Lp[j+1] : Lp[j] + Lnz[j] ;
+        for (p = Lp[j]; p < pend; p++)
+        {
+            i = Li[p] ;
+            if (i > j && mark[i] != j)
+            {
+                mark[i] = j ;
+                Mi[k++] = i ;
+            }
+        }
+        for (p = Tp[j]; p < Tp[j+1]; p++)
+        {
+            i = Ti[p] ;
+            if (i > j && mark[i] != j)
+            {
+                mark[i] = j ;
+                Mi[k++] = i ;
+            }
+        }
+    }
+    Mp[n] = k ;
+
+cleanup:
+    CHOLMOD(free)(n, sizeof(Int), mark, Common) ;
+    CHOLMOD(free)(tnz, sizeof(Int), Ti, Common) ;
+    CHOLMOD(free)(n+1, sizeof(Int), Tp, Common) ;
+    return (M) ;
+}
+
+
+/*
+ * Scatter the elements of L (lower, the unit diagonal is implicit) or U
+ * (upper) of the factor F to X in the layout of the symbolic factor S.
+ */
+static int spinv_lu_scatter
+(
+    cholmod_factor *S,
+    cholmod_sparse *F,
+    int upper,
+    double *X,
+    cholmod_common *Common
+)
+{
+    Int *Fp, *Fi, *Fnz ;
+    double *Fx ;
+    Int i, j, p, pend, kl ;
+
+    Fp = F->p ;
+    Fi = F->i ;
+    Fnz = F->nz ;
+    Fx = F->x ;
+
+    for (j = 0; j < F->ncol; j++)
+    {
+        pend = (F->packed) ? Fp[j+1] : Fp[j] + Fnz[j] ;
+        for (p = Fp[j]; p < pend; p++)
+        {
+            i = Fi[p] ;
+            if ((upper && i > j) || (!upper && i <= j))
+                continue ;
+            kl = CHOLMOD(spinv_locate) (S, MAX(i,j), MIN(i,j)) ;
+            if (kl < 0)
+            {
+                ERROR (CHOLMOD_INVALID, "element outside the pattern") ;
+                return (FALSE) ;
+            }
+            X[kl] = Fx[p] ;
+        }
+    }
+
+    return (TRUE) ;
+}
+
+
+/*
+ * Block step for one supernode.  Lo = [L1; L2] and Up = [U1'; U2'] are ms x
+ * ns with U1 = U[S,S] and U2 = U[S,R], V = Z[R,R] is m2 x m2 (full).  On
+ * output, Zl = [Z[S,S]; Z[R,S]] and the rows m1:ms-1 of Zu are Z[S,R]'.
+ * W is workspace of the size of Zl.
+ */
+static void spinv_lu_block
+(
+    double *Lo,
+    double *Up,
+    double *Zl,
+    double *Zu,
+    double *V,
+    double *W,
+    Int m,
+    Int n
+)
+{
+    double *L1, *L2, *U1, *U2, *Z1, *Z2, *W2, *Y2 ;
+    Int i, j ;
+
+    Int m1 = n ;      // rows of Z1/L1
+    Int m2 = m - m1 ; // rows of Z2/L2
+    Int ld = m ;      // leading dimension of all the blocks
+
+    L1 = Lo ;
+    L2 = Lo + m1 ;
+    U1 = Up ;
+    U2 = Up + m1 ;
+    Z1 = Zl ;
+    Z2 = Zl + m1 ;
+    W2 = W + m1 ;
+    Y2 = Zu + m1 ;
+
+    for (i = 0; i < m1; i++)
+    {
+        for (j = 0; j < m1; j++)
+            Z1[i+j*ld] = ((i == j) ? 1.0 : 0.0) ;
+    }
+
+    if (m2 > 0)
+    {
+        // W2 = V * L2
+        cblas_dgemm (CblasColMajor, CblasNoTrans, CblasNoTrans, (BLAS_INT) m2,
+                     (BLAS_INT) n, (BLAS_INT) m2, 1.0, V, (BLAS_INT) m2, L2,
+                     (BLAS_INT) ld, 0.0, W2, (BLAS_INT) ld) ;
+
+        // Y2 = V' * U2' = (U[S,R] * V)'
+        cblas_dgemm (CblasColMajor, CblasTrans, CblasNoTrans, (BLAS_INT) m2,
+                     (BLAS_INT) n, (BLAS_INT) m2, 1.0, V, (BLAS_INT) m2, U2,
+                     (BLAS_INT) ld, 0.0, Y2, (BLAS_INT) ld) ;
+
+        // Z1 = I + U[S,R] * V * L2
+        cblas_dgemm (CblasColMajor, CblasTrans, CblasNoTrans, (BLAS_INT) m1,
+                     (BLAS_INT) m1, (BLAS_INT) m2, 1.0, U2, (BLAS_INT) ld, W2,
+                     (BLAS_INT) ld, 1.0, Z1, (BLAS_INT) ld) ;
+
+        // Z2 = -W2 / L1
+        for (j = 0; j < n; j++)
+            for (i = 0; i < m2; i++)
+                Z2[i+j*ld] = -W2[i+j*ld] ;
+        cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                     CblasUnit, (BLAS_INT) m2, (BLAS_INT) n, 1.0, L1,
+                     (BLAS_INT) ld, Z2, (BLAS_INT) ld) ;
+
+        // Z[S,R]' = -Y2 / U1'
+        cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                     CblasNonUnit, (BLAS_INT) m2, (BLAS_INT) n, -1.0, U1,
+                     (BLAS_INT) ld, Y2, (BLAS_INT) ld) ;
+    }
+
+    // Z1 = U1 \ Z1 / L1
+    cblas_dtrsm (CblasColMajor, CblasLeft, CblasLower, CblasTrans,
+                 CblasNonUnit, (BLAS_INT) m1, (BLAS_INT) m1, 1.0, U1,
+                 (BLAS_INT) ld, Z1, (BLAS_INT) ld) ;
+    cblas_dtrsm (CblasColMajor, CblasRight, CblasLower, CblasNoTrans,
+                 CblasUnit, (BLAS_INT) m1, (BLAS_INT) m1, 1.0, L1,
+                 (BLAS_INT) ld, Z1, (BLAS_INT) ld) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_lu ===================================================== */
+/* ========================================================================== */
+
+cholmod_sparse *CHOLMOD(spinv_lu)   /* returns the selected inverse */
+(
+    /* ---- input ---- */
+    cholmod_sparse *L,	/* unit lower triangular factor */
+    cholmod_sparse *U,	/* upper triangular factor */
+    Int *P,		/* row permutation, or NULL */
+    Int *Q,		/* column permutation, or NULL */
+    double *R,		/* row scale factors, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *M, *X ;
+    cholmod_factor *S ;
+    cholmod_method_struct method0 ;
+    double *Lo, *Up, *Zlo, *Zup, *V, *Zl, *Zu, *W, *Xx ;
+    Int *Super, *Lpi, *Lpx, *Ls, *map, *Xp, *Xi ;
+    Int n, s, i, j, a, b, kl, kv, ms, ns, m1, m2, psi0, pass, xi, xj, kx ;
+    int nmethods, postorder, supernodal ;
+    size_t lsize, vsize, zsize, nz ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_NULL (U, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+    RETURN_IF_XTYPE_INVALID (U, CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    n = L->ncol ;
+    if (L->nrow != n || U->nrow != n || U->ncol != n)
+    {
+        ERROR (CHOLMOD_INVALID, "dimensions do not match") ;
+        return (NULL) ;
+    }
+
+    X = NULL ;
+    S = NULL ;
+    Lo = NULL ;
+    Up = NULL ;
+    Zlo = NULL ;
+    Zup = NULL ;
+    V = NULL ;
+    Zl = NULL ;
+    Zu = NULL ;
+    W = NULL ;
+    map = NULL ;
+    lsize = 0 ;
+    vsize = 0 ;
+    zsize = 0 ;
+
+    /*
+     * Supernodal symbolic factor of the symmetrized pattern without
+     * reordering: the plan of the recursion
+     */
+    M = spinv_lu_pattern (L, U, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    nmethods = Common->nmethods ;
+    method0 = Common->method[0] ;
+    postorder = Common->postorder ;
+    supernodal = Common->supernodal ;
+    Common->nmethods = 1 ;
+    Common->method[0].ordering = CHOLMOD_NATURAL ;
+    Common->postorder = FALSE ;
+    Common->supernodal = CHOLMOD_SUPERNODAL ;
+    S = CHOLMOD(analyze) (M, Common) ;
+    Common->nmethods = nmethods ;
+    Common->method[0] = method0 ;
+    Common->postorder = postorder ;
+    Common->supernodal = supernodal ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    Super = S->super ;
+    Lpi = S->pi ;
+    Lpx = S->px ;
+    Ls = S->s ;
+    lsize = CHOLMOD(spinv_layout_size) (S) ;
+    vsize = MAX (S->maxesize*S->maxesize, 1) ;
+    zsize = 1 ;
+    for (s = 0; s < S->nsuper; s++)
+        zsize = MAX (zsize, Lpx[s+1] - Lpx[s]) ;
+
+    Lo = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    Up = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    Zlo = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    Zup = CHOLMOD(calloc)(lsize, sizeof(double), Common) ;
+    V = CHOLMOD(malloc)(vsize, sizeof(double), Common) ;
+    map = CHOLMOD(malloc)(vsize, sizeof(Int), Common) ;
+    Zl = CHOLMOD(malloc)(zsize, sizeof(double), Common) ;
+    Zu = CHOLMOD(malloc)(zsize, sizeof(double), Common) ;
+    W = CHOLMOD(malloc)(zsize, sizeof(double), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+
+    if (!spinv_lu_scatter (S, L, FALSE, Lo, Common) ||
+        !spinv_lu_scatter (S, U, TRUE, Up, Common))
+        goto cleanup ;
+
+    /*
+     * Erisman-Tinney recursion from the last supernode to the first
+     */
+    for (s = S->nsuper - 1; s >= 0; s--)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        m1 = ns ;
+        m2 = ms - ns ;
+
+        // V = Z[R,R], both triangles
+        if (m2 > 0)
+        {
+            CHOLMOD(spinv_super_map) (S, s, map) ;
+            for (j = 0; j < m2; j++)
+            {
+                for (i = j; i < m2; i++)
+                {
+                    kv = map[i+j*m2] ;
+                    V[i+j*m2] = Zlo[kv] ;
+                    V[j+i*m2] = Zup[kv] ;
+                }
+            }
+        }
+
+        spinv_lu_block (Lo + Lpx[s], Up + Lpx[s], Zl, Zu, V, W, ms, ns) ;
+
+        for (j = 0; j < ns; j++)
+        {
+            for (i = j; i < ms; i++)
+            {
+                kl = Lpx[s] + i + j*ms ;
+                Zlo[kl] = Zl[i+j*ms] ;
+                Zup[kl] = (i < m1) ? Zl[j+i*ms] : Zu[i+j*ms] ;
+            }
+        }
+    }
+
+    /*
+     * Result: Z[a,b] for the pairs of the pattern, inv(A)[Q[a],P[b]] =
+     * Z[a,b] / R[P[b]].  The first pass counts, the second fills.
+     */
+    nz = 0 ;
+    for (s = 0; s < S->nsuper; s++)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        nz += 2*(ns*ms - (ns*(ns-1))/2) - ns ;
+    }
+    X = CHOLMOD(allocate_sparse) (n, n, nz, FALSE, TRUE, 0, CHOLMOD_REAL,
+                                  Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto cleanup ;
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    for (j = 0; j <= n; j++)
+        Xp[j] = 0 ;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            // Cumulative sum, Xp[j] is the next free position of column j
+            for (j = 0; j < n; j++)
+                Xp[j+1] += Xp[j] ;
+        }
+        for (s = 0; s < S->nsuper; s++)
+        {
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
+            {
+                for (i = j; i < ms; i++)
+                {
+                    kl = Lpx[s] + i + j*ms ;
+                    a = Ls[psi0+i] ;
+                    b = Super[s] + j ;
+                    // Z[a,b], and Z[b,a] if off-diagonal
+                    for (kv = 0; kv < ((a == b) ? 1 : 2); kv++)
+                    {
+                        xi = (Q != NULL) ? Q[kv ? b : a] : (kv ? b : a) ;
+                        xj = (P != NULL) ? P[kv ? a : b] : (kv ? a : b) ;
+                        if (pass == 0)
+                        {
+                            Xp[xj+1]++ ;
+                            continue ;
+                        }
+                        kx = Xp[xj]++ ;
+                        Xi[kx] = xi ;
+                        Xx[kx] = (kv ? Zup[kl] : Zlo[kl]) ;
+                        if (R != NULL)
+                            Xx[kx] /= R[xj] ;
+                    }
+                }
+            }
+        }
+    }
+    // Restore the column pointers
+    for (j = n; j > 0; j--)
+        Xp[j] = Xp[j-1] ;
+    Xp[0] = 0 ;
+
+    CHOLMOD(sort) (X, Common) ;
+
+cleanup:
+    CHOLMOD(free)(zsize, sizeof(double), W, Common) ;
+    CHOLMOD(free)(zsize, sizeof(double), Zu, Common) ;
+    CHOLMOD(free)(zsize, sizeof(double), Zl, Common) ;
+    CHOLMOD(free)(vsize, sizeof(Int), map, Common) ;
+    CHOLMOD(free)(vsize, sizeof(double), V, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Zup, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Zlo, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Up, Common) ;
+    CHOLMOD(free)(lsize, sizeof(double), Lo, Common) ;
+    CHOLMOD(free_factor) (&S, Common) ;
+    CHOLMOD(free_sparse) (&M, Common) ;
+
+    if (Common->status < CHOLMOD_OK)
+        CHOLMOD(free_sparse) (&X, Common) ;
+
+    return (X) ;
+}
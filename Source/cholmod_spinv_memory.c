@@ -0,0 +1,259 @@
+/* ========================================================================== */
+/* === cholmod_spinv_memory ================================================= */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_memory.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Placement of the large buffers of the sparse inverse: the array of the
+ * inverse in the layout of L->x and the workspace of the supernodes.  The
+ * array of cholmod_spinv becomes its result, thus it is from
+ * CHOLMOD(malloc) and only its workspace is placed here.
+ *
+ * A page of memory is placed on the NUMA node of the thread that first
+ * writes it.  Memory from CHOLMOD(malloc) may be reused from earlier
+ * allocations and thus already placed, typically all on the node of the
+ * calling thread.  Therefore buffers of at least SPINV_LARGE bytes are
+ * mapped fresh from the kernel, so that the parts of the inverse and the
+ * workspace written by the threads of cholmod_spinv_super_hybrid are placed
+ * on their own nodes.  Optionally the buffers use transparent huge pages
+ * (madvise) or explicit huge pages (MAP_HUGETLB, which falls back to
+ * transparent huge pages if none are reserved), reducing TLB misses in the
+ * scattered reads of the inverse.
+ *
+ * The mode is set with cholmod_spinv_pages or, if it is not called, with
+ * the environment variable CHOLMOD_SPINV_PAGES (malloc, touch, thp or
+ * hugetlb).  The default is touch.  The mapped buffers are counted in
+ * Common->memory_inuse and Common->memory_usage like those of
+ * CHOLMOD(malloc).
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// Smallest buffer that is mapped fresh
+#define SPINV_LARGE ((size_t) 1 << 21)
+
+// Page sizes
+#define SPINV_PAGE ((size_t) 4096)
+#define SPINV_HUGE_PAGE ((size_t) 1 << 21)
+
+#define SPINV_TRAILER_MAGIC 0x7370696e766d656dULL
+
+// Stored after the data of a large buffer, tells how to free it
+typedef struct spinv_trailer_struct
+{
+    uint64_t magic ;
+    uint64_t length ;	/* length of the mapping, 0 if from CHOLMOD(malloc) */
+} spinv_trailer ;
+
+static pthread_mutex_t pages_lock = PTHREAD_MUTEX_INITIALIZER ;
+static int pages_configured = FALSE ;
+static int pages_mode = CHOLMOD_SPINV_PAGES_TOUCH ;
+
+static int spinv_pages_mode (void)
+{
+    const char *s ;
+    int mode ;
+
+    pthread_mutex_lock (&pages_lock) ;
+    if (!pages_configured)
+    {
+        pages_configured = TRUE ;
+        s = getenv ("CHOLMOD_SPINV_PAGES") ;
+        if (s == NULL)
+            s = "" ;
+        if (strcmp (s, "malloc") == 0)
+            pages_mode = CHOLMOD_SPINV_PAGES_MALLOC ;
+        else if (strcmp (s, "touch") == 0)
+            pages_mode = CHOLMOD_SPINV_PAGES_TOUCH ;
+        else if (strcmp (s, "thp") == 0)
+            pages_mode = CHOLMOD_SPINV_PAGES_THP ;
+        else if (strcmp (s, "hugetlb") == 0)
+            pages_mode = CHOLMOD_SPINV_PAGES_HUGETLB ;
+    }
+    mode = pages_mode ;
+    pthread_mutex_unlock (&pages_lock) ;
+    return (mode) ;
+}
+
+// Offset of the trailer: the data rounded up to a multiple of 8 bytes
+static size_t spinv_trailer_offset (size_t n, size_t size)
+{
+    return (((n*size) + 7) & ~((size_t) 7)) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_pages ================================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_pages)
+(
+    /* ---- input ---- */
+    int mode,		/* CHOLMOD_SPINV_PAGES_* */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    if (mode < CHOLMOD_SPINV_PAGES_MALLOC ||
+        mode > CHOLMOD_SPINV_PAGES_HUGETLB)
+    {
+        ERROR (CHOLMOD_INVALID, "invalid page mode") ;
+        return (FALSE) ;
+    }
+
+    pthread_mutex_lock (&pages_lock) ;
+    pages_configured = TRUE ;
+    pages_mode = mode ;
+    pthread_mutex_unlock (&pages_lock) ;
+    return (TRUE) ;
+}
+
+
+/*
+ * Buffer of n items of the given size, like CHOLMOD(malloc).  Buffers of at
+ * least SPINV_LARGE bytes are mapped fresh according to the page mode and
+ * must be freed with cholmod_spinv_free with the same n and size.
+ */
+void *CHOLMOD(spinv_malloc)
+(
+    size_t n,
+    size_t size,
+    cholmod_common *Common
+)
+{
+    spinv_trailer *t ;
+    size_t offset, bytes, length ;
+    void *p ;
+    int mode ;
+
+    if (size != 0 && n > (SIZE_MAX - 2*SPINV_HUGE_PAGE) / size)
+    {
+        ERROR (CHOLMOD_TOO_LARGE, "problem too large") ;
+        return (NULL) ;
+    }
+    if (n*size < SPINV_LARGE)
+        return (CHOLMOD(malloc) (n, size, Common)) ;
+
+    offset = spinv_trailer_offset (n, size) ;
+    bytes = offset + sizeof(spinv_trailer) ;
+    mode = spinv_pages_mode () ;
+
+    if (mode == CHOLMOD_SPINV_PAGES_MALLOC)
+    {
+        p = CHOLMOD(malloc) (bytes, 1, Common) ;
+        if (p == NULL)
+            return (NULL) ;
+        length = 0 ;
+    }
+    else
+    {
+        p = MAP_FAILED ;
+        if (mode == CHOLMOD_SPINV_PAGES_TOUCH)
+        {
+            length = (bytes + SPINV_PAGE - 1) & ~(SPINV_PAGE - 1) ;
+        }
+        else
+        {
+            length = (bytes + SPINV_HUGE_PAGE - 1) & ~(SPINV_HUGE_PAGE - 1) ;
+#ifdef MAP_HUGETLB
+            if (mode == CHOLMOD_SPINV_PAGES_HUGETLB)
+                p = mmap (NULL, length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) ;
+#endif
+        }
+        if (p == MAP_FAILED)
+        {
+            p = mmap (NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+#ifdef MADV_HUGEPAGE
+            if (p != MAP_FAILED && mode != CHOLMOD_SPINV_PAGES_TOUCH)
+                madvise (p, length, MADV_HUGEPAGE) ;
+#endif
+        }
+        if (p == MAP_FAILED)
+        {
+            ERROR (CHOLMOD_OUT_OF_MEMORY, "out of memory") ;
+            return (NULL) ;
+        }
+        Common->malloc_count++ ;
+        Common->memory_inuse += length ;
+        Common->memory_usage = MAX (Common->memory_usage,
+                                    Common->memory_inuse) ;
+    }
+
+    // The trailer is the only part written here, the data is left untouched
+    t = (spinv_trailer *) ((char *) p + offset) ;
+    t->magic = SPINV_TRAILER_MAGIC ;
+    t->length = length ;
+    return (p) ;
+}
+
+
+/*
+ * Free a buffer from cholmod_spinv_malloc.  Returns NULL.
+ */
+void *CHOLMOD(spinv_free)
+(
+    size_t n,
+    size_t size,
+    void *p,
+    cholmod_common *Common
+)
+{
+    spinv_trailer *t ;
+    size_t offset ;
+
+    if (p == NULL)
+        return (NULL) ;
+    if (n*size < SPINV_LARGE)
+        return (CHOLMOD(free) (n, size, p, Common)) ;
+
+    offset = spinv_trailer_offset (n, size) ;
+    t = (spinv_trailer *) ((char *) p + offset) ;
+    ASSERT (t->magic == SPINV_TRAILER_MAGIC) ;
+    if (t->length == 0)
+    {
+        CHOLMOD(free) (offset + sizeof(spinv_trailer), 1, p, Common) ;
+    }
+    else
+    {
+        Common->malloc_count-- ;
+        Common->memory_inuse -= t->length ;
+        munmap (p, t->length) ;
+    }
+    return (NULL) ;
+}
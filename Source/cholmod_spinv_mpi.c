@@ -0,0 +1,907 @@
+/* ========================================================================== */
+/* === cholmod_spinv_mpi ==================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_mpi.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Distributed-memory sparse inverse: cholmod_spinv_mpi computes the sparse
+ * inverse of a supernodal LL' factorization on the ranks of an MPI
+ * communicator.  Each rank returns its part of the result, or only of its
+ * diagonal, and optionally the whole is gathered on one rank.  It is built
+ * only with CHOLMOD_EXTRA_MPI (make mpi) into its own library, so the main
+ * library does not depend on MPI.
+ *
+ * Every rank calls it with the same factor L, e.g. each rank factorizes the
+ * same matrix.  The supernodal elimination tree is mapped to the ranks by
+ * proportional mapping: the roots get all ranks, and the ranks of a
+ * supernode are split among its children in proportion to the flops of
+ * their subtrees.  A child that gets a single rank is done by that rank
+ * with all of its subtree, thus the separator subtrees at the bottom of the
+ * tree need no communication.  A supernode is done by the first of its
+ * ranks.
+ *
+ * A supernode needs the inverse Z_C at its off-diagonal rows, which is in
+ * the block of its parent or was needed by its parent.  Thus the rank of
+ * the parent has it and, if the child is done by another rank, sends it
+ * (the lower triangle, packed by columns) in messages of at most
+ * SPINV_MPI_CHUNK doubles.  All ranks walk the supernodes from the root
+ * down and the messages of a child are sent at its step, so the messages
+ * between two ranks arrive in the order they are received.  The sends are
+ * nonblocking, thus the rank of the parent goes on with its own supernodes.
+ *
+ * A rank holds only its own blocks and the parts Z_C it receives, in a
+ * compact array described by runs of consecutive positions of L->x.  The
+ * positions of the inverse needed by a supernode are computed in the
+ * layout of L->x and translated to the compact array by a binary search
+ * over the runs.  The factor itself is not distributed.
+ *
+ * By default (root CHOLMOD_SPINV_MPI_LOCAL) each rank returns the elements
+ * of its own blocks as a sparse matrix like the result of cholmod_spinv,
+ * so the sum of the parts of all ranks is the sparse inverse.  With a root
+ * rank the blocks are received in place into a full array on root, one
+ * message per rank described by an indexed datatype, and the sparse
+ * inverse is formed as in cholmod_spinv.  The diagonal alone is summed by
+ * MPI_Reduce and returned as a diagonal matrix, like the result of
+ * cholmod_spinv_diag.  The other ranks then return NULL with
+ * Common->status CHOLMOD_OK.  The fronts themselves are not split, so a
+ * supernode near the root that has several ranks is done by one of them.
+ * -------------------------------------------------------------------------- */
+
+#ifndef CHOLMOD_EXTRA_MPI
+#define CHOLMOD_EXTRA_MPI
+#endif
+
+#include "cholmod_extra_internal.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPINV_MPI_TAG 4711
+
+// Largest message in doubles, the count of MPI is an int
+#ifndef SPINV_MPI_CHUNK
+#define SPINV_MPI_CHUNK ((size_t) 1 << 30)
+#endif
+
+// Subtree of a child and its flops, sorted by decreasing flops
+typedef struct
+{
+    double flops ;
+    Int s ;
+} spinv_mpi_child ;
+
+// Positions start..end-1 of L->x held by a rank at local..local+end-start-1
+// of its compact array
+typedef struct
+{
+    Int start ;
+    Int end ;
+    Int local ;
+} spinv_mpi_run ;
+
+
+/*
+ * Flops of the inverse of a supernode of ms rows and ns columns, as in
+ * cholmod_spinv_sched.c
+ */
+static double spinv_mpi_flops (Int ms, Int ns)
+{
+    double m2 = ms - ns ;
+
+    return (2*m2*m2*ns + 2.0*ns*ns*m2 + (double) ns*ns*ns
+            + (double) ms*ns*ns) ;
+}
+
+
+static int spinv_mpi_compare (const void *a, const void *b)
+{
+    const spinv_mpi_child *x = a, *y = b ;
+
+    if (x->flops != y->flops)
+        return ((x->flops > y->flops) ? -1 : 1) ;
+    return ((x->s > y->s) - (x->s < y->s)) ;
+}
+
+
+static int spinv_mpi_compare_index (const void *a, const void *b)
+{
+    Int x = *(const Int *) a, y = *(const Int *) b ;
+
+    return ((x > y) - (x < y)) ;
+}
+
+
+static int spinv_mpi_compare_run (const void *a, const void *b)
+{
+    const spinv_mpi_run *x = a, *y = b ;
+
+    return ((x->start > y->start) - (x->start < y->start)) ;
+}
+
+
+/*
+ * Proportional mapping of the supernodes to nranks ranks.  Parent[s] is the
+ * parent of the supernode s (-1 for a root) and Owner[s] the rank that does
+ * it.  A child with r ranks gets the r consecutive ranks of its parent with
+ * the least load so far.  Every rank computes the same mapping.
+ */
+static void spinv_mpi_map
+(
+    cholmod_factor *L,
+    int nranks,
+    Int *Parent,
+    Int *Owner,
+    cholmod_common *Common
+)
+{
+    spinv_mpi_child *Child ;
+    double *Flops, *Load ;
+    Int *Super, *Lpi, *Ls, *Colsuper, *Head, *Next, *Lo, *Hi ;
+    Int n, nsuper, s, c, p, q, k, r, nr, nc, ms, ns, best ;
+    double total, worst, w ;
+
+    n = L->n ;
+    nsuper = L->nsuper ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Ls = L->s ;
+
+    Colsuper = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Head = CHOLMOD(malloc)(nsuper+1, sizeof(Int), Common) ;
+    Next = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Lo = CHOLMOD(malloc)(nsuper+1, sizeof(Int), Common) ;
+    Hi = CHOLMOD(malloc)(nsuper+1, sizeof(Int), Common) ;
+    Flops = CHOLMOD(malloc)(nsuper+1, sizeof(double), Common) ;
+    Load = CHOLMOD(calloc)(nranks, sizeof(double), Common) ;
+    Child = CHOLMOD(malloc)(nsuper, sizeof(spinv_mpi_child), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto done ;
+
+    /*
+     * Supernodal elimination tree with a virtual root nsuper above the
+     * roots, and the flops of each subtree.  The parent of a supernode has a
+     * larger index, thus the subtrees are summed in one pass.
+     */
+    for (s = 0; s < nsuper; s++)
+    {
+        for (k = Super[s]; k < Super[s+1]; k++)
+            Colsuper[k] = s ;
+    }
+    for (s = 0; s < nsuper; s++)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        Parent[s] = (ms > ns) ? Colsuper[Ls[Lpi[s]+ns]] : -1 ;
+        Flops[s] = spinv_mpi_flops (ms, ns) ;
+    }
+    Flops[nsuper] = 0 ;
+    for (p = 0; p <= nsuper; p++)
+        Head[p] = -1 ;
+    for (s = 0; s < nsuper; s++)
+        Flops[Parent[s] < 0 ? nsuper : Parent[s]] += Flops[s] ;
+    for (s = nsuper - 1; s >= 0; s--)
+    {
+        p = (Parent[s] < 0) ? nsuper : Parent[s] ;
+        Next[s] = Head[p] ;
+        Head[p] = s ;
+    }
+
+    /*
+     * Split the ranks Lo[p]..Hi[p]-1 of each supernode among its children,
+     * from the root down
+     */
+    Lo[nsuper] = 0 ;
+    Hi[nsuper] = nranks ;
+    for (p = nsuper; p >= 0; p--)
+    {
+        if (p < nsuper)
+            Owner[p] = Lo[p] ;
+        nr = Hi[p] - Lo[p] ;
+        nc = 0 ;
+        total = 0 ;
+        for (c = Head[p]; c >= 0; c = Next[c])
+        {
+            Child[nc].flops = Flops[c] ;
+            Child[nc].s = c ;
+            total += Flops[c] ;
+            nc++ ;
+        }
+        if (nr > 1)
+            qsort (Child, nc, sizeof (spinv_mpi_child), spinv_mpi_compare) ;
+
+        for (k = 0; k < nc; k++)
+        {
+            c = Child[k].s ;
+            if (nr == 1)
+            {
+                Lo[c] = Lo[p] ;
+                Hi[c] = Hi[p] ;
+                continue ;
+            }
+            r = (Int) (nr * Child[k].flops / MAX (total, 1) + 0.5) ;
+            r = MAX (1, MIN (r, nr)) ;
+            best = Lo[p] ;
+            worst = -1 ;
+            for (q = Lo[p]; q + r <= Hi[p]; q++)
+            {
+                w = 0 ;
+                for (s = q; s < q + r; s++)
+                    w = MAX (w, Load[s]) ;
+                if (worst < 0 || w < worst)
+                {
+                    worst = w ;
+                    best = q ;
+                }
+            }
+            Lo[c] = best ;
+            Hi[c] = best + r ;
+            for (q = best; q < best + r; q++)
+                Load[q] += Child[k].flops / r ;
+        }
+    }
+
+done:
+    CHOLMOD(free)(nsuper, sizeof(spinv_mpi_child), Child, Common) ;
+    CHOLMOD(free)(nranks, sizeof(double), Load, Common) ;
+    CHOLMOD(free)(nsuper+1, sizeof(double), Flops, Common) ;
+    CHOLMOD(free)(nsuper+1, sizeof(Int), Hi, Common) ;
+    CHOLMOD(free)(nsuper+1, sizeof(Int), Lo, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Next, Common) ;
+    CHOLMOD(free)(nsuper+1, sizeof(Int), Head, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Colsuper, Common) ;
+}
+
+
+
+
+/*
+ * Run of the compact layout that holds the position kl of L->x
+ */
+static size_t spinv_mpi_find (spinv_mpi_run *Run, size_t nrun, Int kl)
+{
+    size_t lo, hi, mid ;
+
+    lo = 0 ;
+    hi = nrun - 1 ;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo + 1) / 2 ;
+        if (Run[mid].start <= kl)
+            lo = mid ;
+        else
+            hi = mid - 1 ;
+    }
+    ASSERT (Run[lo].start <= kl && kl < Run[lo].end) ;
+    return (lo) ;
+}
+
+
+/*
+ * Compact layout of the rank: its own blocks and the positions of the parts
+ * Z_C it receives, as runs sorted by their positions in L->x.  Off[s] is the
+ * position of the own block of s in the compact array.  Returns the size of
+ * the compact array, with *rsize runs allocated in *Run and *nrun used.
+ */
+static size_t spinv_mpi_layout
+(
+    cholmod_factor *L,
+    Int *Parent,
+    Int *Owner,
+    int rank,
+    Int *map,
+    Int *Off,
+    spinv_mpi_run **Run,
+    size_t *nrun,
+    size_t *rsize,
+    cholmod_common *Common
+)
+{
+    spinv_mpi_run *R ;
+    Int *Super, *Lpi, *Lpx, *P ;
+    Int s, p, i, j, m2 ;
+    size_t k, m, nr, npos, size ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+
+    // Positions of the parts received, sorted
+    npos = 0 ;
+    nr = 0 ;
+    for (s = 0; s < L->nsuper; s++)
+    {
+        if (Owner[s] != rank)
+            continue ;
+        nr++ ;
+        p = Parent[s] ;
+        m2 = (Lpi[s+1] - Lpi[s]) - (Super[s+1] - Super[s]) ;
+        if (p >= 0 && Owner[p] != rank)
+            npos += (size_t) m2 * (m2+1) / 2 ;
+    }
+    P = CHOLMOD(malloc)(MAX (npos, 1), sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (0) ;
+    k = 0 ;
+    for (s = 0; s < L->nsuper; s++)
+    {
+        p = Parent[s] ;
+        if (Owner[s] != rank || p < 0 || Owner[p] == rank)
+            continue ;
+        m2 = (Lpi[s+1] - Lpi[s]) - (Super[s+1] - Super[s]) ;
+        CHOLMOD(spinv_super_map) (L, s, map) ;
+        for (j = 0; j < m2; j++)
+            for (i = j; i < m2; i++)
+                P[k++] = map[i+j*m2] ;
+    }
+    qsort (P, npos, sizeof (Int), spinv_mpi_compare_index) ;
+
+    // Runs of the own blocks and of the consecutive positions received
+    for (k = 0; k < npos; k++)
+    {
+        if (k == 0 || P[k] > P[k-1] + 1)
+            nr++ ;
+    }
+    R = CHOLMOD(malloc)(MAX (nr, 1), sizeof(spinv_mpi_run), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free)(MAX (npos, 1), sizeof(Int), P, Common) ;
+        return (0) ;
+    }
+    *rsize = MAX (nr, 1) ;
+    nr = 0 ;
+    for (s = 0; s < L->nsuper; s++)
+    {
+        if (Owner[s] != rank)
+            continue ;
+        R[nr].start = Lpx[s] ;
+        R[nr].end = Lpx[s+1] ;
+        nr++ ;
+    }
+    for (k = 0; k < npos; k++)
+    {
+        if (k == 0 || P[k] > P[k-1] + 1)
+            R[nr++].start = P[k] ;
+        R[nr-1].end = P[k] + 1 ;
+    }
+    CHOLMOD(free)(MAX (npos, 1), sizeof(Int), P, Common) ;
+
+    // Merge the runs that overlap or touch and place them
+    qsort (R, nr, sizeof (spinv_mpi_run), spinv_mpi_compare_run) ;
+    m = 0 ;
+    for (k = 0; k < nr; k++)
+    {
+        if (m > 0 && R[k].start <= R[m-1].end)
+            R[m-1].end = MAX (R[m-1].end, R[k].end) ;
+        else
+            R[m++] = R[k] ;
+    }
+    size = 0 ;
+    for (k = 0; k < m; k++)
+    {
+        R[k].local = size ;
+        size += R[k].end - R[k].start ;
+    }
+    for (s = 0; s < L->nsuper; s++)
+    {
+        if (Owner[s] != rank)
+            continue ;
+        k = spinv_mpi_find (R, m, Lpx[s]) ;
+        Off[s] = R[k].local + Lpx[s] - R[k].start ;
+    }
+    *Run = R ;
+    *nrun = m ;
+    return (size) ;
+}
+
+
+/*
+ * Indices of the lower triangle of V of the supernode s, as in
+ * CHOLMOD(spinv_super_map), in the compact array of the rank.  The
+ * consecutive positions of a column mostly lie in the same run.
+ */
+static void spinv_mpi_super_map
+(
+    cholmod_factor *L,
+    Int s,
+    Int *map,
+    spinv_mpi_run *Run,
+    size_t nrun
+)
+{
+    Int *Super, *Lpi ;
+    Int i, j, kl, m2 ;
+    size_t r ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    m2 = (Lpi[s+1] - Lpi[s]) - (Super[s+1] - Super[s]) ;
+    CHOLMOD(spinv_super_map) (L, s, map) ;
+    r = 0 ;
+    for (j = 0; j < m2; j++)
+    {
+        for (i = j; i < m2; i++)
+        {
+            kl = map[i+j*m2] ;
+            if (kl < Run[r].start || kl >= Run[r].end)
+                r = spinv_mpi_find (Run, nrun, kl) ;
+            map[i+j*m2] = Run[r].local + kl - Run[r].start ;
+        }
+    }
+}
+
+
+/*
+ * Inverse of the own supernode s in the compact array Xl, as
+ * CHOLMOD(spinv_supernode) with map already in the compact array
+ */
+static void spinv_mpi_supernode
+(
+    cholmod_factor *L,
+    Int s,
+    double *Xl,
+    Int *Off,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+)
+{
+    Int *Super, *Lpi, *Lpx ;
+    double *Lx, *Xs ;
+    Int i, j, ms, ns, m2 ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Lx = L->x ;
+
+    ns = Super[s+1] - Super[s] ;
+    ms = Lpi[s+1] - Lpi[s] ;
+    m2 = ms - ns ;
+    if (m2 > 0)
+        CHOLMOD(spinv_gather_lower) (V, Xl, map, m2) ;
+
+    CHOLMOD(spinv_block) (Lx + Lpx[s], Z, V, ms, ns, Common) ;
+
+    // The diagonal block is made exactly symmetric
+    Xs = Xl + Off[s] ;
+    for (j = 0; j < ns; j++)
+    {
+        for (i = j; i < ms; i++)
+        {
+            if (i < ns)
+                Xs[i+j*ms] = 0.5*(Z[i+j*ms]+Z[j+i*ms]) ;
+            else
+                Xs[i+j*ms] = Z[i+j*ms] ;
+        }
+    }
+}
+
+
+/*
+ * Part of the sparse inverse, or of its diagonal, in the own blocks of the
+ * rank, lower triangular like the result of cholmod_spinv
+ */
+static cholmod_sparse *spinv_mpi_part
+(
+    cholmod_factor *L,
+    Int *Owner,
+    int rank,
+    double *Xl,
+    Int *Off,
+    int diag,
+    cholmod_common *Common
+)
+{
+    cholmod_sparse *X ;
+    double *Xx ;
+    Int *Super, *Lpi, *Ls, *Lperm, *Xp, *Xi ;
+    Int n, s, i, j, k, ms, ns, psi0, ip, jp, jx ;
+    size_t nz ;
+    int pass ;
+
+    n = L->n ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Ls = L->s ;
+    Lperm = L->Perm ;
+
+    nz = 0 ;
+    for (s = 0; s < L->nsuper; s++)
+    {
+        if (Owner[s] != rank)
+            continue ;
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        nz += diag ? (size_t) ns : (size_t) ns*ms - (size_t) ns*(ns-1)/2 ;
+    }
+    X = CHOLMOD(allocate_sparse) (n, n, nz, TRUE, TRUE, -1, CHOLMOD_REAL,
+                                  Common) ;
+    if (X == NULL)
+        return (NULL) ;
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+
+    // Count the elements of each column, then place them
+    for (j = 0; j <= n; j++)
+        Xp[j] = 0 ;
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (s = 0; s < L->nsuper; s++)
+        {
+            if (Owner[s] != rank)
+                continue ;
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
+            {
+                jp = PERM(Super[s]+j) ;
+                for (i = j; i < (diag ? j+1 : ms); i++)
+                {
+                    ip = PERM(Ls[psi0+i]) ;
+                    jx = MIN(ip,jp) ;
+                    if (pass == 0)
+                    {
+                        Xp[jx+1]++ ;
+                        continue ;
+                    }
+                    k = Xp[jx]++ ;
+                    Xi[k] = MAX(ip,jp) ;
+                    Xx[k] = Xl[Off[s] + i + j*ms] ;
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (j = 0; j < n; j++)
+                Xp[j+1] += Xp[j] ;
+        }
+    }
+    for (j = n; j > 0; j--)
+        Xp[j] = Xp[j-1] ;
+    Xp[0] = 0 ;
+
+    for (j = 0; j < n; j++)
+        CHOLMOD(spinv_sort_column) (Xi + Xp[j], Xx + Xp[j], 1,
+                                    Xp[j+1] - Xp[j]) ;
+    return (X) ;
+}
+
+
+/*
+ * Datatype of the lower triangles of the columns of the supernodes of the
+ * rank r, with the block of s at Pos[s], one block per column.  Blen and
+ * Disp have n entries.
+ */
+static MPI_Datatype spinv_mpi_type
+(
+    cholmod_factor *L,
+    Int *Owner,
+    int r,
+    Int *Pos,
+    int *Blen,
+    MPI_Aint *Disp
+)
+{
+    MPI_Datatype type ;
+    Int *Super, *Lpi ;
+    Int s, j, ms, ns ;
+    int count ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+
+    count = 0 ;
+    for (s = 0; s < L->nsuper; s++)
+    {
+        if (Owner[s] != r)
+            continue ;
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        for (j = 0; j < ns; j++)
+        {
+            Blen[count] = ms - j ;
+            Disp[count] = (MPI_Aint) (Pos[s] + j + j*ms) * sizeof (double) ;
+            count++ ;
+        }
+    }
+    MPI_Type_create_hindexed (count, Blen, Disp, MPI_DOUBLE, &type) ;
+    MPI_Type_commit (&type) ;
+    return (type) ;
+}
+
+
+cholmod_sparse *CHOLMOD(spinv_mpi)   /* returns the part of the rank */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* supernodal factorization, the same on every rank */
+    int diag,		/* TRUE for only the diagonal */
+    int root,		/* rank that gets the whole result, or
+			   CHOLMOD_SPINV_MPI_LOCAL */
+    MPI_Comm comm,	/* ranks that share the work */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *X ;
+    MPI_Datatype type ;
+    MPI_Request *Request ;
+    MPI_Aint *Disp ;
+    spinv_mpi_run *Run ;
+    double *Xl, *Xf, *V, *Z, *Buffer, *d, *Xx ;
+    Int *Super, *Lpi, *Lpx, *Lperm, *Parent, *Owner, *Off, *map, *Xp, *Xi ;
+    Int n, nsuper, s, p, i, j, ms, ns, m2 ;
+    size_t fsize, lsize, vsize, zsize, bsize, nrun, rsize, nv, off, t ;
+    int *Blen ;
+    int rank, nranks, nreq, nsend, status, r ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_REAL, NULL) ;
+    Common->status = CHOLMOD_OK ;
+    if (!L->is_super)
+    {
+        ERROR (CHOLMOD_INVALID, "supernodal factor required") ;
+        return (NULL) ;
+    }
+    MPI_Comm_rank (comm, &rank) ;
+    MPI_Comm_size (comm, &nranks) ;
+    if (root < CHOLMOD_SPINV_MPI_LOCAL || root >= nranks)
+    {
+        ERROR (CHOLMOD_INVALID, "invalid root rank") ;
+        return (NULL) ;
+    }
+    // The columns are the blocks of the datatypes and the diagonal is one
+    // message
+    if (L->n > INT_MAX)
+    {
+        ERROR (CHOLMOD_TOO_LARGE, "problem too large") ;
+        return (NULL) ;
+    }
+
+    n = L->n ;
+    nsuper = L->nsuper ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Lperm = L->Perm ;
+
+    /* ---------------------------------------------------------------------- */
+    /* mapping, compact layout and workspace */
+    /* ---------------------------------------------------------------------- */
+
+    fsize = CHOLMOD(spinv_layout_size) (L) ;
+    vsize = MAX (L->maxesize*L->maxesize, 1) ;
+    zsize = 1 ;
+    for (s = 0; s < nsuper; s++)
+        zsize = MAX (zsize, (size_t) (Lpx[s+1] - Lpx[s])) ;
+
+    Parent = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Owner = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Off = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    map = CHOLMOD(malloc)(vsize, sizeof(Int), Common) ;
+    if (Common->status >= CHOLMOD_OK)
+        spinv_mpi_map (L, nranks, Parent, Owner, Common) ;
+    Run = NULL ;
+    nrun = 0 ;
+    rsize = 0 ;
+    lsize = 0 ;
+    if (Common->status >= CHOLMOD_OK)
+        lsize = spinv_mpi_layout (L, Parent, Owner, rank, map, Off, &Run,
+                                  &nrun, &rsize, Common) ;
+
+    // One send buffer for all the messages of this rank
+    bsize = 0 ;
+    nreq = 0 ;
+    for (s = 0; Common->status >= CHOLMOD_OK && s < nsuper; s++)
+    {
+        p = Parent[s] ;
+        if (p >= 0 && Owner[p] == rank && Owner[s] != rank)
+        {
+            m2 = (Lpi[s+1] - Lpi[s]) - (Super[s+1] - Super[s]) ;
+            nv = (size_t) m2 * (m2+1) / 2 ;
+            bsize += nv ;
+            nreq += (nv + SPINV_MPI_CHUNK - 1) / SPINV_MPI_CHUNK ;
+        }
+    }
+
+    Xl = CHOLMOD(calloc)(MAX (lsize, 1), sizeof(double), Common) ;
+    V = CHOLMOD(malloc)(vsize, sizeof(double), Common) ;
+    Z = CHOLMOD(malloc)(zsize, sizeof(double), Common) ;
+    Buffer = CHOLMOD(malloc)(MAX (bsize, 1), sizeof(double), Common) ;
+    Request = CHOLMOD(malloc)(MAX (nreq, 1), sizeof(MPI_Request), Common) ;
+
+    // Go on only if every rank has its workspace
+    status = Common->status ;
+    MPI_Allreduce (MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, comm) ;
+    if (status < CHOLMOD_OK && Common->status >= CHOLMOD_OK)
+        ERROR (status, "failed on another rank") ;
+
+    /* ---------------------------------------------------------------------- */
+    /* supernodes from the root down, sending Z_C to the children */
+    /* ---------------------------------------------------------------------- */
+
+    X = NULL ;
+    nsend = 0 ;
+    off = 0 ;
+    for (s = nsuper - 1; status >= CHOLMOD_OK && s >= 0; s--)
+    {
+        p = Parent[s] ;
+        if (Owner[s] != rank && (p < 0 || Owner[p] != rank))
+            continue ;
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        m2 = ms - ns ;
+        nv = (size_t) m2 * (m2+1) / 2 ;
+        if (m2 > 0)
+            spinv_mpi_super_map (L, s, map, Run, nrun) ;
+        if (Owner[s] != rank)
+        {
+            t = off ;
+            for (j = 0; j < m2; j++)
+                for (i = j; i < m2; i++)
+                    Buffer[t++] = Xl[map[i+j*m2]] ;
+            for (t = 0; t < nv; t += SPINV_MPI_CHUNK)
+                MPI_Isend (Buffer + off + t,
+                           (int) MIN (nv - t, SPINV_MPI_CHUNK), MPI_DOUBLE,
+                           Owner[s], SPINV_MPI_TAG, comm, &Request[nsend++]) ;
+            off += nv ;
+            continue ;
+        }
+        if (p >= 0 && Owner[p] != rank)
+        {
+            for (t = 0; t < nv; t += SPINV_MPI_CHUNK)
+                MPI_Recv (V + t, (int) MIN (nv - t, SPINV_MPI_CHUNK),
+                          MPI_DOUBLE, Owner[p], SPINV_MPI_TAG, comm,
+                          MPI_STATUS_IGNORE) ;
+            t = 0 ;
+            for (j = 0; j < m2; j++)
+                for (i = j; i < m2; i++)
+                    Xl[map[i+j*m2]] = V[t++] ;
+        }
+        spinv_mpi_supernode (L, s, Xl, Off, V, Z, map, Common) ;
+    }
+    if (status >= CHOLMOD_OK)
+        MPI_Waitall (nsend, Request, MPI_STATUSES_IGNORE) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* the part of the rank, or the diagonal or the blocks gathered on root */
+    /* ---------------------------------------------------------------------- */
+
+    d = NULL ;
+    Blen = NULL ;
+    Disp = NULL ;
+    Xf = NULL ;
+    if (status >= CHOLMOD_OK && root == CHOLMOD_SPINV_MPI_LOCAL)
+    {
+        X = spinv_mpi_part (L, Owner, rank, Xl, Off, diag, Common) ;
+    }
+    else if (status >= CHOLMOD_OK)
+    {
+        d = diag ? CHOLMOD(calloc)(n, sizeof(double), Common) : NULL ;
+        Blen = diag ? NULL : CHOLMOD(malloc)(n, sizeof(int), Common) ;
+        Disp = diag ? NULL : CHOLMOD(malloc)(n, sizeof(MPI_Aint), Common) ;
+        if (!diag && rank == root)
+            Xf = CHOLMOD(malloc)(fsize, sizeof(double), Common) ;
+        status = Common->status ;
+        MPI_Allreduce (MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, comm) ;
+        if (status < CHOLMOD_OK && Common->status >= CHOLMOD_OK)
+            ERROR (status, "failed on another rank") ;
+    }
+
+    if (status >= CHOLMOD_OK && root != CHOLMOD_SPINV_MPI_LOCAL && diag)
+    {
+        for (s = 0; s < nsuper; s++)
+        {
+            if (Owner[s] != rank)
+                continue ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            for (j = 0; j < ns; j++)
+                d[PERM(Super[s]+j)] = Xl[Off[s] + j + j*ms] ;
+        }
+        MPI_Reduce ((rank == root) ? MPI_IN_PLACE : d, d, (int) n,
+                    MPI_DOUBLE, MPI_SUM, root, comm) ;
+        if (rank == root)
+        {
+            X = CHOLMOD(allocate_sparse) (n, n, n, TRUE, TRUE, -1,
+                                          CHOLMOD_REAL, Common) ;
+            if (X != NULL)
+            {
+                Xp = X->p ;
+                Xi = X->i ;
+                Xx = X->x ;
+                for (j = 0; j < n; j++)
+                {
+                    Xp[j] = j ;
+                    Xi[j] = j ;
+                    Xx[j] = d[j] ;
+                }
+                Xp[n] = n ;
+            }
+        }
+    }
+    else if (status >= CHOLMOD_OK && root != CHOLMOD_SPINV_MPI_LOCAL)
+    {
+        for (s = 0; rank == root && s < nsuper; s++)
+        {
+            if (Owner[s] == rank)
+                memcpy (Xf + Lpx[s], Xl + Off[s],
+                        (Lpx[s+1] - Lpx[s]) * sizeof (double)) ;
+        }
+        for (r = 0; r < nranks; r++)
+        {
+            if (r == root || (rank != root && rank != r))
+                continue ;
+            if (rank == root)
+            {
+                type = spinv_mpi_type (L, Owner, r, Lpx, Blen, Disp) ;
+                MPI_Recv (Xf, 1, type, r, SPINV_MPI_TAG, comm,
+                          MPI_STATUS_IGNORE) ;
+            }
+            else
+            {
+                type = spinv_mpi_type (L, Owner, r, Off, Blen, Disp) ;
+                MPI_Send (Xl, 1, type, root, SPINV_MPI_TAG, comm) ;
+            }
+            MPI_Type_free (&type) ;
+        }
+        if (rank == root)
+        {
+            // The compact array is no longer needed
+            Xl = CHOLMOD(free)(MAX (lsize, 1), sizeof(double), Xl, Common) ;
+            X = CHOLMOD(spinv_gather) (L, Xf, CHOLMOD_REAL, Common) ;
+        }
+    }
+
+    CHOLMOD(free)(fsize, sizeof(double), Xf, Common) ;
+    CHOLMOD(free)(n, sizeof(MPI_Aint), Disp, Common) ;
+    CHOLMOD(free)(n, sizeof(int), Blen, Common) ;
+    CHOLMOD(free)(n, sizeof(double), d, Common) ;
+    CHOLMOD(free)(MAX (nreq, 1), sizeof(MPI_Request), Request, Common) ;
+    CHOLMOD(free)(MAX (bsize, 1), sizeof(double), Buffer, Common) ;
+    CHOLMOD(free)(zsize, sizeof(double), Z, Common) ;
+    CHOLMOD(free)(vsize, sizeof(double), V, Common) ;
+    CHOLMOD(free)(MAX (lsize, 1), sizeof(double), Xl, Common) ;
+    CHOLMOD(free)(rsize, sizeof(spinv_mpi_run), Run, Common) ;
+    CHOLMOD(free)(vsize, sizeof(Int), map, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Off, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Owner, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Parent, Common) ;
+    return (X) ;
+}
@@ -0,0 +1,622 @@
+/* ========================================================================== */
+/* === cholmod_spinv_ooc ==================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_ooc.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ *
+ * Out-of-core sparse inverse: cholmod_spinv_file writes the sparse inverse
+ * to a file in the binary format of cholmod-spinv (see
+ * cholmod_spinv_cli.c) with a budget for the memory of the inverse.
+ *
+ * The array of the inverse in the layout of L->x (Xf) is allocated as
+ * usual if it takes at most half of the budget.  Otherwise it is mapped
+ * from an unlinked scratch file, in the directory CHOLMOD_SPINV_SCRATCH or
+ * else next to the output file.  The supernodes are then done one at a time
+ * from the root down.  A supernode needs the inverse only at its ancestors,
+ * and a supernode is finished once its last descendant is done.  The blocks
+ * of finished supernodes are dropped from memory (MADV_DONTNEED), so the
+ * kernel writes them to the scratch file.  Thus only the blocks on the path
+ * from the current supernode to the root stay resident.  The block of the
+ * factor and the parent block of the next supernode are prefetched
+ * (MADV_WILLNEED).  If the factor itself exceeds the budget, its blocks are
+ * paged out once they are used (MADV_PAGEOUT, where available).  A
+ * simplicial factor is done in place in the mapped array, which the kernel
+ * pages as needed.
+ *
+ * The result is written in windows of columns whose elements take at most
+ * half of the budget, so the result is never in memory at once.  If there
+ * is more than one window, a single sequential pass over Xf puts each
+ * element to the region of its window in a scratch bucket file, through a
+ * buffer per window.  Each window then reads its region sequentially and
+ * is sorted and written with pwrite.  Thus Xf is read once and the buckets
+ * are written and read once, whatever the number of windows.  Only real
+ * factors are supported, as the format stores real values.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define SPINV_FILE_MAGIC "CSPINV01"
+
+// Header of the binary format, all fields are 8 bytes
+typedef struct spinv_file_header_struct
+{
+    char magic [8] ;
+    int64_t nrow, ncol, nnz, stype ;
+} spinv_file_header ;
+
+// Element of the result in the bucket file
+typedef struct spinv_entry_struct
+{
+    int64_t i, j ;
+    double x ;
+} spinv_entry ;
+
+/*
+ * Advice for the pages of the n bytes at p: the pages that overlap them
+ * (outer) or only the pages inside them (to drop a block without its
+ * neighbours).
+ */
+static void spinv_advise (void *p, size_t n, int advice, int outer)
+{
+    size_t page = (size_t) sysconf (_SC_PAGESIZE) ;
+    uintptr_t a = (uintptr_t) p ;
+    uintptr_t b = a + n ;
+
+    if (outer)
+    {
+        a -= a % page ;
+        b += (page - b % page) % page ;
+    }
+    else
+    {
+        a += (page - a % page) % page ;
+        b -= b % page ;
+    }
+    if (b > a)
+        madvise ((void *) a, b - a, advice) ;
+}
+
+// Scratch array of n doubles mapped from an unlinked file, NULL on failure
+static double *spinv_scratch (const char *filename, size_t n)
+{
+    const char *dir, *slash ;
+    char *path ;
+    size_t len, bytes ;
+    void *p ;
+    int fd ;
+
+    dir = getenv ("CHOLMOD_SPINV_SCRATCH") ;
+    slash = strrchr (filename, '/') ;
+    if (dir != NULL)
+        len = strlen (dir) ;
+    else if (slash != NULL)
+        len = slash - filename ;
+    else
+        len = 1 ;
+    path = malloc (len + 32) ;
+    if (path == NULL)
+        return (NULL) ;
+    memcpy (path, (dir != NULL) ? dir : (slash != NULL) ? filename : ".",
+            len) ;
+    strcpy (path + len, "/.cholmod-spinv-XXXXXX") ;
+
+    fd = mkstemp (path) ;
+    if (fd >= 0)
+        unlink (path) ;
+    free (path) ;
+    if (fd < 0)
+        return (NULL) ;
+    bytes = MAX (n, 1) * sizeof(double) ;
+    p = MAP_FAILED ;
+    if (ftruncate (fd, (off_t) bytes) == 0)
+        p = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+    close (fd) ;
+    return ((p == MAP_FAILED) ? NULL : p) ;
+}
+
+/*
+ * Supernodal inverse from the root down, dropping the blocks of the
+ * finished supernodes.  First[p] is the smallest supernode in the subtree
+ * of p, so p is finished once First[p] is done.
+ */
+static int spinv_super_spill
+(
+    cholmod_factor *L,
+    double *Xf,
+    int pageout,
+    cholmod_common *Common
+)
+{
+    double *V, *Z, *Lx ;
+    Int *Super, *Lpi, *Lpx, *Ls, *W, *Colsuper, *Parent, *First, *Next,
+        *Head, *map ;
+    Int n, nsuper, s, p, j, ms, ns ;
+    size_t vsize, zsize, wsize ;
+
+    n = L->n ;
+    nsuper = L->nsuper ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Ls = L->s ;
+    Lx = L->x ;
+
+    wsize = n + 4*((size_t) nsuper) ;
+    W = CHOLMOD(malloc)(wsize, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (FALSE) ;
+    Colsuper = W ;
+    Parent = W + n ;
+    First = Parent + nsuper ;
+    Next = First + nsuper ;
+    Head = Next + nsuper ;
+
+    // Supernodal elimination tree, a parent comes after its children
+    zsize = 1 ;
+    for (s = 0; s < nsuper; s++)
+    {
+        for (j = Super[s]; j < Super[s+1]; j++)
+            Colsuper[j] = s ;
+        zsize = MAX (zsize, (size_t) (Lpx[s+1] - Lpx[s])) ;
+    }
+    for (s = 0; s < nsuper; s++)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        Parent[s] = (ms > ns) ? Colsuper[Ls[Lpi[s]+ns]] : -1 ;
+        First[s] = s ;
+        Head[s] = -1 ;
+    }
+    for (s = 0; s < nsuper; s++)
+    {
+        if (Parent[s] >= 0)
+            First[Parent[s]] = MIN (First[Parent[s]], First[s]) ;
+        Next[s] = Head[First[s]] ;
+        Head[First[s]] = s ;
+    }
+
+    vsize = MAX (L->maxesize*L->maxesize, 1) ;
+    V = CHOLMOD(spinv_malloc)(vsize, sizeof(double), Common) ;
+    Z = CHOLMOD(spinv_malloc)(zsize, sizeof(double), Common) ;
+    map = CHOLMOD(spinv_malloc)(vsize, sizeof(Int), Common) ;
+    if (Common->status >= CHOLMOD_OK)
+    {
+        for (s = nsuper - 1; s >= 0; s--)
+        {
+            if (s > 0)
+            {
+                spinv_advise (Lx + Lpx[s-1], (Lpx[s] - Lpx[s-1]) *
+                              sizeof(double), MADV_WILLNEED, TRUE) ;
+                p = Parent[s-1] ;
+                if (p >= 0)
+                    spinv_advise (Xf + Lpx[p], (Lpx[p+1] - Lpx[p]) *
+                                  sizeof(double), MADV_WILLNEED, TRUE) ;
+            }
+
+            CHOLMOD(spinv_supernode) (L, s, Xf, V, Z, map, Common) ;
+
+            for (p = Head[s]; p >= 0; p = Next[p])
+                spinv_advise (Xf + Lpx[p], (Lpx[p+1] - Lpx[p]) *
+                              sizeof(double), MADV_DONTNEED, FALSE) ;
+#ifdef MADV_PAGEOUT
+            if (pageout)
+                spinv_advise (Lx + Lpx[s], (Lpx[s+1] - Lpx[s]) *
+                              sizeof(double), MADV_PAGEOUT, FALSE) ;
+#endif
+        }
+    }
+
+    CHOLMOD(spinv_free)(vsize, sizeof(Int), map, Common) ;
+    CHOLMOD(spinv_free)(zsize, sizeof(double), Z, Common) ;
+    CHOLMOD(spinv_free)(vsize, sizeof(double), V, Common) ;
+    CHOLMOD(free)(wsize, sizeof(Int), W, Common) ;
+    return (Common->status >= CHOLMOD_OK) ;
+}
+
+// Writes all n bytes at offset, FALSE on failure
+static int spinv_pwrite (int fd, const void *buf, size_t n, off_t offset)
+{
+    const char *b = buf ;
+    ssize_t k ;
+
+    while (n > 0)
+    {
+        k = pwrite (fd, b, n, offset) ;
+        if (k <= 0)
+            return (FALSE) ;
+        b += k ;
+        n -= k ;
+        offset += k ;
+    }
+    return (TRUE) ;
+}
+
+// Buckets of the windows of the result, see spinv_bucket
+typedef struct spinv_buckets_struct
+{
+    spinv_entry *E ;	/* buffers of the windows, bsize elements each */
+    spinv_entry *Bucket ;	/* bucket file, the regions of the windows */
+    size_t *Fill ;	/* next free element of the region of each window */
+    Int *Cnt ;		/* elements in the buffer of each window */
+    Int *Win ;		/* window of each column */
+    size_t bsize ;
+} spinv_buckets ;
+
+static void spinv_bucket_add
+(
+    spinv_buckets *b,
+    Int ix,
+    Int jx,
+    double x
+)
+{
+    Int w = b->Win[jx] ;
+    spinv_entry *e = b->E + w*b->bsize ;
+
+    e[b->Cnt[w]].i = ix ;
+    e[b->Cnt[w]].j = jx ;
+    e[b->Cnt[w]].x = x ;
+    if ((size_t) ++b->Cnt[w] == b->bsize)
+    {
+        memcpy (b->Bucket + b->Fill[w], e, b->bsize * sizeof(spinv_entry)) ;
+        spinv_advise (b->Bucket + b->Fill[w], b->bsize * sizeof(spinv_entry),
+                      MADV_DONTNEED, FALSE) ;
+        b->Fill[w] += b->bsize ;
+        b->Cnt[w] = 0 ;
+    }
+}
+
+/*
+ * Puts every element of the inverse to the region of its window in the
+ * bucket file, through the buffers of the windows.  Xf is read once, in
+ * its order.
+ */
+static void spinv_bucket
+(
+    cholmod_factor *L,
+    double *Xf,
+    Int nwin,
+    spinv_buckets *b
+)
+{
+    Int *Super, *Lpi, *Lpx, *Ls, *Lp, *Li, *Lperm ;
+    Int s, i, j, ms, ns, psi0, kl, ip, jp, w ;
+
+    Lperm = L->Perm ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    Ls = L->s ;
+    Lp = L->p ;
+    Li = L->i ;
+
+    if (L->is_super)
+    {
+        for (s = 0; s < (Int) L->nsuper; s++)
+        {
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
+            {
+                jp = PERM(Super[s]+j) ;
+                for (i = j; i < ms; i++)
+                {
+                    ip = PERM(Ls[psi0+i]) ;
+                    kl = Lpx[s] + i + j*ms ;
+                    spinv_bucket_add (b, MAX(ip,jp), MIN(ip,jp), Xf[kl]) ;
+                }
+            }
+        }
+    }
+    else
+    {
+        for (j = 0; j < (Int) L->n; j++)
+        {
+            jp = PERM(j) ;
+            for (kl = Lp[j]; kl < Lp[j+1]; kl++)
+            {
+                ip = PERM(Li[kl]) ;
+                spinv_bucket_add (b, MAX(ip,jp), MIN(ip,jp), Xf[kl]) ;
+            }
+        }
+    }
+
+    for (w = 0; w < nwin; w++)
+    {
+        memcpy (b->Bucket + b->Fill[w], b->E + w*b->bsize,
+                b->Cnt[w] * sizeof(spinv_entry)) ;
+    }
+}
+
+/*
+ * Writes the sparse inverse from Xf to the file fd in windows of columns
+ * with at most wmax elements (or a single longer column).  With more than
+ * one window, the elements are first put to their windows in a bucket file
+ * next to filename (see spinv_scratch).
+ */
+static int spinv_write_windows
+(
+    cholmod_factor *L,
+    double *Xf,
+    int fd,
+    const char *filename,
+    size_t wmax,
+    cholmod_common *Common
+)
+{
+    spinv_file_header h ;
+    spinv_buckets bk ;
+    spinv_entry *e ;
+    double *Wx ;
+    int64_t *B ;
+    Int *Xp, *Cur, *Wi, *Start ;
+    Int n, nitems, c0, c1, jx, k, w, nwin ;
+    size_t nz, len, wsize, bsize ;
+    off_t off_i, off_x ;
+    int ok ;
+
+    n = L->n ;
+    nitems = L->is_super ? (Int) L->nsuper : n ;
+
+    // Column counts and pointers, and the windows
+    Xp = CHOLMOD(calloc)(n+1, sizeof(Int), Common) ;
+    Cur = CHOLMOD(malloc)(n+1, sizeof(Int), Common) ;
+    Start = CHOLMOD(malloc)(n+1, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free)(n+1, sizeof(Int), Start, Common) ;
+        CHOLMOD(free)(n+1, sizeof(Int), Cur, Common) ;
+        CHOLMOD(free)(n+1, sizeof(Int), Xp, Common) ;
+        return (FALSE) ;
+    }
+    CHOLMOD(spinv_gather_range) (L, Xf, CHOLMOD_REAL, 0, nitems, 0, n, Xp,
+                                 NULL, NULL, 0) ;
+    nz = 0 ;
+    for (jx = 0; jx < n; jx++)
+    {
+        len = Xp[jx] ;
+        Xp[jx] = nz ;
+        nz += len ;
+        wmax = MAX (wmax, len) ;
+    }
+    Xp[n] = nz ;
+    wsize = MAX (MIN (wmax, nz), 1) ;
+
+    // Cur holds the window of each column until the windows are written
+    nwin = 0 ;
+    for (c0 = 0; c0 < n; c0 = c1)
+    {
+        for (c1 = c0 + 1; c1 < n && (size_t) (Xp[c1+1] - Xp[c0]) <= wsize;
+             c1++)
+            ;
+        for (jx = c0; jx < c1; jx++)
+            Cur[jx] = nwin ;
+        Start[nwin++] = c0 ;
+    }
+    Start[nwin] = n ;
+
+    /*
+     * A single pass over Xf to the buckets, with the buffers of the windows
+     * taking about as much memory as a window
+     */
+    ok = TRUE ;
+    bk.Bucket = NULL ;
+    if (nwin > 1)
+    {
+        bk.bsize = MAX (wsize / nwin, 1) ;
+        bk.Win = Cur ;
+        bk.E = CHOLMOD(malloc)(bk.bsize*nwin, sizeof(spinv_entry), Common) ;
+        bk.Fill = CHOLMOD(malloc)(nwin, sizeof(size_t), Common) ;
+        bk.Cnt = CHOLMOD(calloc)(nwin, sizeof(Int), Common) ;
+        if (Common->status >= CHOLMOD_OK)
+        {
+            bk.Bucket = (spinv_entry *) spinv_scratch (filename, nz *
+                (sizeof(spinv_entry) / sizeof(double))) ;
+            if (bk.Bucket == NULL)
+                ERROR (CHOLMOD_OUT_OF_MEMORY, "cannot map the scratch file") ;
+        }
+        if (bk.Bucket != NULL)
+        {
+            for (w = 0; w < nwin; w++)
+                bk.Fill[w] = Xp[Start[w]] ;
+            spinv_bucket (L, Xf, nwin, &bk) ;
+            madvise (bk.Bucket, nz * sizeof(spinv_entry), MADV_SEQUENTIAL) ;
+        }
+        CHOLMOD(free)(nwin, sizeof(Int), bk.Cnt, Common) ;
+        CHOLMOD(free)(nwin, sizeof(size_t), bk.Fill, Common) ;
+        CHOLMOD(free)(bk.bsize*nwin, sizeof(spinv_entry), bk.E, Common) ;
+        ok = (bk.Bucket != NULL) ;
+    }
+
+    bsize = MAX (wsize, (size_t) n+1) ;
+    Wi = CHOLMOD(malloc)(wsize, sizeof(Int), Common) ;
+    Wx = CHOLMOD(malloc)(wsize, sizeof(double), Common) ;
+    B = CHOLMOD(malloc)(bsize, sizeof(int64_t), Common) ;
+
+    // Header and column pointers
+    memcpy (h.magic, SPINV_FILE_MAGIC, 8) ;
+    h.nrow = n ;
+    h.ncol = n ;
+    h.nnz = nz ;
+    h.stype = -1 ;
+    off_i = sizeof(h) + (n+1) * sizeof(int64_t) ;
+    off_x = off_i + nz * sizeof(int64_t) ;
+    ok = ok && (Common->status >= CHOLMOD_OK) ;
+    if (ok)
+    {
+        for (jx = 0; jx <= n; jx++)
+            B[jx] = Xp[jx] ;
+        ok = spinv_pwrite (fd, &h, sizeof(h), 0)
+            && spinv_pwrite (fd, B, (n+1) * sizeof(int64_t), sizeof(h)) ;
+    }
+
+    // Windows of columns c0..c1-1, from the bucket or else from Xf
+    for (w = 0; ok && w < nwin; w++)
+    {
+        c0 = Start[w] ;
+        c1 = Start[w+1] ;
+        len = Xp[c1] - Xp[c0] ;
+        for (jx = c0; jx < c1; jx++)
+            Cur[jx] = Xp[jx] - Xp[c0] ;
+        if (bk.Bucket != NULL)
+        {
+            e = bk.Bucket + Xp[c0] ;
+            for (k = 0; k < (Int) len; k++)
+            {
+                jx = Cur[e[k].j]++ ;
+                Wi[jx] = e[k].i ;
+                Wx[jx] = e[k].x ;
+            }
+            spinv_advise (e, len * sizeof(spinv_entry), MADV_DONTNEED,
+                          FALSE) ;
+        }
+        else
+        {
+            CHOLMOD(spinv_gather_range) (L, Xf, CHOLMOD_REAL, 0, nitems, c0,
+                                         c1, Cur, Wi, Wx, 1) ;
+        }
+        for (jx = c0; jx < c1; jx++)
+            CHOLMOD(spinv_sort_column) (Wi + Xp[jx] - Xp[c0],
+                                        Wx + Xp[jx] - Xp[c0], 1,
+                                        Xp[jx+1] - Xp[jx]) ;
+        for (k = 0; k < (Int) len; k++)
+            B[k] = Wi[k] ;
+        ok = spinv_pwrite (fd, B, len * sizeof(int64_t),
+                           off_i + Xp[c0] * sizeof(int64_t))
+            && spinv_pwrite (fd, Wx, len * sizeof(double),
+                             off_x + Xp[c0] * sizeof(double)) ;
+    }
+
+    if (bk.Bucket != NULL)
+        munmap (bk.Bucket, MAX (nz * sizeof(spinv_entry), sizeof(double))) ;
+    CHOLMOD(free)(bsize, sizeof(int64_t), B, Common) ;
+    CHOLMOD(free)(wsize, sizeof(double), Wx, Common) ;
+    CHOLMOD(free)(wsize, sizeof(Int), Wi, Common) ;
+    CHOLMOD(free)(n+1, sizeof(Int), Start, Common) ;
+    CHOLMOD(free)(n+1, sizeof(Int), Cur, Common) ;
+    CHOLMOD(free)(n+1, sizeof(Int), Xp, Common) ;
+    if (!ok && Common->status >= CHOLMOD_OK)
+    {
+        ERROR (CHOLMOD_INVALID, "cannot write the file") ;
+    }
+    return (ok) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_file =================================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_file)
+(
+    /* ---- input ---- */
+    cholmod_factor *L,		/* factorization to use */
+    const char *filename,	/* output file, binary format */
+    size_t budget,		/* bytes of memory for the inverse */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    double *Xf ;
+    size_t fsize, wmax ;
+    int mapped, ok, fd ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    RETURN_IF_NULL (L, FALSE) ;
+    RETURN_IF_NULL (filename, FALSE) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_REAL, FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+    if (fd < 0)
+    {
+        ERROR (CHOLMOD_INVALID, "cannot open the file") ;
+        return (FALSE) ;
+    }
+
+    /*
+     * The inverse in the layout of L->x, in memory if it takes at most half
+     * of the budget and otherwise in a scratch file
+     */
+    fsize = CHOLMOD(spinv_layout_size) (L) ;
+    mapped = (fsize > budget / (2 * sizeof(double))) ;
+    if (mapped)
+    {
+        Xf = spinv_scratch (filename, fsize) ;
+        if (Xf == NULL)
+        {
+            close (fd) ;
+            ERROR (CHOLMOD_OUT_OF_MEMORY, "cannot map the scratch file") ;
+            return (FALSE) ;
+        }
+    }
+    else
+    {
+        Xf = CHOLMOD(spinv_malloc)(fsize, sizeof(double), Common) ;
+        if (Common->status < CHOLMOD_OK)
+        {
+            close (fd) ;
+            return (FALSE) ;
+        }
+    }
+
+    if (mapped && L->is_super)
+        ok = spinv_super_spill (L, Xf, fsize > budget / sizeof(double),
+                                Common) ;
+    else
+        ok = CHOLMOD(spinv_numeric) (L, Xf, Common) ;
+
+    // Each window of the result takes half of the budget
+    if (ok)
+    {
+        if (mapped)
+            madvise (Xf, fsize * sizeof(double), MADV_SEQUENTIAL) ;
+        wmax = budget / (2 * sizeof(spinv_entry)) ;
+        ok = spinv_write_windows (L, Xf, fd, filename, wmax, Common) ;
+    }
+
+    if (mapped)
+        munmap (Xf, MAX (fsize, 1) * sizeof(double)) ;
+    else
+        CHOLMOD(spinv_free)(fsize, sizeof(double), Xf, Common) ;
+    ok = (close (fd) == 0) && ok ;
+    if (!ok && Common->status >= CHOLMOD_OK)
+    {
+        ERROR (CHOLMOD_INVALID, "cannot write the file") ;
+    }
+    return (ok) ;
+}
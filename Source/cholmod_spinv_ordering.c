@@ -0,0 +1,193 @@
+/* ========================================================================== */
+/* === cholmod_spinv_ordering =============================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_ordering.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Fill-reducing ordering chosen for the cost of the sparse inverse.
+ * cholmod_analyze picks the ordering with the least flops of the
+ * factorization, but the recursion of cholmod_spinv costs
+ * 2*m2^2*ns + 2*ns^2*m2 + ns^3 + ms*ns^2 flops for a supernode with ns
+ * columns, ms rows and m2 = ms - ns, and its workspace grows as
+ * maxesize^2.  This weighs the supernodes differently from the cost of
+ * the factorization, so the ordering with the cheapest factorization is
+ * not always the one with the cheapest inverse.
+ *
+ * cholmod_spinv_analyze_ordering runs cholmod_analyze with each of AMD,
+ * METIS, NESDIS and COLAMD (METIS and NESDIS only with the Partition
+ * module), estimates the cost of the sparse inverse from each symbolic
+ * factor with cholmod_spinv_estimate and returns the symbolic factor with
+ * the least flops (the least memory on a tie).  The settings of Common
+ * (nmethods and method[0]) are restored, and Common->fl and Common->lnz
+ * describe the returned factor.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+int CHOLMOD(spinv_estimate)
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* symbolic or numerical factorization */
+    /* ---- output --- */
+    double *flops,	/* flops of the recursion, or NULL */
+    double *bytes,	/* memory of the result and workspace, or NULL */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    Int *Super, *Lpi, *ColCount ;
+    Int s, j ;
+    double fl, ms, ns, m2, nj, nz, vsize, maxnj ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    RETURN_IF_NULL (L, FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    /*
+     * Same kernels as cholmod_spinv: per supernode a symmetric product with
+     * the m2-by-m2 part V of the inverse, a product with the diagonal block
+     * and the triangular solves; per simplicial column a dsymv and a ddot.
+     * The number of rows of a simplicial column is taken from ColCount,
+     * which a symbolic simplicial factor also has.
+     */
+    fl = 0 ;
+    nz = 0 ;
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            m2 = ms - ns ;
+            fl += 2*m2*m2*ns + 2*ns*ns*m2 + ns*ns*ns + ms*ns*ns ;
+        }
+        nz = L->xsize ;
+        vsize = (double) L->maxesize * L->maxesize ;
+    }
+    else
+    {
+        ColCount = L->ColCount ;
+        maxnj = 0 ;
+        for (j = 0; j < L->n; j++)
+        {
+            nj = ColCount[j] - 1 ;
+            fl += 2*nj*nj + 2*nj ;
+            nz += ColCount[j] ;
+            maxnj = MAX (maxnj, nj) ;
+        }
+        vsize = maxnj * maxnj ;
+    }
+
+    if (flops != NULL)
+        *flops = fl ;
+    if (bytes != NULL)
+        *bytes = nz * sizeof (double)
+            + vsize * (sizeof (double) + sizeof (Int)) ;
+    return (TRUE) ;
+}
+
+
+cholmod_factor *CHOLMOD(spinv_analyze_ordering)  /* returns symbolic factor */
+(
+    /* ---- input ---- */
+    cholmod_sparse *A,	/* matrix to order and analyze */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    int candidates [ ] = {
+        CHOLMOD_AMD,
+#ifndef NPARTITION
+        CHOLMOD_METIS,
+        CHOLMOD_NESDIS,
+#endif
+        CHOLMOD_COLAMD } ;
+    int ncandidates = sizeof (candidates) / sizeof (candidates[0]) ;
+    cholmod_factor *L, *Lbest ;
+    struct cholmod_method_struct method0 ;
+    double fl, bytes, flbest, bytesbest, cfl, clnz ;
+    int nmethods, k ;
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (A, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    nmethods = Common->nmethods ;
+    method0 = Common->method[0] ;
+
+    Lbest = NULL ;
+    flbest = 0 ;
+    bytesbest = 0 ;
+    cfl = 0 ;
+    clnz = 0 ;
+    for (k = 0; k < ncandidates; k++)
+    {
+        Common->nmethods = 1 ;
+        Common->method[0].ordering = candidates[k] ;
+        L = CHOLMOD(analyze) (A, Common) ;
+        if (L == NULL)
+        {
+            // Ordering not available, e.g. METIS in this build of CHOLMOD
+            if (Common->status == CHOLMOD_OUT_OF_MEMORY)
+                break ;
+            Common->status = CHOLMOD_OK ;
+            continue ;
+        }
+        CHOLMOD(spinv_estimate) (L, &fl, &bytes, Common) ;
+        if (Lbest == NULL || fl < flbest
+            || (fl == flbest && bytes < bytesbest))
+        {
+            CHOLMOD(free_factor) (&Lbest, Common) ;
+            Lbest = L ;
+            flbest = fl ;
+            bytesbest = bytes ;
+            cfl = Common->fl ;
+            clnz = Common->lnz ;
+        }
+        else
+        {
+            CHOLMOD(free_factor) (&L, Common) ;
+        }
+    }
+
+    Common->nmethods = nmethods ;
+    Common->method[0] = method0 ;
+    if (Lbest == NULL)
+    {
+        if (Common->status == CHOLMOD_OK)
+            ERROR (CHOLMOD_INVALID, "no ordering succeeded") ;
+        return (NULL) ;
+    }
+    Common->fl = cfl ;
+    Common->lnz = clnz ;
+    Common->status = CHOLMOD_OK ;
+    return (Lbest) ;
+}
@@ -0,0 +1,752 @@
+/* ========================================================================== */
+/* === cholmod_spinv_plan =================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_plan.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Symbolic plan of the sparse inverse.  A service that computes sparse
+ * inverses of matrices with a few fixed patterns spends its start-up time
+ * in the ordering, cholmod_analyze and the symbolic part of cholmod_spinv
+ * (the pattern of the result and the positions of its elements in the
+ * layout of L).  The plan holds all of these and is written to a file once:
+ *
+ *   L = cholmod_analyze (A, c) ;  cholmod_factorize (A, L, c) ;
+ *   Plan = cholmod_spinv_plan_create (L, c) ;
+ *   cholmod_spinv_plan_save (Plan, "A.plan", c) ;
+ *
+ * A worker then maps the file and does only numerical work:
+ *
+ *   Plan = cholmod_spinv_plan_load ("A.plan", c) ;
+ *   L = cholmod_spinv_plan_factor (Plan, c) ;	(instead of cholmod_analyze)
+ *   cholmod_factorize (A, L, c) ;
+ *   X = cholmod_spinv_plan_numeric (Plan, L, c) ;	(like cholmod_spinv)
+ *
+ * The file is the memory image of the plan: a header followed by the
+ * arrays, each padded to 8 bytes.  cholmod_spinv_plan_load maps it with
+ * mmap, read-only and shared, so it is not parsed or copied and the workers
+ * on one host share one copy in the page cache.  Only the arrays of the
+ * symbolic factor, O(n + nsuper + ssize), are copied into the factor that
+ * cholmod_factorize fills.  The header has a version, the byte order and
+ * the width of Int of the writer; a plan is loaded only by the same build
+ * (cholmod_* or cholmod_l_*) on a machine with the same byte order.  The
+ * arrays are trusted, only their sizes are checked.
+ *
+ * cholmod_spinv_plan_numeric checks that L has the same permutation and
+ * layout (supernodes or columns, with their row indices) as the plan, which holds if L was
+ * factorized from cholmod_spinv_plan_factor with the same Common settings
+ * (e.g. final_super, final_pack) as the factor that made the plan.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SPINV_PLAN_MAGIC "CSPVPLAN"
+#define SPINV_PLAN_VERSION 3
+#define SPINV_PLAN_ENDIAN 0x01020304
+
+// Header of the plan file, followed by the arrays
+typedef struct
+{
+    char magic [8] ;
+    uint32_t version ;
+    uint32_t endian ;	/* SPINV_PLAN_ENDIAN in the byte order of the writer */
+    uint32_t intsize ;	/* sizeof (Int) of the writer */
+    uint32_t is_super ;
+    uint64_t n, nzx, nlayout, nsuper, ssize, maxcsize, maxesize, ordering ;
+} spinv_plan_header ;
+
+#define PAD8(bytes) (((bytes) + 7) & ~((size_t) 7))
+
+
+/*
+ * Point the arrays of Plan into Plan->data (or set them NULL if data is
+ * NULL) from the sizes in Plan.  Returns the size of the image in bytes.
+ */
+static size_t spinv_plan_arrays
+(
+    cholmod_spinv_plan *Plan
+)
+{
+    char *data = Plan->data ;
+    size_t nsuper1 = Plan->is_super ? Plan->nsuper + 1 : 0 ;
+    size_t offset = PAD8 (sizeof (spinv_plan_header)) ;
+    void **array [11] = { &Plan->Perm, &Plan->ColCount, &Plan->super,
+                          &Plan->pi, &Plan->px, &Plan->s, &Plan->p,
+                          &Plan->i, &Plan->Xp, &Plan->Xi, &Plan->Xmap } ;
+    size_t count [11] = { Plan->n, Plan->n, nsuper1,
+                          nsuper1, nsuper1, Plan->is_super ? Plan->ssize : 0,
+                          Plan->is_super ? 0 : Plan->n + 1,
+                          Plan->is_super ? 0 : Plan->nzx,
+                          Plan->n + 1, Plan->nzx, Plan->nzx } ;
+    int k ;
+
+    for (k = 0; k < 11; k++)
+    {
+        *array[k] = (data != NULL && count[k] > 0) ? data + offset : NULL ;
+        offset += PAD8 (count[k] * sizeof (Int)) ;
+    }
+    return (offset) ;
+}
+
+
+/*
+ * Position of X[ix,jx] in the sorted pattern Xp, Xi
+ */
+static Int spinv_plan_find
+(
+    Int *Xp,
+    Int *Xi,
+    Int ix,
+    Int jx
+)
+{
+    Int lo, hi, mid ;
+
+    lo = Xp[jx] ;
+    hi = Xp[jx+1] - 1 ;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2 ;
+        if (Xi[mid] < ix)
+            lo = mid + 1 ;
+        else
+            hi = mid ;
+    }
+    return (lo) ;
+}
+
+
+/*
+ * Xmap[k] for the k-th element of the lower triangle of the layout, in the
+ * same order as cholmod_spinv_gather visits them.  The strictly upper parts
+ * of the diagonal blocks of a supernodal layout have no entries, so Xmap has
+ * exactly nzx entries.
+ */
+static void spinv_plan_map
+(
+    cholmod_factor *L,
+    cholmod_spinv_plan *Plan
+)
+{
+    Int *Super, *Ls, *Lpi, *Lp, *Li, *Lperm, *Xp, *Xi, *Xmap ;
+    Int n, s, i, j, ms, ns, psi0, k, kl, kx, ip, jp ;
+
+    n = L->n ;
+    Lperm = L->Perm ;
+    Xp = Plan->Xp ;
+    Xi = Plan->Xi ;
+    Xmap = Plan->Xmap ;
+    k = 0 ;
+
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        Ls = L->s ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            psi0 = Lpi[s] ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - psi0 ;
+            for (j = 0; j < ns; j++)
+            {
+                jp = PERM(Super[s]+j) ;
+                for (i = j; i < ms; i++)
+                {
+                    ip = PERM(Ls[psi0+i]) ;
+                    kx = spinv_plan_find (Xp, Xi, MAX(ip,jp), MIN(ip,jp)) ;
+                    Xmap[k++] = (ip < jp) ? -1-kx : kx ;
+                }
+            }
+        }
+    }
+    else
+    {
+        Lp = L->p ;
+        Li = L->i ;
+        for (j = 0; j < n; j++)
+        {
+            jp = PERM(j) ;
+            for (kl = Lp[j]; kl < Lp[j+1]; kl++)
+            {
+                ip = PERM(Li[kl]) ;
+                kx = spinv_plan_find (Xp, Xi, MAX(ip,jp), MIN(ip,jp)) ;
+                Xmap[k++] = (ip < jp) ? -1-kx : kx ;
+            }
+        }
+    }
+}
+
+
+cholmod_spinv_plan *CHOLMOD(spinv_plan_create)  /* returns the plan */
+(
+    /* ---- input ---- */
+    cholmod_factor *L,	/* numerical factorization */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_spinv_plan *Plan ;
+    cholmod_sparse *X ;
+    spinv_plan_header *h ;
+    Int *Perm, *ColCount, *Lperm, *LColCount ;
+    Int j, n ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    /* ---------------------------------------------------------------------- */
+    /* pattern of the sparse inverse */
+    /* ---------------------------------------------------------------------- */
+
+    X = CHOLMOD(spinv_gather) (L, NULL, CHOLMOD_PATTERN, Common) ;
+    if (X == NULL)
+        return (NULL) ;
+
+    Plan = CHOLMOD(calloc)(1, sizeof(cholmod_spinv_plan), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free_sparse) (&X, Common) ;
+        return (NULL) ;
+    }
+    n = L->n ;
+    Plan->n = n ;
+    Plan->nzx = ((Int *) X->p)[n] ;
+    Plan->nlayout = CHOLMOD(spinv_layout_size) (L) ;
+    Plan->is_super = L->is_super ;
+    Plan->ordering = L->ordering ;
+    if (L->is_super)
+    {
+        Plan->nsuper = L->nsuper ;
+        Plan->ssize = L->ssize ;
+        Plan->maxcsize = L->maxcsize ;
+        Plan->maxesize = L->maxesize ;
+    }
+
+    // Zeroed, so that the padding of the file is defined
+    Plan->size = spinv_plan_arrays (Plan) ;
+    Plan->data = CHOLMOD(calloc)(Plan->size, 1, Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        CHOLMOD(free_sparse) (&X, Common) ;
+        CHOLMOD(spinv_plan_free) (&Plan, Common) ;
+        return (NULL) ;
+    }
+    spinv_plan_arrays (Plan) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* header and arrays */
+    /* ---------------------------------------------------------------------- */
+
+    h = Plan->data ;
+    memcpy (h->magic, SPINV_PLAN_MAGIC, 8) ;
+    h->version = SPINV_PLAN_VERSION ;
+    h->endian = SPINV_PLAN_ENDIAN ;
+    h->intsize = sizeof (Int) ;
+    h->is_super = Plan->is_super ;
+    h->n = Plan->n ;
+    h->nzx = Plan->nzx ;
+    h->nlayout = Plan->nlayout ;
+    h->nsuper = Plan->nsuper ;
+    h->ssize = Plan->ssize ;
+    h->maxcsize = Plan->maxcsize ;
+    h->maxesize = Plan->maxesize ;
+    h->ordering = Plan->ordering ;
+
+    Perm = Plan->Perm ;
+    ColCount = Plan->ColCount ;
+    Lperm = L->Perm ;
+    LColCount = L->ColCount ;
+    for (j = 0; j < n; j++)
+    {
+        Perm[j] = PERM(j) ;
+        ColCount[j] = (LColCount != NULL) ? LColCount[j] : 0 ;
+    }
+    if (L->is_super)
+    {
+        memcpy (Plan->super, L->super, (L->nsuper+1) * sizeof (Int)) ;
+        memcpy (Plan->pi, L->pi, (L->nsuper+1) * sizeof (Int)) ;
+        memcpy (Plan->px, L->px, (L->nsuper+1) * sizeof (Int)) ;
+        memcpy (Plan->s, L->s, L->ssize * sizeof (Int)) ;
+    }
+    else
+    {
+        memcpy (Plan->p, L->p, (n+1) * sizeof (Int)) ;
+        memcpy (Plan->i, L->i, Plan->nzx * sizeof (Int)) ;
+    }
+    memcpy (Plan->Xp, X->p, (n+1) * sizeof (Int)) ;
+    memcpy (Plan->Xi, X->i, Plan->nzx * sizeof (Int)) ;
+    CHOLMOD(free_sparse) (&X, Common) ;
+
+    spinv_plan_map (L, Plan) ;
+
+    return (Plan) ;
+}
+
+
+int CHOLMOD(spinv_plan_save)
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to write */
+    const char *filename,	/* file to (over)write */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    FILE *f ;
+    char *tmpname ;
+    size_t len ;
+    int ok ;
+
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    RETURN_IF_NULL (Plan, FALSE) ;
+    RETURN_IF_NULL (filename, FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    /*
+     * Written to a temporary file that is renamed, so that a worker that
+     * loads the plan at the same time never maps a partial file
+     */
+    len = strlen (filename) + 32 ;
+    tmpname = CHOLMOD(malloc)(len, 1, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (FALSE) ;
+    snprintf (tmpname, len, "%s.tmp%ld", filename, (long) getpid ()) ;
+
+    f = fopen (tmpname, "wb") ;
+    ok = (f != NULL) ;
+    if (ok)
+    {
+        ok = (fwrite (Plan->data, 1, Plan->size, f) == Plan->size) ;
+        ok = (fclose (f) == 0) && ok ;
+        ok = ok && (rename (tmpname, filename) == 0) ;
+        if (!ok)
+            remove (tmpname) ;
+    }
+    CHOLMOD(free)(len, 1, tmpname, Common) ;
+
+    if (!ok)
+        ERROR (CHOLMOD_INVALID, "cannot write the plan file") ;
+    return (ok) ;
+}
+
+
+cholmod_spinv_plan *CHOLMOD(spinv_plan_load)  /* returns the plan */
+(
+    /* ---- input ---- */
+    const char *filename,	/* file written by cholmod_spinv_plan_save */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_spinv_plan *Plan ;
+    spinv_plan_header *h ;
+    struct stat st ;
+    void *data ;
+    int fd ;
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (filename, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    /* ---------------------------------------------------------------------- */
+    /* map the file */
+    /* ---------------------------------------------------------------------- */
+
+    fd = open (filename, O_RDONLY) ;
+    if (fd < 0 || fstat (fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close (fd) ;
+        ERROR (CHOLMOD_INVALID, "cannot open the plan file") ;
+        return (NULL) ;
+    }
+    if (st.st_size < (off_t) sizeof (spinv_plan_header))
+    {
+        close (fd) ;
+        ERROR (CHOLMOD_INVALID, "not a plan file") ;
+        return (NULL) ;
+    }
+    data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) ;
+    close (fd) ;
+    if (data == MAP_FAILED)
+    {
+        ERROR (CHOLMOD_INVALID, "cannot map the plan file") ;
+        return (NULL) ;
+    }
+
+    /* ---------------------------------------------------------------------- */
+    /* check the header */
+    /* ---------------------------------------------------------------------- */
+
+    h = data ;
+    if (memcmp (h->magic, SPINV_PLAN_MAGIC, 8) != 0)
+    {
+        munmap (data, st.st_size) ;
+        ERROR (CHOLMOD_INVALID, "not a plan file") ;
+        return (NULL) ;
+    }
+    if (h->endian != SPINV_PLAN_ENDIAN)
+    {
+        munmap (data, st.st_size) ;
+        ERROR (CHOLMOD_INVALID, "plan file has a different byte order") ;
+        return (NULL) ;
+    }
+    if (h->version != SPINV_PLAN_VERSION)
+    {
+        munmap (data, st.st_size) ;
+        ERROR (CHOLMOD_INVALID, "unsupported plan file version") ;
+        return (NULL) ;
+    }
+    if (h->intsize != sizeof (Int))
+    {
+        munmap (data, st.st_size) ;
+        ERROR (CHOLMOD_INVALID, "plan file has a different integer size") ;
+        return (NULL) ;
+    }
+
+    Plan = CHOLMOD(calloc)(1, sizeof(cholmod_spinv_plan), Common) ;
+    if (Common->status < CHOLMOD_OK)
+    {
+        munmap (data, st.st_size) ;
+        return (NULL) ;
+    }
+    Plan->n = h->n ;
+    Plan->nzx = h->nzx ;
+    Plan->nlayout = h->nlayout ;
+    Plan->is_super = h->is_super ;
+    Plan->ordering = h->ordering ;
+    Plan->nsuper = h->nsuper ;
+    Plan->ssize = h->ssize ;
+    Plan->maxcsize = h->maxcsize ;
+    Plan->maxesize = h->maxesize ;
+    Plan->data = data ;
+    Plan->size = st.st_size ;
+    Plan->mapped = TRUE ;
+
+    if (spinv_plan_arrays (Plan) != Plan->size)
+    {
+        CHOLMOD(spinv_plan_free) (&Plan, Common) ;
+        ERROR (CHOLMOD_INVALID, "plan file is truncated or corrupt") ;
+        return (NULL) ;
+    }
+    return (Plan) ;
+}
+
+
+cholmod_factor *CHOLMOD(spinv_plan_factor)  /* returns a symbolic factor */
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to use */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_factor *L ;
+    size_t nsuper1 ;
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (Plan, NULL) ;
+    Common->status = CHOLMOD_OK ;
+
+    L = CHOLMOD(allocate_factor) (Plan->n, Common) ;
+    if (Common->status < CHOLMOD_OK)
+        return (NULL) ;
+    memcpy (L->Perm, Plan->Perm, Plan->n * sizeof (Int)) ;
+    memcpy (L->ColCount, Plan->ColCount, Plan->n * sizeof (Int)) ;
+    L->ordering = Plan->ordering ;
+
+    if (Plan->is_super)
+    {
+        // Supernodal symbolic factor as left by cholmod_super_symbolic
+        nsuper1 = Plan->nsuper + 1 ;
+        L->is_super = TRUE ;
+        L->is_ll = TRUE ;
+        L->is_monotonic = TRUE ;
+        L->nsuper = Plan->nsuper ;
+        L->ssize = Plan->ssize ;
+        L->xsize = Plan->nlayout ;
+        L->maxcsize = Plan->maxcsize ;
+        L->maxesize = Plan->maxesize ;
+        L->super = CHOLMOD(malloc)(nsuper1, sizeof(Int), Common) ;
+        L->pi = CHOLMOD(malloc)(nsuper1, sizeof(Int), Common) ;
+        L->px = CHOLMOD(malloc)(nsuper1, sizeof(Int), Common) ;
+        L->s = CHOLMOD(malloc)(Plan->ssize, sizeof(Int), Common) ;
+        if (Common->status < CHOLMOD_OK)
+        {
+            CHOLMOD(free_factor) (&L, Common) ;
+            return (NULL) ;
+        }
+        memcpy (L->super, Plan->super, nsuper1 * sizeof (Int)) ;
+        memcpy (L->pi, Plan->pi, nsuper1 * sizeof (Int)) ;
+        memcpy (L->px, Plan->px, nsuper1 * sizeof (Int)) ;
+        memcpy (L->s, Plan->s, Plan->ssize * sizeof (Int)) ;
+    }
+
+    return (L) ;
+}
+
+
+/*
+ * Size in bytes of the image of the plan of L, from the sizes of L only
+ */
+size_t CHOLMOD(spinv_plan_size)
+(
+    cholmod_factor *L
+)
+{
+    cholmod_spinv_plan Plan ;
+    Int *Super, *Lpi, *Lp ;
+    Int s, ms, ns ;
+
+    memset (&Plan, 0, sizeof (Plan)) ;
+    Plan.n = L->n ;
+    Plan.is_super = L->is_super ;
+    if (L->is_super)
+    {
+        Super = L->super ;
+        Lpi = L->pi ;
+        for (s = 0; s < L->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            Plan.nzx += ns*ms - (ns*(ns-1))/2 ;
+        }
+        Plan.nsuper = L->nsuper ;
+        Plan.ssize = L->ssize ;
+    }
+    else
+    {
+        Lp = L->p ;
+        Plan.nzx = Lp[L->n] ;
+    }
+    return (spinv_plan_arrays (&Plan)) ;
+}
+
+
+/*
+ * TRUE if L has the permutation and the layout of the plan, including the
+ * row indices (Ls or Li)
+ */
+int CHOLMOD(spinv_plan_matches)
+(
+    cholmod_spinv_plan *Plan,
+    cholmod_factor *L
+)
+{
+    Int *Lperm, *Perm ;
+    Int j ;
+    size_t nsuper1 ;
+
+    if (L->n != Plan->n || (L->is_super != 0) != (Plan->is_super != 0)
+        || CHOLMOD(spinv_layout_size) (L) != Plan->nlayout)
+        return (FALSE) ;
+
+    Lperm = L->Perm ;
+    Perm = Plan->Perm ;
+    for (j = 0; j < Plan->n; j++)
+        if (PERM(j) != Perm[j])
+            return (FALSE) ;
+
+    if (Plan->is_super)
+    {
+        nsuper1 = Plan->nsuper + 1 ;
+        return (L->nsuper == Plan->nsuper && L->ssize == Plan->ssize
+                && memcmp (L->super, Plan->super, nsuper1*sizeof(Int)) == 0
+                && memcmp (L->pi, Plan->pi, nsuper1*sizeof(Int)) == 0
+                && memcmp (L->px, Plan->px, nsuper1*sizeof(Int)) == 0
+                && memcmp (L->s, Plan->s, Plan->ssize*sizeof(Int)) == 0) ;
+    }
+    return (memcmp (L->p, Plan->p, (Plan->n+1) * sizeof (Int)) == 0
+            && memcmp (L->i, Plan->i, Plan->nzx * sizeof (Int)) == 0) ;
+}
+
+
+/*
+ * Move the len elements of the layout from Xf[kl] on to X, using the map
+ * from Xmap[k] on.  Returns the position in Xmap after them.
+ */
+static Int spinv_plan_move
+(
+    Int *Xmap,
+    Int k,
+    double *Xf,
+    Int kl,
+    Int len,
+    double *Xx,
+    int xtype
+)
+{
+    Int t, kx ;
+
+    if (xtype == CHOLMOD_COMPLEX)
+    {
+        for (t = 0; t < len; t++, k++, kl++)
+        {
+            kx = Xmap[k] ;
+            if (kx >= 0)
+            {
+                Xx[2*kx] = Xf[2*kl] ;
+                Xx[2*kx+1] = Xf[2*kl+1] ;
+            }
+            else
+            {
+                Xx[2*(-1-kx)] = Xf[2*kl] ;
+                Xx[2*(-1-kx)+1] = -Xf[2*kl+1] ;
+            }
+        }
+    }
+    else
+    {
+        for (t = 0; t < len; t++, k++, kl++)
+        {
+            kx = Xmap[k] ;
+            Xx[kx >= 0 ? kx : -1-kx] = Xf[kl] ;
+        }
+    }
+    return (k) ;
+}
+
+
+cholmod_sparse *CHOLMOD(spinv_plan_numeric)  /* returns the sparse inverse */
+(
+    /* ---- input ---- */
+    cholmod_spinv_plan *Plan,	/* plan to use */
+    cholmod_factor *L,	/* factorization of the symbolic factor of Plan */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    cholmod_sparse *X ;
+    double *Xf, *Xx ;
+    Int *Xmap, *Super, *Lpi, *Lpx, *Lp ;
+    Int s, j, k, ms, ns ;
+    size_t fsize ;
+    int xtype ;
+
+    /* ---------------------------------------------------------------------- */
+    /* check inputs */
+    /* ---------------------------------------------------------------------- */
+
+    RETURN_IF_NULL_COMMON (NULL) ;
+    RETURN_IF_NULL (Plan, NULL) ;
+    RETURN_IF_NULL (L, NULL) ;
+    RETURN_IF_XTYPE_INVALID (L, CHOLMOD_REAL, CHOLMOD_ZOMPLEX, NULL) ;
+    Common->status = CHOLMOD_OK ;
+    if (!CHOLMOD(spinv_plan_matches) (Plan, L))
+    {
+        ERROR (CHOLMOD_INVALID, "factor does not match the plan") ;
+        return (NULL) ;
+    }
+
+    /* ---------------------------------------------------------------------- */
+    /* inverse in the layout of L and its pattern from the plan */
+    /* ---------------------------------------------------------------------- */
+
+    xtype = (L->xtype == CHOLMOD_REAL) ? CHOLMOD_REAL : CHOLMOD_COMPLEX ;
+    fsize = Plan->nlayout * ((xtype == CHOLMOD_COMPLEX) ? 2 : 1) ;
+    Xf = CHOLMOD(spinv_malloc)(fsize, sizeof(double), Common) ;
+    X = CHOLMOD(allocate_sparse) (Plan->n, Plan->n, Plan->nzx, TRUE, TRUE,
+                                  -1, xtype, Common) ;
+    if (Common->status < CHOLMOD_OK
+        || !CHOLMOD(spinv_numeric) (L, Xf, Common))
+    {
+        CHOLMOD(spinv_free)(fsize, sizeof(double), Xf, Common) ;
+        CHOLMOD(free_sparse) (&X, Common) ;
+        return (NULL) ;
+    }
+    memcpy (X->p, Plan->Xp, (Plan->n+1) * sizeof (Int)) ;
+    memcpy (X->i, Plan->Xi, Plan->nzx * sizeof (Int)) ;
+
+    /* ---------------------------------------------------------------------- */
+    /* move the elements to X */
+    /* ---------------------------------------------------------------------- */
+
+    Xmap = Plan->Xmap ;
+    Xx = X->x ;
+    k = 0 ;
+    if (Plan->is_super)
+    {
+        Super = Plan->super ;
+        Lpi = Plan->pi ;
+        Lpx = Plan->px ;
+        for (s = 0; s < Plan->nsuper; s++)
+        {
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            for (j = 0; j < ns; j++)
+                k = spinv_plan_move (Xmap, k, Xf, Lpx[s] + j + j*ms, ms - j,
+                                     Xx, xtype) ;
+        }
+    }
+    else
+    {
+        Lp = Plan->p ;
+        for (j = 0; j < Plan->n; j++)
+            k = spinv_plan_move (Xmap, k, Xf, Lp[j], Lp[j+1] - Lp[j], Xx,
+                                 xtype) ;
+    }
+
+    CHOLMOD(spinv_free)(fsize, sizeof(double), Xf, Common) ;
+    return (X) ;
+}
+
+
+int CHOLMOD(spinv_plan_free)
+(
+    /* ---- in/out --- */
+    cholmod_spinv_plan **Plan,	/* plan to free, NULL on output */
+    /* --------------- */
+    cholmod_common *Common
+    )
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    if (Plan == NULL || *Plan == NULL)
+        return (TRUE) ;
+
+    if ((*Plan)->mapped)
+        munmap ((*Plan)->data, (*Plan)->size) ;
+    else
+        CHOLMOD(free)((*Plan)->size, 1, (*Plan)->data, Common) ;
+    *Plan = CHOLMOD(free)(1, sizeof(cholmod_spinv_plan), *Plan, Common) ;
+
+    return (TRUE) ;
+}
@@ -0,0 +1,454 @@
+/* ========================================================================== */
+/* === cholmod_spinv_sched ================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_sched.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Hybrid scheduling of the supernodal sparse inverse.  The recursion goes
+ * from the roots of the supernodal elimination tree to the leaves, and a
+ * supernode needs the inverse only at its ancestors, thus disjoint subtrees
+ * are independent.  The tree is cut so that every subtree below the cut
+ * costs at most 1/SPINV_SUBTREES_PER_THREAD of the work of a thread.  The
+ * supernodes above the cut, the large fronts near the roots, are done
+ * first, one at a time, with the BLAS threads chosen from the flops of the
+ * front.  The subtrees below the cut are then run concurrently, the largest
+ * first, each by one thread with single-threaded BLAS.
+ *
+ * The number of threads is Common->nthreads_max, limited by the OpenMP
+ * default (omp_get_max_threads), divided by the threaded parts of inverses
+ * running in the process at the same time (e.g. the jobs of
+ * cholmod_spinv_submit).  It is derived again for each front above the cut
+ * and before the subtrees, thus a part that started alone gives up threads
+ * to those started later.  The number of BLAS threads is set with a hook,
+ * by default openblas_set_num_threads, which sets it for the whole process:
+ * the hook is called under a lock, the BLAS is single-threaded while more
+ * than one part runs, and the number of BLAS threads before the first part
+ * is restored when the last one ends.  Without OpenMP, or with one thread,
+ * the supernodes are done one at a time as before.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Subtrees below the cut per thread, for load balance
+#define SPINV_SUBTREES_PER_THREAD 4
+
+// Flops of a front per BLAS thread above the cut
+#define SPINV_FLOPS_PER_THREAD 4e6
+
+// Least flops of the whole inverse for which threads are used
+#define SPINV_PARALLEL_FLOPS 1e7
+
+// The workspace of each thread starts on its own page (of 4096 bytes), thus
+// it is placed on the NUMA node of the thread (see cholmod_spinv_memory.c)
+#define SPINV_PAGE_ITEMS (4096 / sizeof(Int))
+#define SPINV_PAGE_ROUND(k) \
+    (SPINV_PAGE_ITEMS * (((k) + SPINV_PAGE_ITEMS - 1) / SPINV_PAGE_ITEMS))
+
+static int spinv_blas_default (int nthreads)
+{
+#ifdef OPENBLAS_VERSION
+    int previous = openblas_get_num_threads () ;
+    openblas_set_num_threads (nthreads) ;
+    return (previous) ;
+#else
+    return (0) ;
+#endif
+}
+
+static cholmod_spinv_blas_hook spinv_blas_hook = spinv_blas_default ;
+
+// Threaded parts of inverses running in the process, and the BLAS threads
+// set by the hook (0 if none) and before its first call
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER ;
+static int sched_active = 0 ;
+static int sched_blas = 0 ;
+static int sched_saved = 0 ;
+
+static int spinv_threads_locked (cholmod_common *Common)
+{
+    int nthreads ;
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads () ;
+#else
+    nthreads = 1 ;
+#endif
+    if (Common->nthreads_max > 0)
+        nthreads = MIN (nthreads, Common->nthreads_max) ;
+    return (MAX (1, nthreads / MAX (1, sched_active))) ;
+}
+
+#ifdef _OPENMP
+
+/*
+ * Sets the BLAS threads of the process, a single one while more than one
+ * part runs
+ */
+static void spinv_blas_set (int nblas)
+{
+    int previous ;
+
+    pthread_mutex_lock (&sched_lock) ;
+    if (sched_active > 1)
+        nblas = 1 ;
+    if (nblas != sched_blas)
+    {
+        previous = spinv_blas_hook (nblas) ;
+        if (sched_blas == 0)
+            sched_saved = previous ;
+        sched_blas = nblas ;
+    }
+    pthread_mutex_unlock (&sched_lock) ;
+}
+
+#endif
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_threads_enter ========================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_threads_enter)
+(
+    cholmod_common *Common
+)
+{
+    int nthreads ;
+
+    pthread_mutex_lock (&sched_lock) ;
+    sched_active++ ;
+    nthreads = spinv_threads_locked (Common) ;
+    pthread_mutex_unlock (&sched_lock) ;
+    return (nthreads) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_threads_share ========================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_threads_share)
+(
+    cholmod_common *Common
+)
+{
+    int nthreads ;
+
+    pthread_mutex_lock (&sched_lock) ;
+    nthreads = spinv_threads_locked (Common) ;
+    pthread_mutex_unlock (&sched_lock) ;
+    return (nthreads) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_threads_leave ========================================== */
+/* ========================================================================== */
+
+void CHOLMOD(spinv_threads_leave)
+(
+    void
+)
+{
+    pthread_mutex_lock (&sched_lock) ;
+    sched_active-- ;
+    if (sched_active == 0 && sched_blas != 0)
+    {
+        if (sched_saved > 0)
+            spinv_blas_hook (sched_saved) ;
+        sched_blas = 0 ;
+        sched_saved = 0 ;
+    }
+    pthread_mutex_unlock (&sched_lock) ;
+}
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_blas_threads =========================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_blas_threads)
+(
+    /* ---- input ---- */
+    cholmod_spinv_blas_hook hook,	/* new hook, NULL for the default */
+    /* --------------- */
+    cholmod_common *Common
+)
+{
+    RETURN_IF_NULL_COMMON (FALSE) ;
+    Common->status = CHOLMOD_OK ;
+
+    pthread_mutex_lock (&sched_lock) ;
+    spinv_blas_hook = (hook != NULL) ? hook : spinv_blas_default ;
+    pthread_mutex_unlock (&sched_lock) ;
+    return (TRUE) ;
+}
+
+
+#ifdef _OPENMP
+
+/*
+ * Flops of cholmod_spinv_block for a front with ms rows and ns columns, as
+ * in cholmod_spinv_estimate.
+ */
+static double spinv_front_flops (Int ms, Int ns)
+{
+    double m2 = ms - ns ;
+
+    return (2*m2*m2*ns + 2.0*ns*ns*m2 + (double) ns*ns*ns
+            + (double) ms*ns*ns) ;
+}
+
+// Subtree below the cut: Order[first..last-1] from its root down
+typedef struct spinv_task_struct
+{
+    double flops ;
+    Int first ;
+    Int last ;
+} spinv_task ;
+
+static int spinv_task_compare (const void *a, const void *b)
+{
+    double fa = ((const spinv_task *) a)->flops ;
+    double fb = ((const spinv_task *) b)->flops ;
+
+    return ((fa < fb) - (fa > fb)) ;
+}
+
+#endif
+
+
+/* ========================================================================== */
+/* === cholmod_spinv_super_hybrid =========================================== */
+/* ========================================================================== */
+
+int CHOLMOD(spinv_super_hybrid)
+(
+    cholmod_factor *L,
+    double *Xf,
+    double *V,
+    double *Z,
+    Int *map,
+    cholmod_common *Common
+)
+{
+#ifdef _OPENMP
+    spinv_task *Task ;
+    double *Flops, *Vt, *Zt ;
+    Int *Super, *Lpi, *Ls, *Colsuper, *Parent, *Owner, *Order, *Mapt ;
+    Int n, nsuper, s, j, k, t, p, ms, ns, ntask ;
+    size_t vsub, zsub ;
+    double total, cut ;
+    int nthreads, nblas, share, scheduled ;
+
+    n = L->n ;
+    nsuper = L->nsuper ;
+    Super = L->super ;
+    Lpi = L->pi ;
+    Ls = L->s ;
+
+    if (omp_in_parallel () || nsuper < 2)
+        return (FALSE) ;
+    nthreads = omp_get_max_threads () ;
+    if (Common->nthreads_max > 0)
+        nthreads = MIN (nthreads, Common->nthreads_max) ;
+    if (nthreads <= 1)
+        return (FALSE) ;
+
+    /*
+     * Supernodal elimination tree and the flops of each subtree.  The parent
+     * of a supernode is the one of its first off-diagonal row, thus it has a
+     * larger index.
+     */
+    Colsuper = CHOLMOD(malloc)(n, sizeof(Int), Common) ;
+    Parent = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Owner = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Order = CHOLMOD(malloc)(nsuper, sizeof(Int), Common) ;
+    Flops = CHOLMOD(malloc)(nsuper, sizeof(double), Common) ;
+    Task = CHOLMOD(malloc)(nsuper, sizeof(spinv_task), Common) ;
+    Vt = NULL ;
+    Zt = NULL ;
+    Mapt = NULL ;
+    vsub = 1 ;
+    zsub = 1 ;
+    scheduled = FALSE ;
+    if (Common->status < CHOLMOD_OK)
+        goto done ;
+
+    for (s = 0; s < nsuper; s++)
+    {
+        for (j = Super[s]; j < Super[s+1]; j++)
+            Colsuper[j] = s ;
+    }
+
+    total = 0 ;
+    for (s = 0; s < nsuper; s++)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        Parent[s] = (ms > ns) ? Colsuper[Ls[Lpi[s]+ns]] : -1 ;
+        Flops[s] = spinv_front_flops (ms, ns) ;
+        total += Flops[s] ;
+    }
+    if (total < SPINV_PARALLEL_FLOPS)
+        goto done ;
+
+    for (s = 0; s < nsuper; s++)
+    {
+        if (Parent[s] >= 0)
+            Flops[Parent[s]] += Flops[s] ;
+    }
+
+    /*
+     * Cut the tree: a supernode is above the cut (Owner -1) if its subtree is
+     * too large, otherwise it belongs to the subtree (task) of its highest
+     * ancestor below the cut.  The supernodes of a task are ordered from its
+     * root down.
+     */
+    cut = total / ((double) SPINV_SUBTREES_PER_THREAD * nthreads) ;
+    ntask = 0 ;
+    for (s = nsuper - 1; s >= 0; s--)
+    {
+        p = Parent[s] ;
+        if (Flops[s] > cut)
+        {
+            Owner[s] = -1 ;
+        }
+        else if (p < 0 || Owner[p] < 0)
+        {
+            Task[ntask].flops = Flops[s] ;
+            Task[ntask].last = 0 ;
+            Owner[s] = ntask++ ;
+        }
+        else
+        {
+            Owner[s] = Owner[p] ;
+        }
+    }
+
+    for (s = 0; s < nsuper; s++)
+    {
+        if (Owner[s] >= 0)
+        {
+            Task[Owner[s]].last++ ;
+            ns = Super[s+1] - Super[s] ;
+            ms = Lpi[s+1] - Lpi[s] ;
+            vsub = MAX (vsub, (size_t) ((ms-ns)*(ms-ns))) ;
+            zsub = MAX (zsub, (size_t) (ms*ns)) ;
+        }
+    }
+    k = 0 ;
+    for (t = 0; t < ntask; t++)
+    {
+        Task[t].first = k ;
+        k += Task[t].last ;
+        Task[t].last = Task[t].first ;
+    }
+    for (s = nsuper - 1; s >= 0; s--)
+    {
+        if (Owner[s] >= 0)
+            Order[Task[Owner[s]].last++] = s ;
+    }
+
+    // Workspace of each thread, of the size of the fronts below the cut
+    vsub = SPINV_PAGE_ROUND (vsub) ;
+    zsub = SPINV_PAGE_ROUND (zsub) ;
+    Vt = CHOLMOD(spinv_malloc)(vsub*nthreads, sizeof(double), Common) ;
+    Zt = CHOLMOD(spinv_malloc)(zsub*nthreads, sizeof(double), Common) ;
+    Mapt = CHOLMOD(spinv_malloc)(vsub*nthreads, sizeof(Int), Common) ;
+    if (Common->status < CHOLMOD_OK)
+        goto done ;
+
+    /*
+     * Supernodes above the cut from the roots down, with threaded BLAS
+     */
+    CHOLMOD(spinv_threads_enter) (Common) ;
+    for (s = nsuper - 1; s >= 0; s--)
+    {
+        if (Owner[s] >= 0)
+            continue ;
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        share = CHOLMOD(spinv_threads_share) (Common) ;
+        nblas = (int) MIN ((double) share,
+                           MAX (1.0, spinv_front_flops (ms, ns)
+                                     / SPINV_FLOPS_PER_THREAD)) ;
+        spinv_blas_set (nblas) ;
+        CHOLMOD(spinv_supernode) (L, s, Xf, V, Z, map, Common) ;
+    }
+
+    /*
+     * Subtrees below the cut concurrently, the largest first, with one BLAS
+     * thread each
+     */
+    if (ntask > 0)
+    {
+        spinv_blas_set (1) ;
+        share = CHOLMOD(spinv_threads_share) (Common) ;
+        qsort (Task, ntask, sizeof(spinv_task), spinv_task_compare) ;
+
+        #pragma omp parallel for num_threads(share) schedule(dynamic,1) \
+            private(k)
+        for (t = 0; t < ntask; t++)
+        {
+            int tid = omp_get_thread_num () ;
+            for (k = Task[t].first; k < Task[t].last; k++)
+            {
+                CHOLMOD(spinv_supernode) (L, Order[k], Xf, Vt + tid*vsub,
+                                          Zt + tid*zsub, Mapt + tid*vsub,
+                                          Common) ;
+            }
+        }
+    }
+
+    CHOLMOD(spinv_threads_leave) () ;
+    scheduled = TRUE ;
+
+done:
+    CHOLMOD(spinv_free)(vsub*nthreads, sizeof(Int), Mapt, Common) ;
+    CHOLMOD(spinv_free)(zsub*nthreads, sizeof(double), Zt, Common) ;
+    CHOLMOD(spinv_free)(vsub*nthreads, sizeof(double), Vt, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(spinv_task), Task, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(double), Flops, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Order, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Owner, Common) ;
+    CHOLMOD(free)(nsuper, sizeof(Int), Parent, Common) ;
+    CHOLMOD(free)(n, sizeof(Int), Colsuper, Common) ;
+
+    // Done here, or failed for lack of memory (reported in Common->status)
+    return (scheduled || Common->status < CHOLMOD_OK) ;
+#else
+    return (FALSE) ;
+#endif
+}
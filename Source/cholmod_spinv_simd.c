@@ -0,0 +1,175 @@
+/* ========================================================================== */
+/* === cholmod_spinv_simd =================================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_spinv_simd.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ *
+ * Indexed copies dst[k] = src[idx[k]], used to collect the part V of the
+ * inverse needed by a supernode or a column from the array in the layout of
+ * L->x.  The positions are scattered over the earlier supernodes, thus on
+ * large factors these copies are limited by memory latency and can cost as
+ * much as the BLAS calls.  The indices are known in advance, so the source
+ * elements are prefetched SPINV_PREFETCH elements ahead.
+ *
+ * On x86-64 with GCC or Clang, AVX2 and AVX-512 versions using the gather
+ * instructions are compiled with target attributes and selected once, on
+ * first use, with __builtin_cpu_supports, so the same binary runs on hosts
+ * without them.  Elsewhere, or with -DNSIMD, the scalar loop is used.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra_internal.h"
+
+#if !defined(NSIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    defined(__x86_64__)
+#define SPINV_SIMD
+#include <immintrin.h>
+#include <pthread.h>
+#endif
+
+// Prefetch distance (in elements) of the indexed copies
+#define SPINV_PREFETCH 16
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch (p)
+#else
+#define PREFETCH(p)
+#endif
+
+static void spinv_copy_scalar
+(
+    double *dst,
+    const double *src,
+    const Int *idx,
+    Int n
+)
+{
+    Int k ;
+
+    for (k = 0; k < n; k++)
+    {
+        if (k + SPINV_PREFETCH < n)
+            PREFETCH (src + idx[k+SPINV_PREFETCH]) ;
+        dst[k] = src[idx[k]] ;
+    }
+}
+
+#ifdef SPINV_SIMD
+
+__attribute__ ((target ("avx2")))
+static void spinv_copy_avx2
+(
+    double *dst,
+    const double *src,
+    const Int *idx,
+    Int n
+)
+{
+    Int k, q ;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        for (q = k + SPINV_PREFETCH; q < MIN (k + SPINV_PREFETCH + 4, n); q++)
+            PREFETCH (src + idx[q]) ;
+#ifdef DLONG
+        _mm256_storeu_pd (dst + k, _mm256_i64gather_pd (
+            src, _mm256_loadu_si256 ((const __m256i *) (idx + k)), 8)) ;
+#else
+        _mm256_storeu_pd (dst + k, _mm256_i32gather_pd (
+            src, _mm_loadu_si128 ((const __m128i *) (idx + k)), 8)) ;
+#endif
+    }
+    spinv_copy_scalar (dst + k, src, idx + k, n - k) ;
+}
+
+__attribute__ ((target ("avx512f")))
+static void spinv_copy_avx512
+(
+    double *dst,
+    const double *src,
+    const Int *idx,
+    Int n
+)
+{
+    Int k, q ;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        for (q = k + SPINV_PREFETCH; q < MIN (k + SPINV_PREFETCH + 8, n); q++)
+            PREFETCH (src + idx[q]) ;
+#ifdef DLONG
+        _mm512_storeu_pd (dst + k, _mm512_i64gather_pd (
+            _mm512_loadu_si512 ((const void *) (idx + k)), src, 8)) ;
+#else
+        _mm512_storeu_pd (dst + k, _mm512_i32gather_pd (
+            _mm256_loadu_si256 ((const __m256i *) (idx + k)), src, 8)) ;
+#endif
+    }
+    spinv_copy_scalar (dst + k, src, idx + k, n - k) ;
+}
+
+// Copy used by cholmod_spinv_gather_lower, set once by spinv_copy_select
+static void (*spinv_copy) (double *, const double *, const Int *, Int) ;
+static pthread_once_t spinv_copy_once = PTHREAD_ONCE_INIT ;
+
+static void spinv_copy_select (void)
+{
+    if (__builtin_cpu_supports ("avx512f"))
+        spinv_copy = spinv_copy_avx512 ;
+    else if (__builtin_cpu_supports ("avx2"))
+        spinv_copy = spinv_copy_avx2 ;
+    else
+        spinv_copy = spinv_copy_scalar ;
+}
+
+#endif
+
+
+/*
+ * Lower triangle of the m x m matrix V: V[i+j*m] = X[map[i+j*m]] for i >= j.
+ */
+void CHOLMOD(spinv_gather_lower)
+(
+    double *V,
+    const double *X,
+    const Int *map,
+    Int m
+)
+{
+    void (*copy) (double *, const double *, const Int *, Int) ;
+    Int j ;
+
+#ifdef SPINV_SIMD
+    pthread_once (&spinv_copy_once, spinv_copy_select) ;
+    copy = spinv_copy ;
+#else
+    copy = spinv_copy_scalar ;
+#endif
+
+    for (j = 0; j < m; j++)
+        copy (V + j + j*m, X, map + j + j*m, m - j) ;
+}
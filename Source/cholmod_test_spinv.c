@@ -39,7 +39,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 int uniform_rand(int l, int u)
 {
@@ -71,6 +76,943 @@ double compute_error(cholmod_dense *A, cholmod_dense *B, cholmod_dense *M)
     return sqrt(error) ;
 }
 
+/*
+ * Compare cholmod_spinv_adjoint to the dense formula: for f = sum of
+ * Xbar.*X, the derivative wrt A is -inv(A)*G*inv(A) where G is Xbar as a
+ * symmetric matrix (off-diagonal elements halved).  Off-diagonal elements of
+ * the result are derivatives wrt both symmetric positions.
+ */
+double compute_adjoint_error(cholmod_factor *L, cholmod_sparse *X,
+                             cholmod_dense *M, cholmod_common *Common)
+{
+    int N, i, j ;
+    double *Gx, *Yx, *Ex ;
+    double error, norm ;
+    cholmod_dense *G, *Y, *E, *Abar ;
+    cholmod_sparse *S ;
+
+    N = X->nrow ;
+
+    // Use Xbar = X
+    S = cholmod_spinv_adjoint(L, X, X, Common) ;
+    G = cholmod_sparse_to_dense(X, Common) ;
+    Gx = G->x ;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            if (i != j)
+                Gx[i+j*N] *= 0.5 ;
+
+    // E = -inv(A)*G*inv(A) with off-diagonal elements doubled
+    Y = cholmod_solve(CHOLMOD_A, L, G, Common) ;
+    Yx = Y->x ;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            Gx[i+j*N] = Yx[j+i*N] ;
+    E = cholmod_solve(CHOLMOD_A, L, G, Common) ;
+    Ex = E->x ;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            Ex[i+j*N] *= (i == j) ? -1.0 : -2.0 ;
+
+    Abar = cholmod_sparse_to_dense(S, Common) ;
+    error = compute_error(E, Abar, M) ;
+    cholmod_free_dense(&Abar, Common) ;
+    Abar = cholmod_zeros(N, N, CHOLMOD_REAL, Common) ;
+    norm = compute_error(E, Abar, M) ;
+
+    cholmod_free_dense(&Abar, Common) ;
+    cholmod_free_dense(&E, Common) ;
+    cholmod_free_dense(&Y, Common) ;
+    cholmod_free_dense(&G, Common) ;
+    cholmod_free_sparse(&S, Common) ;
+    return error / norm ;
+}
+
+/*
+ * Compare cholmod_spinv_fisher to tr(inv(A)*dA[i]*inv(A)*dA[j]) computed
+ * from the dense inverse.  Uses dA = {K, I, K.^2}.
+ */
+double compute_fisher_error(cholmod_factor *L, cholmod_sparse *K,
+                            cholmod_dense *invK, cholmod_common *Common)
+{
+    int N, P, i, j, k, l, q ;
+    double *Dx, *Mx[3], *invKx, *Fx, *Kx ;
+    double error, norm, f ;
+    cholmod_sparse *dA[3] ;
+    cholmod_dense *D, *M[3], *F, *I ;
+
+    N = K->nrow ;
+    P = 3 ;
+    invKx = invK->x ;
+
+    I = cholmod_eye(N, N, CHOLMOD_REAL, Common) ;
+    dA[0] = K ;
+    dA[1] = cholmod_dense_to_sparse(I, 1, Common) ;
+    dA[2] = cholmod_copy_sparse(K, Common) ;
+    Kx = dA[2]->x ;
+    for (k = 0; k < ((int *) dA[2]->p)[N]; k++)
+        Kx[k] *= Kx[k] ;
+
+    F = cholmod_spinv_fisher(L, dA, P, Common) ;
+    Fx = F->x ;
+
+    // M[q] = inv(K)*dA[q]
+    for (q = 0; q < P; q++)
+    {
+        D = cholmod_sparse_to_dense(dA[q], Common) ;
+        Dx = D->x ;
+        M[q] = cholmod_zeros(N, N, CHOLMOD_REAL, Common) ;
+        Mx[q] = M[q]->x ;
+        for (j = 0; j < N; j++)
+            for (k = 0; k < N; k++)
+                if (Dx[k+j*N] != 0)
+                    for (i = 0; i < N; i++)
+                        Mx[q][i+j*N] += invKx[i+k*N] * Dx[k+j*N] ;
+        cholmod_free_dense(&D, Common) ;
+    }
+
+    error = 0 ;
+    norm = 0 ;
+    for (i = 0; i < P; i++)
+    {
+        for (j = 0; j < P; j++)
+        {
+            f = 0 ;
+            for (k = 0; k < N; k++)
+                for (l = 0; l < N; l++)
+                    f += Mx[i][k+l*N] * Mx[j][l+k*N] ;
+            error += (f - Fx[i+j*P]) * (f - Fx[i+j*P]) ;
+            norm += f*f ;
+        }
+    }
+
+    for (q = 0; q < P; q++)
+        cholmod_free_dense(&M[q], Common) ;
+    cholmod_free_dense(&F, Common) ;
+    cholmod_free_dense(&I, Common) ;
+    cholmod_free_sparse(&dA[1], Common) ;
+    cholmod_free_sparse(&dA[2], Common) ;
+    return sqrt(error / norm) ;
+}
+
+/*
+ * Compare cholmod_spinv_diag to the diagonal of the dense inverse.  Returns
+ * the relative error and, in *ratio, the ratio of the actual and the
+ * estimated root-mean-square errors.  The graph given as the unsymmetric
+ * (stype 0) upper triangle of K must give the same estimate.
+ */
+double compute_diag_error(cholmod_factor *L, cholmod_sparse *K,
+                          cholmod_dense *invK, int distance, int nsamples,
+                          double *ratio, cholmod_common *Common)
+{
+    int N, i, j, k, nz ;
+    int *Kp, *Ki, *Up, *Ui ;
+    double *Dx, *Ex, *invKx ;
+    double error, norm, se ;
+    cholmod_sparse *D, *D2, *U ;
+    cholmod_dense *E ;
+
+    N = K->nrow ;
+    invKx = invK->x ;
+
+    D = cholmod_spinv_diag(L, K, distance, nsamples, &E, Common) ;
+    Dx = D->x ;
+    Ex = E->x ;
+
+    // Upper triangle of the packed K with stype 0
+    Kp = K->p ;
+    Ki = K->i ;
+    U = cholmod_allocate_sparse(N, N, Kp[N], 1, 1, 0, CHOLMOD_PATTERN,
+                                Common) ;
+    Up = U->p ;
+    Ui = U->i ;
+    nz = 0 ;
+    for (j = 0; j < N; j++)
+    {
+        Up[j] = nz ;
+        for (k = Kp[j]; k < Kp[j+1]; k++)
+            if (Ki[k] <= j)
+                Ui[nz++] = Ki[k] ;
+    }
+    Up[N] = nz ;
+    D2 = cholmod_spinv_diag(L, U, distance, nsamples, NULL, Common) ;
+    for (i = 0; i < N; i++)
+        if (((double *) D2->x)[i] != Dx[i])
+            Dx[i] = INFINITY ;
+    cholmod_free_sparse(&D2, Common) ;
+    cholmod_free_sparse(&U, Common) ;
+
+    error = 0 ;
+    norm = 0 ;
+    se = 0 ;
+    for (i = 0; i < N; i++)
+    {
+        error += (Dx[i] - invKx[i+i*N]) * (Dx[i] - invKx[i+i*N]) ;
+        norm += invKx[i+i*N] * invKx[i+i*N] ;
+        se += Ex[i] * Ex[i] ;
+    }
+    *ratio = (se > 0) ? sqrt(error / se) : 0 ;
+
+    cholmod_free_dense(&E, Common) ;
+    cholmod_free_sparse(&D, Common) ;
+    return sqrt(error / norm) ;
+}
+
+/*
+ * Compare cholmod_spinv_factor to the dense inverse at the positions of the
+ * factor: Z->x[k] is the element of the permuted inverse at the position of
+ * L->x[k].
+ */
+double compute_factor_error(cholmod_factor *L, cholmod_dense *invK,
+                            cholmod_common *Common)
+{
+    int N, s, i, j, k, ms, ip, jp ;
+    int *Perm, *Super, *Lpi, *Lpx, *Ls, *Lp, *Li ;
+    double *Zx, *invKx ;
+    double error, norm, d ;
+    cholmod_factor *Z ;
+
+    N = L->n ;
+    Perm = L->Perm ;
+    invKx = invK->x ;
+
+    Z = cholmod_spinv_factor(L, Common) ;
+    Zx = Z->x ;
+
+    error = 0 ;
+    norm = 0 ;
+    if (Z->is_super)
+    {
+        Super = Z->super ;
+        Lpi = Z->pi ;
+        Lpx = Z->px ;
+        Ls = Z->s ;
+        for (s = 0; s < Z->nsuper; s++)
+        {
+            ms = Lpi[s+1] - Lpi[s] ;
+            for (j = 0; j < Super[s+1] - Super[s]; j++)
+            {
+                jp = Perm[Super[s]+j] ;
+                for (i = j; i < ms; i++)
+                {
+                    ip = Perm[Ls[Lpi[s]+i]] ;
+                    d = Zx[Lpx[s]+i+j*ms] - invKx[ip+jp*N] ;
+                    error += d * d ;
+                    norm += invKx[ip+jp*N] * invKx[ip+jp*N] ;
+                }
+            }
+        }
+    }
+    else
+    {
+        Lp = Z->p ;
+        Li = Z->i ;
+        for (j = 0; j < N; j++)
+        {
+            jp = Perm[j] ;
+            for (k = Lp[j]; k < Lp[j+1]; k++)
+            {
+                ip = Perm[Li[k]] ;
+                d = Zx[k] - invKx[ip+jp*N] ;
+                error += d * d ;
+                norm += invKx[ip+jp*N] * invKx[ip+jp*N] ;
+            }
+        }
+    }
+
+    cholmod_spinv_free_factor(&Z, Common) ;
+    return sqrt(error / norm) ;
+}
+
+/*
+ * Sparse inverse through a symbolic plan saved to a file and loaded back:
+ * the factor is rebuilt from the plan, factorized and the result is compared
+ * to the sparse inverse V computed from L.  Returns the largest difference,
+ * or infinity if the pattern differs or a step fails.
+ */
+double compute_plan_error(cholmod_sparse *K, cholmod_factor *L,
+                          cholmod_sparse *V, cholmod_common *Common)
+{
+    char filename[] = "/tmp/cholmod_test_spinv_planXXXXXX" ;
+    int fd, j, k ;
+    int *Xp, *Xi, *Vp, *Vi ;
+    double *Xx, *Vx ;
+    double error ;
+    cholmod_spinv_plan *Plan ;
+    cholmod_factor *L2 ;
+    cholmod_sparse *X ;
+
+    fd = mkstemp(filename) ;
+    if (fd < 0)
+        return INFINITY ;
+    close(fd) ;
+
+    Plan = cholmod_spinv_plan_create(L, Common) ;
+    cholmod_spinv_plan_save(Plan, filename, Common) ;
+    cholmod_spinv_plan_free(&Plan, Common) ;
+
+    Plan = cholmod_spinv_plan_load(filename, Common) ;
+    remove(filename) ;
+    if (Plan == NULL)
+        return INFINITY ;
+    L2 = cholmod_spinv_plan_factor(Plan, Common) ;
+    cholmod_factorize(K, L2, Common) ;
+    X = cholmod_spinv_plan_numeric(Plan, L2, Common) ;
+    cholmod_spinv_plan_free(&Plan, Common) ;
+    cholmod_free_factor(&L2, Common) ;
+    if (X == NULL)
+        return INFINITY ;
+
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    Vp = V->p ;
+    Vi = V->i ;
+    Vx = V->x ;
+    error = 0 ;
+    for (j = 0; j <= (int) V->ncol; j++)
+        if (Xp[j] != Vp[j])
+            error = INFINITY ;
+    for (j = 0; error == 0 && j < (int) V->ncol; j++)
+    {
+        for (k = Vp[j]; k < Vp[j+1]; k++)
+        {
+            if (Xi[k] != Vi[k])
+                error = INFINITY ;
+            error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        }
+    }
+
+    cholmod_free_sparse(&X, Common) ;
+    return error ;
+}
+
+/*
+ * Sparse inverse computed twice with the plan cache on: the first call must
+ * miss and the second hit.  A factor with other row indices must not match
+ * the plan.  With a budget below the size of the plan the call must bypass
+ * the cache.  Returns the largest difference to V, or
+ * infinity if the counters are wrong.
+ */
+double compute_cache_error(cholmod_factor *L, cholmod_sparse *V,
+                           cholmod_common *Common)
+{
+    int r, k, print ;
+    size_t hits0, misses0, bypasses0, hits, misses, bypasses, nplans, bytes ;
+    double *Xx, *Vx ;
+    double error ;
+    int *Li ;
+    cholmod_sparse *X ;
+    cholmod_spinv_plan *Plan ;
+
+    cholmod_spinv_cache_stats(&hits0, &misses0, &bypasses0, NULL, NULL, NULL,
+                              Common) ;
+    cholmod_spinv_cache_config(1 << 30, Common) ;
+
+    error = 0 ;
+    Vx = V->x ;
+    for (r = 0; r < 2; r++)
+    {
+        X = cholmod_spinv(L, Common) ;
+        Xx = X->x ;
+        for (k = 0; k < ((int *) V->p)[V->ncol]; k++)
+            error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        cholmod_free_sparse(&X, Common) ;
+    }
+
+    cholmod_spinv_cache_stats(&hits, &misses, &bypasses, NULL, &nplans,
+                              &bytes, Common) ;
+    if (hits != hits0 + 1 || misses != misses0 + 1 || bypasses != bypasses0
+        || nplans != 1)
+        error = INFINITY ;
+
+    // The size known before the plan is created is its size
+    Plan = cholmod_spinv_plan_create(L, Common) ;
+    if (Plan == NULL || Plan->size != bytes)
+        error = INFINITY ;
+
+    // A factor that differs from the plan only in a row index is rejected
+    Li = L->is_super ? (int *) L->s + L->ssize - 1
+                     : (int *) L->i + ((int *) L->p)[L->n] - 1 ;
+    (*Li)++ ;
+    print = Common->print ;
+    Common->print = 0 ;
+    X = cholmod_spinv_plan_numeric(Plan, L, Common) ;
+    Common->print = print ;
+    if (X != NULL || Common->status != CHOLMOD_INVALID)
+        error = INFINITY ;
+    (*Li)-- ;
+    cholmod_free_sparse(&X, Common) ;
+    cholmod_spinv_plan_free(&Plan, Common) ;
+    Common->status = CHOLMOD_OK ;
+
+    // Turning the cache off frees the plans
+    cholmod_spinv_cache_config(0, Common) ;
+    cholmod_spinv_cache_stats(NULL, NULL, NULL, NULL, &nplans, NULL, Common) ;
+    if (nplans != 0)
+        error = INFINITY ;
+
+    // A plan over the budget is neither created nor counted as a miss
+    cholmod_spinv_cache_config(bytes - 1, Common) ;
+    X = cholmod_spinv(L, Common) ;
+    Xx = X->x ;
+    for (k = 0; k < ((int *) V->p)[V->ncol]; k++)
+        error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+    cholmod_free_sparse(&X, Common) ;
+    cholmod_spinv_cache_stats(NULL, &misses0, &bypasses0, NULL, &nplans,
+                              NULL, Common) ;
+    if (misses0 != misses || bypasses0 != bypasses + 1 || nplans != 0)
+        error = INFINITY ;
+    cholmod_spinv_cache_config(0, Common) ;
+    return error ;
+}
+
+/*
+ * Peak memory of cholmod_spinv with one thread relative to the original
+ * implementation, which held the result, a map of L->xsize integers and the
+ * workspace at once, and then twice the result in cholmod_sort.  The matrix
+ * is block-tridiagonal (N blocks of size b) with a supernodal factor in the
+ * natural ordering, large enough for the result to dominate the workspace.
+ * cholmod_spinv_factor must need no more than cholmod_spinv.
+ */
+double compute_memory_ratio(int N, int b, cholmod_common *Common)
+{
+    int *Kp, *Ki, *Super, *Lpi, *Lpx ;
+    int n, i, j, p, s, ns, ms, maxsize, nmethods, ordering, supernodal,
+        nthreads_max ;
+    size_t usage, inuse, nz, xbytes, base, peak ;
+    double *Kx ;
+    double ratio ;
+    cholmod_sparse *K, *X ;
+    cholmod_factor *L, *Z ;
+
+    n = N*b ;
+    K = cholmod_allocate_sparse(n, n, (size_t) n*2*b, 1, 1, 1,
+                                CHOLMOD_REAL, Common) ;
+    Kp = K->p ;
+    Ki = K->i ;
+    Kx = K->x ;
+    p = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        Kp[j] = p ;
+        for (i = (j/b > 0) ? (j/b - 1)*b : 0; i <= j; i++)
+        {
+            Ki[p] = i ;
+            Kx[p++] = (i == j) ? 4.0*b : -1.0/(1+j-i) ;
+        }
+    }
+    Kp[n] = p ;
+
+    nmethods = Common->nmethods ;
+    ordering = Common->method[0].ordering ;
+    supernodal = Common->supernodal ;
+    Common->nmethods = 1 ;
+    Common->method[0].ordering = CHOLMOD_NATURAL ;
+    Common->supernodal = CHOLMOD_SUPERNODAL ;
+    L = cholmod_analyze(K, Common) ;
+    cholmod_factorize(K, L, Common) ;
+    Common->nmethods = nmethods ;
+    Common->method[0].ordering = ordering ;
+    Common->supernodal = supernodal ;
+
+    Super = L->super ;
+    Lpi = L->pi ;
+    Lpx = L->px ;
+    nz = 0 ;
+    maxsize = 0 ;
+    for (s = 0; s < (int) L->nsuper; s++)
+    {
+        ns = Super[s+1] - Super[s] ;
+        ms = Lpi[s+1] - Lpi[s] ;
+        nz += ns*ms - (ns*(ns-1))/2 ;
+        if (Lpx[s+1] - Lpx[s] > maxsize)
+            maxsize = Lpx[s+1] - Lpx[s] ;
+    }
+    xbytes = nz*(sizeof(double)+sizeof(int)) + (n+1)*sizeof(int) ;
+    base = xbytes + (L->xsize + n)*sizeof(int)
+        + (L->maxesize*L->maxesize + maxsize)*sizeof(double) ;
+    if (2*xbytes > base)
+        base = 2*xbytes ;
+
+    nthreads_max = Common->nthreads_max ;
+    Common->nthreads_max = 1 ;
+    usage = Common->memory_usage ;
+    inuse = Common->memory_inuse ;
+    Common->memory_usage = inuse ;
+    X = cholmod_spinv(L, Common) ;
+    peak = Common->memory_usage - inuse ;
+    ratio = (double) peak / base ;
+    if (X == NULL || X->nzmax != nz)
+        ratio = INFINITY ;
+
+    inuse = Common->memory_inuse ;
+    Common->memory_usage = inuse ;
+    Z = cholmod_spinv_factor(L, Common) ;
+    if (Z == NULL || Common->memory_usage - inuse > peak)
+        ratio = INFINITY ;
+    if (Common->memory_usage < usage)
+        Common->memory_usage = usage ;
+    Common->nthreads_max = nthreads_max ;
+
+    cholmod_spinv_free_factor(&Z, Common) ;
+    cholmod_free_sparse(&X, Common) ;
+    cholmod_free_factor(&L, Common) ;
+    cholmod_free_sparse(&K, Common) ;
+    return ratio ;
+}
+
+static int blas_hook_calls = 0 ;
+
+static int count_blas_threads(int nthreads)
+{
+    blas_hook_calls++ ;
+    return 0 ;
+}
+
+/*
+ * Sparse inverse with four threads compared to V, which must have the same
+ * (sorted) pattern.  With OpenMP the hybrid scheduler must set the BLAS
+ * threads through the hook.  If dynamic is nonzero, OpenMP may give the
+ * parallel regions fewer threads than asked for.
+ */
+double compute_threads_error(cholmod_factor *L, cholmod_sparse *V,
+                             int dynamic, cholmod_common *Common)
+{
+    int k, nthreads_max ;
+    double *Xx, *Vx ;
+    double error ;
+    cholmod_sparse *X ;
+#ifdef _OPENMP
+    int omp_threads = omp_get_max_threads() ;
+    int omp_dynamic = omp_get_dynamic() ;
+    omp_set_num_threads(4) ;
+    omp_set_dynamic(dynamic) ;
+#endif
+
+    nthreads_max = Common->nthreads_max ;
+    Common->nthreads_max = 4 ;
+    blas_hook_calls = 0 ;
+    cholmod_spinv_blas_threads(count_blas_threads, Common) ;
+
+    X = cholmod_spinv(L, Common) ;
+    error = 0 ;
+    Xx = X->x ;
+    Vx = V->x ;
+    for (k = 0; k < ((int *) V->p)[V->ncol]; k++)
+    {
+        error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        if (((int *) X->i)[k] != ((int *) V->i)[k])
+            error = INFINITY ;
+    }
+    cholmod_free_sparse(&X, Common) ;
+
+    cholmod_spinv_blas_threads(NULL, Common) ;
+    Common->nthreads_max = nthreads_max ;
+#ifdef _OPENMP
+    omp_set_num_threads(omp_threads) ;
+    omp_set_dynamic(omp_dynamic) ;
+    if (blas_hook_calls == 0)
+        error = INFINITY ;
+#endif
+    return error ;
+}
+
+/*
+ * Sparse inverse with each placement of the large buffers compared to V.
+ */
+double compute_pages_error(cholmod_factor *L, cholmod_sparse *V,
+                           cholmod_common *Common)
+{
+    int mode, k ;
+    size_t inuse ;
+    double *Xx, *Vx ;
+    double error ;
+    cholmod_sparse *X ;
+
+    error = 0 ;
+    Vx = V->x ;
+    inuse = Common->memory_inuse ;
+    for (mode = CHOLMOD_SPINV_PAGES_MALLOC;
+         mode <= CHOLMOD_SPINV_PAGES_HUGETLB; mode++)
+    {
+        cholmod_spinv_pages(mode, Common) ;
+        X = cholmod_spinv(L, Common) ;
+        Xx = X->x ;
+        for (k = 0; k < ((int *) V->p)[V->ncol]; k++)
+            error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        cholmod_free_sparse(&X, Common) ;
+        // The mapped buffers must be returned
+        if (Common->memory_inuse != inuse)
+            error = INFINITY ;
+    }
+    cholmod_spinv_pages(CHOLMOD_SPINV_PAGES_TOUCH, Common) ;
+    return error ;
+}
+
+/*
+ * Sparse inverse written to a temporary file with cholmod_spinv_file and a
+ * memory budget, read back and compared to V.
+ */
+double compute_file_error(cholmod_factor *L, cholmod_sparse *V,
+                          size_t budget, cholmod_common *Common)
+{
+    char filename[] = "/tmp/cholmod_test_spinv_fileXXXXXX" ;
+    int64_t h [5], *Xp, *Xi ;
+    double *Xx, *Vx ;
+    double error ;
+    int fd, k, n, nz ;
+    FILE *f ;
+
+    fd = mkstemp(filename) ;
+    if (fd < 0)
+        return INFINITY ;
+    close(fd) ;
+
+    if (!cholmod_spinv_file(L, filename, budget, Common))
+    {
+        unlink(filename) ;
+        return INFINITY ;
+    }
+    n = V->ncol ;
+    nz = ((int *) V->p)[n] ;
+    Xp = malloc((n+1) * sizeof(int64_t)) ;
+    Xi = malloc(nz * sizeof(int64_t)) ;
+    Xx = malloc(nz * sizeof(double)) ;
+    f = fopen(filename, "rb") ;
+    error = 0 ;
+    if (f == NULL || fread(h, 8, 5, f) != 5 || h[1] != n || h[3] != nz
+        || h[4] != -1 || fread(Xp, 8, n+1, f) != (size_t) n+1
+        || fread(Xi, 8, nz, f) != (size_t) nz
+        || fread(Xx, 8, nz, f) != (size_t) nz)
+        error = INFINITY ;
+    Vx = V->x ;
+    for (k = 0; error == 0 && k <= n; k++)
+        if (Xp[k] != ((int *) V->p)[k])
+            error = INFINITY ;
+    for (k = 0; error < INFINITY && k < nz; k++)
+    {
+        error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        if (Xi[k] != ((int *) V->i)[k])
+            error = INFINITY ;
+    }
+    if (f != NULL)
+        fclose(f) ;
+    unlink(filename) ;
+    free(Xx) ;
+    free(Xi) ;
+    free(Xp) ;
+    return error ;
+}
+
+/*
+ * Records the status of a finished job, data points to a flag of the job.
+ */
+static void record_status(int status, void *data)
+{
+    *(int *) data = status + 1 ;
+}
+
+/*
+ * Three sparse inverses running asynchronously, compared to V.  The
+ * callbacks must have been called before poll returns TRUE, and the
+ * memory must be counted in Common after the results are freed.
+ */
+double compute_async_error(cholmod_factor *L, cholmod_sparse *V,
+                           cholmod_common *Common)
+{
+    int j, k, flags [3] ;
+    size_t inuse ;
+    double *Xx, *Vx ;
+    double error ;
+    cholmod_spinv_job *Job [3] ;
+    cholmod_sparse *X ;
+
+    error = 0 ;
+    Vx = V->x ;
+    inuse = Common->memory_inuse ;
+    cholmod_spinv_async_threads(2, Common) ;
+    for (j = 0; j < 3; j++)
+    {
+        flags[j] = 0 ;
+        if (!cholmod_spinv_submit(L, record_status, &flags[j], &Job[j],
+                                  Common))
+            return INFINITY ;
+    }
+    while (!cholmod_spinv_poll(Job[0], Common))
+        ;
+    if (flags[0] != CHOLMOD_OK + 1)
+        error = INFINITY ;
+    for (j = 0; j < 3; j++)
+    {
+        X = cholmod_spinv_wait(&Job[j], Common) ;
+        if (X == NULL || Job[j] != NULL || flags[j] != CHOLMOD_OK + 1)
+            return INFINITY ;
+        Xx = X->x ;
+        for (k = 0; k < ((int *) V->p)[V->ncol]; k++)
+            error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        cholmod_free_sparse(&X, Common) ;
+    }
+    if (Common->memory_inuse != inuse)
+        error = INFINITY ;
+    return error ;
+}
+
+/*
+ * Sparse inverse of a block-tridiagonal matrix (N blocks of size b) with the
+ * natural ordering, thus with a banded simplicial factor.  Compares to the
+ * inverse from cholmod_solve.
+ */
+double compute_band_error(int N, int b, cholmod_common *Common)
+{
+    int n, i, j, p, nmethods, ordering, supernodal ;
+    double *Ax, *Ix, *Xx ;
+    double error ;
+    cholmod_dense *A, *I, *invK ;
+    cholmod_sparse *K, *X ;
+    cholmod_factor *L ;
+
+    n = N*b ;
+    A = cholmod_zeros(n, n, CHOLMOD_REAL, Common) ;
+    Ax = A->x ;
+    for (j = 0; j < n; j++)
+    {
+        for (i = j; i < n && i/b <= j/b + 1; i++)
+        {
+            Ax[i+j*n] = (i == j) ? 4.0*b : -1.0/(1+i-j) ;
+            Ax[j+i*n] = Ax[i+j*n] ;
+        }
+    }
+    K = cholmod_dense_to_sparse(A, 1, Common) ;
+    K->stype = 1 ;
+
+    nmethods = Common->nmethods ;
+    ordering = Common->method[0].ordering ;
+    supernodal = Common->supernodal ;
+    Common->nmethods = 1 ;
+    Common->method[0].ordering = CHOLMOD_NATURAL ;
+    Common->supernodal = CHOLMOD_SIMPLICIAL ;
+    L = cholmod_analyze(K, Common) ;
+    cholmod_factorize(K, L, Common) ;
+    Common->nmethods = nmethods ;
+    Common->method[0].ordering = ordering ;
+    Common->supernodal = supernodal ;
+
+    X = cholmod_spinv(L, Common) ;
+    I = cholmod_eye(n, n, CHOLMOD_REAL, Common) ;
+    invK = cholmod_solve(CHOLMOD_A, L, I, Common) ;
+    Ix = invK->x ;
+    Xx = X->x ;
+    error = 0 ;
+    for (j = 0; j < n; j++)
+        for (p = ((int *) X->p)[j]; p < ((int *) X->p)[j+1]; p++)
+            error = fmax(error, fabs(Xx[p] - Ix[((int *) X->i)[p]+j*n])) ;
+
+    cholmod_free_dense(&invK, Common) ;
+    cholmod_free_dense(&I, Common) ;
+    cholmod_free_sparse(&X, Common) ;
+    cholmod_free_factor(&L, Common) ;
+    cholmod_free_sparse(&K, Common) ;
+    cholmod_free_dense(&A, Common) ;
+    return error ;
+}
+
+/*
+ * Sparse inverse of a complex Hermitian matrix: K with imaginary parts
+ * 0.5*K[i,j] added to the off-diagonal elements and the diagonal scaled by
+ * 1.2 to keep it positive definite.  Compares to the dense inverse and, if
+ * zomplex is nonzero, uses a zomplex factor.
+ */
+double compute_complex_error(cholmod_dense *A, int supernodal, int zomplex,
+                             cholmod_common *Common)
+{
+    int N, i, j ;
+    double *Ax, *Cx, *Ix, *Sx ;
+    double error, e ;
+    cholmod_dense *C, *I, *invC, *spinvC ;
+    cholmod_sparse *KC, *V ;
+    cholmod_factor *L ;
+
+    N = A->nrow ;
+    Ax = A->x ;
+    C = cholmod_zeros(N, N, CHOLMOD_COMPLEX, Common) ;
+    Cx = C->x ;
+    for (i = 0; i < N; i++)
+    {
+        for (j = 0; j < N; j++)
+        {
+            Cx[2*(i+j*N)] = Ax[i+j*N] * ((i == j) ? 1.2 : 1.0) ;
+            Cx[2*(i+j*N)+1] = (i < j) ? 0.5*Ax[i+j*N] :
+                ((i > j) ? -0.5*Ax[i+j*N] : 0.0) ;
+        }
+    }
+    KC = cholmod_dense_to_sparse(C, 1, Common) ;
+    KC->stype = 1 ;
+
+    Common->supernodal = supernodal ;
+    L = cholmod_analyze(KC, Common) ;
+    cholmod_factorize(KC, L, Common) ;
+    I = cholmod_eye(N, N, CHOLMOD_COMPLEX, Common) ;
+    invC = cholmod_solve(CHOLMOD_A, L, I, Common) ;
+    if (zomplex)
+        cholmod_factor_xtype(CHOLMOD_ZOMPLEX, L, Common) ;
+    V = cholmod_spinv(L, Common) ;
+    spinvC = cholmod_sparse_to_dense(V, Common) ;
+
+    Ix = invC->x ;
+    Sx = spinvC->x ;
+    error = 0 ;
+    for (i = 0; i < 2*N*N; i++)
+    {
+        if (Ax[i/2] != 0)
+        {
+            e = Ix[i] - Sx[i] ;
+            error += e*e ;
+        }
+    }
+
+    cholmod_free_dense(&spinvC, Common) ;
+    cholmod_free_dense(&invC, Common) ;
+    cholmod_free_dense(&I, Common) ;
+    cholmod_free_dense(&C, Common) ;
+    cholmod_free_sparse(&V, Common) ;
+    cholmod_free_sparse(&KC, Common) ;
+    cholmod_free_factor(&L, Common) ;
+    return sqrt(error) ;
+}
+
+/*
+ * Compare cholmod_spinv_lu to the dense inverse of a random unsymmetric
+ * N x N matrix A.  The factorization L*U = (R\A)(P,:) is computed here with
+ * dense partial pivoting, R are the row maxima.
+ */
+double compute_lu_error(int N, cholmod_common *Common)
+{
+    int i, j, k, p, nz ;
+    int *P, *Xp, *Xi ;
+    double *Ax, *Bx, *Gx, *R, *Xx ;
+    double x, error, norm ;
+    cholmod_dense *A, *B, *G ;
+    cholmod_sparse *L, *U, *X ;
+
+    A = cholmod_zeros(N, N, CHOLMOD_REAL, Common) ;
+    Ax = A->x ;
+    for (k = 0; k < 4*N; k++)
+    {
+        i = uniform_rand(0,N) ;
+        j = uniform_rand(0,N) ;
+        Ax[i+j*N] += uniform_rand(-4,4) ;
+    }
+    for (i = 0; i < N; i++)
+        Ax[i+i*N] += 10 ;
+
+    // Row scaling and dense LU with partial pivoting of B = R\A
+    R = malloc(N*sizeof(double)) ;
+    P = malloc(N*sizeof(int)) ;
+    B = cholmod_zeros(N, N, CHOLMOD_REAL, Common) ;
+    Bx = B->x ;
+    for (i = 0; i < N; i++)
+    {
+        R[i] = 0 ;
+        for (j = 0; j < N; j++)
+            R[i] = fmax(R[i], fabs(Ax[i+j*N])) ;
+        for (j = 0; j < N; j++)
+            Bx[i+j*N] = Ax[i+j*N] / R[i] ;
+        P[i] = i ;
+    }
+    for (k = 0; k < N; k++)
+    {
+        p = k ;
+        for (i = k+1; i < N; i++)
+            if (fabs(Bx[i+k*N]) > fabs(Bx[p+k*N]))
+                p = i ;
+        for (j = 0; j < N; j++)
+        {
+            x = Bx[k+j*N] ; Bx[k+j*N] = Bx[p+j*N] ; Bx[p+j*N] = x ;
+        }
+        i = P[k] ; P[k] = P[p] ; P[p] = i ;
+        for (i = k+1; i < N; i++)
+        {
+            Bx[i+k*N] /= Bx[k+k*N] ;
+            for (j = k+1; j < N; j++)
+                Bx[i+j*N] -= Bx[i+k*N] * Bx[k+j*N] ;
+        }
+    }
+    G = cholmod_zeros(N, N, CHOLMOD_REAL, Common) ;
+    Gx = G->x ;
+    for (i = 0; i < N; i++)
+        for (j = 0; j <= i; j++)
+            Gx[i+j*N] = (i == j) ? 1.0 : Bx[i+j*N] ;
+    L = cholmod_dense_to_sparse(G, 1, Common) ;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            Gx[i+j*N] = (i <= j) ? Bx[i+j*N] : 0.0 ;
+    U = cholmod_dense_to_sparse(G, 1, Common) ;
+
+    X = cholmod_spinv_lu(L, U, P, NULL, R, Common) ;
+
+    // Dense inverse of A by Gauss-Jordan elimination of [A I]
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+        {
+            Bx[i+j*N] = Ax[i+j*N] ;
+            Gx[i+j*N] = (i == j) ? 1.0 : 0.0 ;
+        }
+    for (k = 0; k < N; k++)
+    {
+        for (i = 0; i < N; i++)
+        {
+            if (i == k)
+                continue ;
+            x = Bx[i+k*N] / Bx[k+k*N] ;
+            for (j = 0; j < N; j++)
+            {
+                Bx[i+j*N] -= x * Bx[k+j*N] ;
+                Gx[i+j*N] -= x * Gx[k+j*N] ;
+            }
+        }
+    }
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            Gx[i+j*N] /= Bx[i+i*N] ;
+
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    error = 0 ;
+    norm = 0 ;
+    nz = 0 ;
+    for (j = 0; j < N; j++)
+    {
+        for (p = Xp[j]; p < Xp[j+1]; p++)
+        {
+            x = Gx[Xi[p]+j*N] ;
+            error += (Xx[p] - x) * (Xx[p] - x) ;
+            norm += x*x ;
+            nz++ ;
+        }
+    }
+    // The pattern must contain the pattern of A'
+    for (i = 0; i < N; i++)
+        for (j = 0; j < N; j++)
+            if (Ax[i+j*N] != 0)
+            {
+                for (p = Xp[i]; p < Xp[i+1] && Xi[p] != j; p++) ;
+                if (p == Xp[i+1])
+                    error = norm ;
+            }
+
+    cholmod_free_sparse(&X, Common) ;
+    cholmod_free_sparse(&U, Common) ;
+    cholmod_free_sparse(&L, Common) ;
+    cholmod_free_dense(&G, Common) ;
+    cholmod_free_dense(&B, Common) ;
+    cholmod_free_dense(&A, Common) ;
+    free(P) ;
+    free(R) ;
+    return sqrt(error / norm) ;
+}
+
 int main(void)
 {
     int N = 1000 ;
@@ -79,10 +1021,10 @@ int main(void)
     //double *X ;
     int nz = 0;
     double *Ax ;
-    double x, error ;
-    cholmod_dense *A, *invK, *spinvK, *I ;
-    cholmod_sparse *K, *V ;
-    cholmod_factor *L ;
+    double x, error, ratio ;
+    cholmod_dense *A, *invK, *spinvK, *spinvW, *I ;
+    cholmod_sparse *K, *V, *W ;
+    cholmod_factor *L, *L2 ;
     cholmod_common Common ;
     clock_t start, end;
     double cpu_time_used;
@@ -147,6 +1089,96 @@ int main(void)
       }
     printf("PASSED.\n");
 
+    // Same elements in the layout of the factor
+    error = compute_factor_error(L, invK, &Common) ;
+    printf("Error for simplicial factor layout: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Same inverse through a plan file
+    error = compute_plan_error(K, L, V, &Common) ;
+    printf("Error for simplicial plan: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Same inverse through the plan cache
+    error = compute_cache_error(L, V, &Common) ;
+    printf("Error for simplicial plan cache: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Out of core with many windows of the result
+    error = compute_file_error(L, V, (size_t) 1 << 16, &Common) ;
+    printf("Error for simplicial out of core: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Reverse-mode derivative
+    error = compute_adjoint_error(L, V, A, &Common) ;
+    printf("Relative error for simplicial adjoint: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Trace terms
+    error = compute_fisher_error(L, K, invK, &Common) ;
+    printf("Relative error for simplicial trace terms: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Diagonal by probing: exact if no two nodes of a colour are connected
+    error = compute_diag_error(L, K, invK, N, 2, &ratio, &Common) ;
+    printf("Relative error for simplicial probed diagonal: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Diagonal by Hutchinson: the error estimates must match the errors
+    error = compute_diag_error(L, K, invK, 0, 8, &ratio, &Common) ;
+    printf("Error ratio for simplicial Hutchinson diagonal: %g\n", ratio) ;
+    if (ratio < 0.5 || ratio > 2.0)
+      {
+        printf("FAILED: Error estimates inconsistent\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Block-tridiagonal matrix: banded factor
+    error = compute_band_error(100, 4, &Common) ;
+    printf("Error for simplicial block-tridiagonal: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
     /* SUPERNODAL */
 
     // Factorize
@@ -172,6 +1204,198 @@ int main(void)
       }
     printf("PASSED.\n");
 
+    // Same elements in the layout of the factor
+    error = compute_factor_error(L, invK, &Common) ;
+    printf("Error for supernodal factor layout: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Same inverse through a plan file
+    error = compute_plan_error(K, L, V, &Common) ;
+    printf("Error for supernodal plan: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Same inverse through the plan cache
+    error = compute_cache_error(L, V, &Common) ;
+    printf("Error for supernodal plan cache: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Subtrees on threads, threaded BLAS for the large fronts
+    error = compute_threads_error(L, V, 0, &Common) ;
+    printf("Error for supernodal with threads: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Teams smaller than asked for (e.g. on a busy host)
+    error = compute_threads_error(L, V, 1, &Common) ;
+    printf("Error for supernodal with dynamic threads: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Buffers from CHOLMOD(malloc), fresh pages and huge pages
+    error = compute_pages_error(L, V, &Common) ;
+    printf("Error for supernodal with each page mode: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Out of core (everything spilled), with many windows of the result
+    // and within the budget
+    error = fmax(compute_file_error(L, V, 0, &Common),
+                 compute_file_error(L, V, (size_t) 1 << 16, &Common)) ;
+    error = fmax(error, compute_file_error(L, V, (size_t) 1 << 30, &Common)) ;
+    printf("Error for supernodal out of core: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Inverses computed by the worker threads
+    error = compute_async_error(L, V, &Common) ;
+    printf("Error for supernodal asynchronously: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Peak memory at most 3/4 of the original implementation, and no more
+    // in the layout of the factor
+    ratio = compute_memory_ratio(250, 4, &Common) ;
+    printf("Peak memory ratio for supernodal: %g\n", ratio) ;
+    if (ratio > 0.75)
+      {
+        printf("FAILED: Peak memory too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Ordering chosen for the inverse
+    L2 = cholmod_spinv_analyze_ordering(K, &Common) ;
+    cholmod_factorize(K, L2, &Common) ;
+    W = cholmod_spinv(L2, &Common) ;
+    spinvW = cholmod_sparse_to_dense(W, &Common) ;
+    error = compute_error(invK, spinvW, A) ;
+    printf("Error for supernodal with the ordering for the inverse: %g\n",
+           error) ;
+    cholmod_free_dense(&spinvW, &Common) ;
+    cholmod_free_sparse(&W, &Common) ;
+    cholmod_free_factor(&L2, &Common) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Reverse-mode derivative
+    error = compute_adjoint_error(L, V, A, &Common) ;
+    printf("Relative error for supernodal adjoint: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Trace terms
+    error = compute_fisher_error(L, K, invK, &Common) ;
+    printf("Relative error for supernodal trace terms: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Diagonal by probing: exact if no two nodes of a colour are connected
+    error = compute_diag_error(L, K, invK, N, 2, &ratio, &Common) ;
+    printf("Relative error for supernodal probed diagonal: %g\n", error) ;
+    if (error > 1e-10)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    // Diagonal by Hutchinson: the error estimates must match the errors
+    error = compute_diag_error(L, K, invK, 0, 8, &ratio, &Common) ;
+    printf("Error ratio for supernodal Hutchinson diagonal: %g\n", ratio) ;
+    if (ratio < 0.5 || ratio > 2.0)
+      {
+        printf("FAILED: Error estimates inconsistent\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    /* COMPLEX */
+
+    error = compute_complex_error(A, CHOLMOD_SIMPLICIAL, 0, &Common) ;
+    printf("Error for complex simplicial: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    error = compute_complex_error(A, CHOLMOD_SUPERNODAL, 0, &Common) ;
+    printf("Error for complex supernodal: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    error = compute_complex_error(A, CHOLMOD_SUPERNODAL, 1, &Common) ;
+    printf("Error for zomplex supernodal: %g\n", error) ;
+    if (error > 1e-14)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
+    /* UNSYMMETRIC */
+
+    error = compute_lu_error(300, &Common) ;
+    printf("Relative error for unsymmetric LU: %g\n", error) ;
+    if (error > 1e-12)
+      {
+        printf("FAILED: Error too large\n") ;
+        return -1;
+      }
+    printf("PASSED.\n");
+
     /* CLEANUP */
 
     // Free memory
@@ -0,0 +1,169 @@
+/* ========================================================================== */
+/* === cholmod_test_spinv_eigen ============================================= */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_test_spinv_eigen.cpp is licensed under Version 2 of the GNU
+ * General Public License, or (at your option) any later version. See
+ * LICENSE for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * Test the C++ interface (cholmod_extra.hpp) with Eigen matrices.
+ * -------------------------------------------------------------------------- */
+
+#include "cholmod_extra.hpp"
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace cholmod_extra ;
+
+// Lower triangle of a shifted 2D Laplacian on an m-by-m grid, with an
+// imaginary part c on the off-diagonal for complex scalars
+template <typename Scalar, typename Index>
+Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> laplacian (int m,
+                                                               Scalar c)
+{
+    int n = m*m ;
+    std::vector<Eigen::Triplet<Scalar, Index> > T ;
+    for (int j = 0 ; j < n ; j++)
+    {
+        T.push_back (Eigen::Triplet<Scalar, Index> (j, j, 4.5)) ;
+        if (j % m < m-1)
+            T.push_back (Eigen::Triplet<Scalar, Index> (j+1, j, c - 1.0)) ;
+        if (j + m < n)
+            T.push_back (Eigen::Triplet<Scalar, Index> (j+m, j, -1.0)) ;
+    }
+    Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> A (n, n) ;
+    A.setFromTriplets (T.begin (), T.end ()) ;
+    return A ;
+}
+
+// Largest error of the sparse inverse X on its pattern
+template <typename Scalar, typename Index>
+double compute_error (const sparse<Index> &X,
+                      const Eigen::SparseMatrix<Scalar, Eigen::ColMajor,
+                                                Index> &A)
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Dense ;
+    Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> S =
+        A.template selfadjointView<Eigen::Lower> () ;
+    Dense K = S ;
+    Dense invK = K.llt ().solve (Dense::Identity (K.rows (), K.cols ())) ;
+    Eigen::Map<const Eigen::SparseMatrix<Scalar, Eigen::ColMajor, Index> > Xe
+        = X.template eigen<Scalar> () ;
+    double error = 0 ;
+
+    // The map must use the arrays of X
+    if (Xe.valuePtr () != X->x || Xe.outerIndexPtr () != X->p)
+        return INFINITY ;
+    for (Index j = 0 ; j < Xe.outerSize () ; j++)
+        for (typename Eigen::Map<const Eigen::SparseMatrix<
+                 Scalar, Eigen::ColMajor, Index> >::InnerIterator it (Xe, j) ;
+             it ; ++it)
+            error = std::max (error,
+                              std::abs (it.value () - invK (it.row (), j))) ;
+    return error ;
+}
+
+static int report (const char *name, double error, double tol)
+{
+    printf ("Error for %s: %g\n", name, error) ;
+    if (!(error <= tol))
+    {
+        printf ("FAILED: Error too large\n") ;
+        return -1 ;
+    }
+    printf ("PASSED.\n") ;
+    return 0 ;
+}
+
+int main (void)
+{
+    printf ("RUNNING TESTS FOR CHOLMOD-EXTRA C++ INTERFACE...\n") ;
+
+    // Real, int indices, through an Eigen view
+    {
+        common<int> c ;
+        Eigen::SparseMatrix<double, Eigen::ColMajor, int> A =
+            laplacian<double, int> (15, 0.0) ;
+        sparse<int> X = spinv (c, A) ;
+        if (report ("Eigen spinv", compute_error (X, A), 1e-13))
+            return -1 ;
+    }
+
+    // Real, long indices, through a plan
+    {
+        common<int64_t> c ;
+        Eigen::SparseMatrix<double, Eigen::ColMajor, int64_t> A =
+            laplacian<double, int64_t> (12, 0.0) ;
+        factor<int64_t> L = factor<int64_t>::analyze (c, A) ;
+        L.factorize (A) ;
+        plan<int64_t> P = plan<int64_t>::create (L) ;
+        sparse<int64_t> X = P.numeric (L) ;
+        sparse<int64_t> Y = std::move (X) ;
+        if (X || report ("Eigen plan (long)", compute_error (Y, A), 1e-13))
+            return -1 ;
+    }
+
+    // Complex Hermitian
+    {
+        typedef std::complex<double> Complex ;
+        common<int> c ;
+        Eigen::SparseMatrix<Complex, Eigen::ColMajor, int> A =
+            laplacian<Complex, int> (10, Complex (0, 0.3)) ;
+        c->supernodal = CHOLMOD_SIMPLICIAL ;
+        sparse<int> X = spinv (c, A) ;
+        if (report ("Eigen complex spinv", compute_error (X, A), 1e-13))
+            return -1 ;
+    }
+
+    // Errors are thrown
+    {
+        common<int> c ;
+        Eigen::SparseMatrix<double, Eigen::ColMajor, int> A =
+            laplacian<double, int> (4, 0.0) ;
+        int status = CHOLMOD_OK ;
+        A.uncompress () ;
+        try
+        {
+            spinv (c, A) ;
+        }
+        catch (const error &e)
+        {
+            status = e.status () ;
+        }
+        printf ("Status for an uncompressed matrix: %d\n", status) ;
+        if (status != CHOLMOD_INVALID)
+        {
+            printf ("FAILED: No error\n") ;
+            return -1 ;
+        }
+        printf ("PASSED.\n") ;
+    }
+
+    return 0 ;
+}
@@ -0,0 +1,282 @@
+/* ========================================================================== */
+/* === cholmod_test_spinv_mpi =============================================== */
+/* ========================================================================== */
+
+/* -----------------------------------------------------------------------------
+ * Copyright (C) 2012 Jaakko Luttinen
+ *
+ * cholmod_test_spinv_mpi.c is licensed under Version 2 of the GNU General
+ * Public License, or (at your option) any later version. See LICENSE
+ * for a text of the license.
+ * -------------------------------------------------------------------------- */
+
+/* -----------------------------------------------------------------------------
+ * This file is part of CHOLMOD Extra Module.
+ *
+ * CHOLDMOD Extra Module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * CHOLMOD Extra Module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CHOLMOD Extra Module.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------------- */
+
+
+/* -----------------------------------------------------------------------------
+ * Test the sparse inverse distributed over MPI ranks, e.g.
+ * mpirun -np 4 Build/cholmod_test_spinv_mpi (make mpi-check).
+ * -------------------------------------------------------------------------- */
+
+
+#define CHOLMOD_EXTRA_MPI
+#include "cholmod_extra.h"
+#include <cholmod.h>
+#include <math.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Side of the grids at the leaves of the dissection
+#define M 6
+
+/*
+ * Nested dissection by construction: at level 0 an M-by-M grid, otherwise
+ * two matrices of the level below and a separator path of M nodes joined to
+ * the last M nodes of each of them.  The nodes are numbered from *next on in
+ * the order of elimination, so the natural ordering keeps the tree.  Returns
+ * the first of the last M nodes.
+ */
+static int dissection(double *Ax, int N, int level, int *next)
+{
+    int a, b, t, k ;
+
+    if (level == 0)
+    {
+        k = *next ;
+        *next += M*M ;
+        for (t = 0; t < M*M; t++)
+        {
+            if (t % M < M-1)
+                Ax[k+t+1 + (k+t)*N] = Ax[k+t + (k+t+1)*N] = -1 ;
+            if (t + M < M*M)
+                Ax[k+t+M + (k+t)*N] = Ax[k+t + (k+t+M)*N] = -1 ;
+        }
+        return k + M*M - M ;
+    }
+    a = dissection(Ax, N, level-1, next) ;
+    b = dissection(Ax, N, level-1, next) ;
+    k = *next ;
+    *next += M ;
+    for (t = 0; t < M; t++)
+    {
+        Ax[k+t + (a+t)*N] = Ax[a+t + (k+t)*N] = -1 ;
+        Ax[k+t + (b+t)*N] = Ax[b+t + (k+t)*N] = -1 ;
+        if (t < M-1)
+            Ax[k+t+1 + (k+t)*N] = Ax[k+t + (k+t+1)*N] = -1 ;
+    }
+    return k ;
+}
+
+/*
+ * Largest difference of the distributed inverse X to V on the pattern of
+ * V, or on its diagonal if diag is nonzero.  Infinite if the pattern differs.
+ */
+static double compute_error(cholmod_sparse *X, cholmod_sparse *V, int diag)
+{
+    int *Xp, *Xi, *Vp, *Vi ;
+    double *Xx, *Vx ;
+    double error ;
+    int j, k, n ;
+
+    if (X == NULL)
+        return INFINITY ;
+    n = V->ncol ;
+    Xp = X->p ;
+    Xi = X->i ;
+    Xx = X->x ;
+    Vp = V->p ;
+    Vi = V->i ;
+    Vx = V->x ;
+    error = 0 ;
+    for (j = 0; j < n; j++)
+    {
+        if (diag)
+        {
+            // The diagonal is the first element of a column of V
+            if (Xp[j] != j || Xi[j] != j || Vi[Vp[j]] != j)
+                return INFINITY ;
+            error = fmax(error, fabs(Xx[j] - Vx[Vp[j]])) ;
+            continue ;
+        }
+        if (Xp[j+1] != Vp[j+1])
+            return INFINITY ;
+        for (k = Vp[j]; k < Vp[j+1]; k++)
+        {
+            if (Xi[k] != Vi[k])
+                return INFINITY ;
+            error = fmax(error, fabs(Xx[k] - Vx[k])) ;
+        }
+    }
+    return error ;
+}
+
+/*
+ * Largest difference of the sum of the parts X of the ranks to V, or to its
+ * diagonal if diag is nonzero, on the first rank.  Infinite if the parts do
+ * not have as many elements as V (or its diagonal).
+ */
+static double compute_parts_error(cholmod_sparse *X, cholmod_sparse *V,
+                                  int diag, int rank, cholmod_common *Common)
+{
+    cholmod_dense *D, *E ;
+    double *Dx, *Ex ;
+    double error ;
+    long nz ;
+    int i, j, n ;
+
+    n = V->ncol ;
+    if (X != NULL)
+    {
+        D = cholmod_sparse_to_dense(X, Common) ;
+        nz = ((int *) X->p)[n] ;
+    }
+    else
+    {
+        D = cholmod_zeros(n, n, CHOLMOD_REAL, Common) ;
+        nz = -1 - (long) n*n ;
+    }
+    Dx = D->x ;
+    MPI_Reduce((rank == 0) ? MPI_IN_PLACE : Dx, Dx, n*n, MPI_DOUBLE, MPI_SUM,
+               0, MPI_COMM_WORLD) ;
+    MPI_Reduce((rank == 0) ? MPI_IN_PLACE : &nz, &nz, 1, MPI_LONG, MPI_SUM,
+               0, MPI_COMM_WORLD) ;
+    error = 0 ;
+    if (rank == 0)
+    {
+        E = cholmod_sparse_to_dense(V, Common) ;
+        Ex = E->x ;
+        if (nz != (diag ? n : ((int *) V->p)[n]))
+            error = INFINITY ;
+        for (j = 0; j < n; j++)
+            for (i = 0; i < n; i++)
+                error = fmax(error, fabs(Dx[i+j*n] - ((diag && i != j)
+                                                      ? 0 : Ex[i+j*n]))) ;
+        cholmod_free_dense(&E, Common) ;
+    }
+    cholmod_free_dense(&D, Common) ;
+    return error ;
+}
+
+/*
+ * Error is checked on root, and the result is shared so that every rank
+ * returns the same status.
+ */
+static int report(const char *name, double error, double tol, int rank,
+                  int root)
+{
+    int failed ;
+
+    failed = !(error <= tol) ;
+    MPI_Bcast(&failed, 1, MPI_INT, root, MPI_COMM_WORLD) ;
+    if (rank == root)
+    {
+        printf("Error for %s: %g\n", name, error) ;
+        printf(failed ? "FAILED: Error too large\n" : "PASSED.\n") ;
+    }
+    return failed ? -1 : 0 ;
+}
+
+int main(int argc, char **argv)
+{
+    int N, n, j, next, rank, nranks, root, failed ;
+    double *Ax ;
+    cholmod_dense *A ;
+    cholmod_sparse *K, *V, *X ;
+    cholmod_factor *L ;
+    cholmod_common Common ;
+
+    MPI_Init(&argc, &argv) ;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank) ;
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks) ;
+    if (rank == 0)
+        printf("RUNNING TESTS FOR CHOLMOD-EXTRA MPI ON %d RANKS...\n",
+               nranks) ;
+
+    cholmod_start(&Common) ;
+
+    // Every rank forms and factorizes the same matrix, diagonally dominant
+    N = 8*M*M + 7*M ;
+    A = cholmod_zeros(N, N, CHOLMOD_REAL, &Common) ;
+    Ax = A->x ;
+    next = 0 ;
+    dissection(Ax, N, 3, &next) ;
+    for (n = 0; n < N; n++)
+        Ax[n+n*N] = 6 + 0.01*n ;
+    K = cholmod_dense_to_sparse(A, 1, &Common) ;
+    K->stype = 1 ;
+
+    Common.nmethods = 1 ;
+    Common.method[0].ordering = CHOLMOD_NATURAL ;
+    Common.supernodal = CHOLMOD_SUPERNODAL ;
+    L = cholmod_analyze(K, &Common) ;
+    cholmod_factorize(K, L, &Common) ;
+    V = cholmod_spinv(L, &Common) ;
+
+    // Parts kept on the ranks
+    X = cholmod_spinv_mpi(L, 0, CHOLMOD_SPINV_MPI_LOCAL, MPI_COMM_WORLD,
+                          &Common) ;
+    failed = report("parts of the distributed sparse inverse",
+                    compute_parts_error(X, V, 0, rank, &Common), 1e-14, rank,
+                    0) ;
+    cholmod_free_sparse(&X, &Common) ;
+
+    X = cholmod_spinv_mpi(L, 1, CHOLMOD_SPINV_MPI_LOCAL, MPI_COMM_WORLD,
+                          &Common) ;
+    if (!failed)
+        failed = report("parts of the distributed diagonal",
+                        compute_parts_error(X, V, 1, rank, &Common), 1e-14,
+                        rank, 0) ;
+    cholmod_free_sparse(&X, &Common) ;
+
+    // Full inverse gathered on the first rank
+    root = 0 ;
+    X = cholmod_spinv_mpi(L, 0, root, MPI_COMM_WORLD, &Common) ;
+    if (!failed)
+        failed = report("distributed sparse inverse",
+                        (rank == root) ? compute_error(X, V, 0) : 0,
+                        1e-14, rank, root) ;
+    cholmod_free_sparse(&X, &Common) ;
+
+    // Diagonal gathered on the last rank
+    root = nranks - 1 ;
+    X = cholmod_spinv_mpi(L, 1, root, MPI_COMM_WORLD, &Common) ;
+    if (!failed)
+        failed = report("distributed diagonal",
+                        (rank == root) ? compute_error(X, V, 1) : 0,
+                        1e-14, rank, root) ;
+    cholmod_free_sparse(&X, &Common) ;
+
+    // The other ranks get no result
+    X = cholmod_spinv_mpi(L, 0, 0, MPI_COMM_WORLD, &Common) ;
+    j = (rank == 0) == (X != NULL) && Common.status == CHOLMOD_OK ;
+    MPI_Allreduce(MPI_IN_PLACE, &j, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD) ;
+    if (!failed)
+        failed = report("results only on root", j ? 0 : INFINITY, 0, rank,
+                        0) ;
+    cholmod_free_sparse(&X, &Common) ;
+
+    cholmod_free_sparse(&V, &Common) ;
+    cholmod_free_factor(&L, &Common) ;
+    cholmod_free_sparse(&K, &Common) ;
+    cholmod_free_dense(&A, &Common) ;
+    cholmod_finish(&Common) ;
+    MPI_Finalize() ;
+    return failed ;
+}